@@ -0,0 +1,58 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+// Small helpers to read and write plain values, strings and vectors to binary streams.
+// Values are stored in the host byte order: the files are caches, they are not meant to be portable.
+// The length read before a string or a vector is bounded, so a corrupt file fails the read instead of
+// allocating gigabytes.
+
+static const uint32_t maxBinaryBytes = 64 * 1024 * 1024; // of one string or vector
+
+template<typename T>
+inline void writeBinary(std::ostream& out, const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "writeBinary needs a trivially copyable type");
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+inline bool readBinary(std::istream& in, T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "readBinary needs a trivially copyable type");
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return bool(in);
+}
+
+inline void writeBinary(std::ostream& out, const std::string& value) {
+    writeBinary(out, uint32_t(value.size()));
+    out.write(value.data(), value.size());
+}
+
+inline bool readBinary(std::istream& in, std::string& value, uint32_t maxBytes = maxBinaryBytes) {
+    uint32_t size = 0;
+    if (!readBinary(in, size) || size > maxBytes) return false;
+    value.resize(size);
+    in.read(&value[0], size);
+    return bool(in);
+}
+
+template<typename T>
+inline void writeBinary(std::ostream& out, const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable<T>::value, "writeBinary needs a trivially copyable type");
+    writeBinary(out, uint32_t(values.size()));
+    out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template<typename T>
+inline bool readBinary(std::istream& in, std::vector<T>& values, uint32_t maxBytes = maxBinaryBytes) {
+    static_assert(std::is_trivially_copyable<T>::value, "readBinary needs a trivially copyable type");
+    uint32_t size = 0;
+    if (!readBinary(in, size) || size > maxBytes / sizeof(T)) return false;
+    values.resize(size);
+    in.read(reinterpret_cast<char*>(values.data()), size * sizeof(T));
+    return bool(in);
+}
@@ -0,0 +1,202 @@
+#include "FeatureCache.h"
+#include "FeatureHandler.h"
+#include "BinaryIO.h"
+#include <filesystem>
+#include <fstream>
+
+static const uint32_t cacheMagic = 0x4346434D; // "MCFC"
+static const uint32_t cacheFormatVersion = 3;
+
+bool FeatureCache::getFileIdentity(const std::string& path, FileIdentity& identity) {
+    std::error_code error;
+    std::filesystem::path file(ofToDataPath(path, true));
+    identity.size = std::filesystem::file_size(file, error);
+    if (error) return false;
+    auto modified = std::filesystem::last_write_time(file, error);
+    if (error) return false;
+    identity.modifiedTime = modified.time_since_epoch().count();
+    return true;
+}
+
+bool FeatureCache::load() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+
+    std::ifstream in(ofToDataPath(cachePath, true), std::ios::binary);
+    if (!in) return false;
+
+    uint32_t magic = 0, formatVersion = 0, extractorVersion = 0, count = 0;
+    FeatureHandler::RhythmOptions stampedOptions;
+    int32_t imageWidth = 0, imageHeight = 0;
+    readBinary(in, magic);
+    readBinary(in, formatVersion);
+    readBinary(in, extractorVersion);
+    readBinary(in, stampedOptions.frameStride);
+    readBinary(in, stampedOptions.maxSamples);
+    readBinary(in, stampedOptions.timeBudgetSeconds);
+    readBinary(in, stampedOptions.sampleSize);
+    readBinary(in, imageWidth);
+    readBinary(in, imageHeight);
+    if (!readBinary(in, count) || magic != cacheMagic || formatVersion != cacheFormatVersion) {
+        ofLogWarning() << "Ignoring unreadable feature cache " << cachePath;
+        return false;
+    }
+    if (extractorVersion != FeatureHandler::extractorVersion) {
+        ofLogNotice() << "Feature extractors changed, recomputing the feature cache";
+        dirty = true; // overwrite the stale file on the next save
+        return false;
+    }
+    if (stampedOptions.frameStride != rhythmOptions.frameStride || stampedOptions.maxSamples != rhythmOptions.maxSamples
+        || stampedOptions.timeBudgetSeconds != rhythmOptions.timeBudgetSeconds || stampedOptions.sampleSize != rhythmOptions.sampleSize
+        || imageWidth != imageSize.first || imageHeight != imageSize.second) {
+        ofLogNotice() << "Feature settings changed, recomputing the feature cache";
+        dirty = true;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        std::string path;
+        Entry entry;
+        readBinary(in, path);
+        readBinary(in, entry.identity.size);
+        readBinary(in, entry.identity.modifiedTime);
+        if (!readBinary(in, entry.features)) {
+            ofLogWarning() << "Feature cache " << cachePath << " is truncated, kept " << entries.size() << " entries";
+            break;
+        }
+        entries[path] = std::move(entry);
+    }
+    return true;
+}
+
+bool FeatureCache::save(bool pruneUnused) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pruneUnused) {
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (!it->second.used) {
+                it = entries.erase(it);
+                dirty = true;
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+    if (!dirty) return true;
+
+    // Write to a temporary file first so a crash never leaves a half written cache behind
+    std::string finalPath = ofToDataPath(cachePath, true);
+    std::string tempPath = finalPath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            ofLogError() << "Cannot write feature cache " << tempPath;
+            return false;
+        }
+        writeBinary(out, cacheMagic);
+        writeBinary(out, cacheFormatVersion);
+        writeBinary(out, uint32_t(FeatureHandler::extractorVersion));
+        writeBinary(out, rhythmOptions.frameStride);
+        writeBinary(out, rhythmOptions.maxSamples);
+        writeBinary(out, rhythmOptions.timeBudgetSeconds);
+        writeBinary(out, rhythmOptions.sampleSize);
+        writeBinary(out, int32_t(imageSize.first));
+        writeBinary(out, int32_t(imageSize.second));
+        writeBinary(out, uint32_t(entries.size()));
+        for (const auto& pair : entries) {
+            writeBinary(out, pair.first);
+            writeBinary(out, pair.second.identity.size);
+            writeBinary(out, pair.second.identity.modifiedTime);
+            writeBinary(out, pair.second.features);
+        }
+        if (!out) return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, finalPath, error);
+    if (error) {
+        ofLogError() << "Cannot replace feature cache " << finalPath << ": " << error.message();
+        return false;
+    }
+    dirty = false;
+    return true;
+}
+
+bool FeatureCache::lookup(const std::string& path, MediaElement& media) {
+    FileIdentity identity;
+    bool known = getFileIdentity(path, identity);
+
+    std::string features;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(path);
+        if (!known || it == entries.end() || !(it->second.identity == identity)) {
+            misses++;
+            return false;
+        }
+        it->second.used = true;
+        features = it->second.features;
+    }
+
+    std::istringstream in(features);
+    if (!media.loadFeatures(in)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        misses++;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    hits++;
+    return true;
+}
+
+void FeatureCache::store(const std::string& path, const MediaElement& media) {
+    Entry entry;
+    if (!getFileIdentity(path, entry.identity)) return;
+
+    std::ostringstream out;
+    media.saveFeatures(out);
+    entry.features = out.str();
+    entry.used = true;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[path] = std::move(entry);
+    dirty = true;
+}
+
+bool FeatureCache::update(const std::string& path, const MediaElement& media, const FileIdentity& identity) {
+    std::string features;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(path);
+        if (it == entries.end() || !(it->second.identity == identity)) return false;
+        features = it->second.features;
+    }
+
+    // The media given may hold a frame decoded again, or no image at all: the thumbnail comes from the entry
+    MediaElement updated;
+    updated.filePath = media.filePath;
+    updated.videoPath = media.videoPath;
+    updated.image.setUseTexture(false);
+    std::istringstream in(features);
+    if (!updated.loadFeatures(in)) return false;
+    updated.features = media.features;
+
+    Entry entry;
+    entry.identity = identity;
+    std::ostringstream out;
+    updated.saveFeatures(out);
+    entry.features = out.str();
+    entry.used = true;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(path);
+    if (it == entries.end() || !(it->second.identity == identity)) return false; // replaced meanwhile
+    it->second = std::move(entry);
+    dirty = true;
+    return true;
+}
+
+size_t FeatureCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "ofMain.h"
+#include "MediaElement.h"
+#include "FeatureHandler.h"
+#include <mutex>
+
+class FeatureCache {
+	// The FeatureCache persists the extracted features of every media file between launches, so that
+	// unchanged files skip feature extraction (and video decoding) entirely.
+	// Entries are keyed by the file path and validated against the file size and modification time.
+	// The whole cache is discarded when FeatureHandler::extractorVersion changes, or when the settings the features
+	// depend on (the rhythm sampling and the image size of the analysis) differ from the ones it was built with.
+	// Only complete analyses are stored: a video whose analysis stopped early is analysed again on the next launch.
+	// lookup(), store() and update() are thread safe, they are called from the IngestPipeline workers.
+
+public:
+
+	// Size and modification time of a media file, an entry is only valid while they are unchanged
+	struct FileIdentity {
+		uint64_t size = 0;
+		int64_t modifiedTime = 0;
+		bool operator==(const FileIdentity& other) const { return size == other.size && modifiedTime == other.modifiedTime; };
+	};
+
+	// CONSTRUCTORS
+
+	FeatureCache() {};
+	FeatureCache(const std::string& cachePath) : cachePath(cachePath) {};
+
+	// CACHE METHODS
+
+	bool load(); // Reads the cache file, returns false if it is missing, corrupt or from another extractor version
+	bool save(bool pruneUnused = true); // Writes the cache file if it changed, pruneUnused drops the entries not used since load()
+	bool lookup(const std::string& path, MediaElement& media); // Restores the features of an unchanged file, returns false on a miss
+	void store(const std::string& path, const MediaElement& media); // Records the features of a freshly extracted file
+	// Replaces the features of an entry still valid for a file of the given identity, keeping its video thumbnail.
+	// False if the file has no entry, or changed since the features were computed
+	bool update(const std::string& path, const MediaElement& media, const FileIdentity& identity);
+
+	// ATTRIBUTES
+
+	size_t size() const;
+	int getHits() const { return hits; };
+	int getMisses() const { return misses; };
+
+	std::string cachePath = "features.cache"; // relative to the data folder
+	FeatureHandler::RhythmOptions rhythmOptions; // set before load(), like the IngestPipeline that fills the cache
+	std::pair<int, int> imageSize = { 280, 280 }; // size the images are analysed at, IngestPipeline::imageSize
+
+	static bool getFileIdentity(const std::string& path, FileIdentity& identity); // path relative to the data folder or absolute
+
+private:
+	struct Entry {
+		FileIdentity identity;
+		std::string features; // serialized with MediaElement::saveFeatures
+		bool used = false;
+	};
+
+	mutable std::mutex mutex;
+	std::map<std::string, Entry> entries;
+	bool dirty = false;
+	int hits = 0;
+	int misses = 0;
+};
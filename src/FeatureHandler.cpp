@@ -1,290 +1,456 @@
 #pragma once
 #include "FeatureHandler.h"
-#include "ofxOpenCv.h"
+#include "VideoAnalysisSession.h"
 #include <opencv2/opencv.hpp>
 #include <algorithm>
 
-void FeatureHandler::computeAllFeatures(MediaElement& element) {
+namespace {
+    // Grayscale plane shared by the gray-based extractors (edge map, texture) within one extraction: inside a
+    // SharedGrayPlane scope the image is converted once whichever of them runs first. Outside a scope every call
+    // converts again, so a plane never outlives the call that made it (the element may since have been reloaded
+    // with other pixels, even at the same address). The buffer is kept from one conversion to the next
+    struct GrayPlaneCache {
+        int scopes = 0; // SharedGrayPlane scopes open on this thread
+        const MediaElement* element = nullptr; // valid only while a scope is open
+        cv::Mat gray;
+    };
+    thread_local GrayPlaneCache grayPlaneCache;
+
+    struct SharedGrayPlane {
+        SharedGrayPlane() { grayPlaneCache.scopes++; };
+        ~SharedGrayPlane() {
+            if (--grayPlaneCache.scopes == 0) grayPlaneCache.element = nullptr;
+        };
+    };
+
+    const cv::Mat& getGrayPlane(const MediaElement& element) {
+        GrayPlaneCache& cache = grayPlaneCache;
+        if (cache.scopes > 0 && cache.element == &element) return cache.gray;
+
+        // Same conversion as ofxCvGrayscaleImage = ofxCvColorImage, straight from the pixels of the image
+        const ofPixels& pixels = element.image.getPixels();
+        const int channels = pixels.getNumChannels();
+        cv::Mat source(pixels.getHeight(), pixels.getWidth(), CV_8UC(channels), const_cast<unsigned char*>(pixels.getData()));
+        if (channels == 3) cv::cvtColor(source, cache.gray, cv::COLOR_RGB2GRAY);
+        else if (channels == 4) cv::cvtColor(source, cache.gray, cv::COLOR_RGBA2GRAY);
+        else source.copyTo(cache.gray);
+        cache.element = cache.scopes > 0 ? &element : nullptr;
+        return cache.gray;
+    }
+
+    // Buffers of the edge extractor, one set per thread (ingest workers, thumbnail threads, main thread).
+    // They keep their capacity between calls: once they fit the image size, an edge map allocates nothing
+    struct EdgeScratch {
+        cv::Mat edges;
+        std::vector<int> cellStart; // first column of every grid cell, gridX + 1 entries
+        std::vector<uint32_t> cellSums; // sum of the Canny output (0 or 255) per grid cell
+    };
+    thread_local EdgeScratch edgeScratch;
+}
+
+FeatureStore::AnalysisSettings FeatureHandler::getAnalysisSettings(const RhythmOptions& options, std::pair<int, int> imageSize) {
+    FeatureStore::AnalysisSettings settings;
+    settings.frameStride = options.frameStride;
+    settings.maxSamples = options.maxSamples;
+    settings.timeBudgetSeconds = options.timeBudgetSeconds;
+    settings.sampleSize = options.sampleSize;
+    settings.imageWidth = imageSize.first;
+    settings.imageHeight = imageSize.second;
+    return settings;
+}
+
+bool FeatureHandler::computeAllFeatures(MediaElement& element) {
+    SharedGrayPlane sharedGray; // the edge map and the texture convert the image to gray once
     if (element.isVideo()) {
-        generateThumbnail(element, 280, 280);
-		computeRhythmMetric(element);
+        if (!analyzeVideo(element)) return false;
         assignRhythmGroup(element);
 	}
-    if (!element.image.isAllocated()) return;
-    computeNormalizedRGBHistogram(element);
-    computeEdgeMap(element);
-    computeDominantColor(element);
-    computeLuminanceMap(element);
-    computeAverageLuminance(element);
+    if (!element.image.isAllocated()) return false;
+    // Only the features needed to group and sort are eager, the luminance map and the edge map are
+    // computed when first needed (see OverlayCache and IngestPipeline::computeMissingFeature)
+    computeColorFeatures(element, HISTOGRAM_OUTPUT | DOMINANT_COLOR_OUTPUT | AVERAGE_LUMINANCE_OUTPUT);
     computeTextureDescriptor(element);
 	assignLuminanceGroup(element);
     assignHueGroup(element);
 	assignTextureGroup(element);
+    return true;
 }
 
 
-void FeatureHandler::generateThumbnail(MediaElement& element, int width, int height) {
-    if (!element.isVideo()) return;
-    try {
-        ofVideoPlayer tempVideo;
-        tempVideo.load(element.videoPath);
-        while (!tempVideo.isFrameNew()) {
-            tempVideo.update();
-        }
-        element.image.setFromPixels(tempVideo.getPixels());
-        element.image.resize(width, height);
+bool FeatureHandler::analyzeVideo(MediaElement& element, int thumbnailWidth, int thumbnailHeight) {
+    // One pass over the video for the thumbnail and the rhythm metric, see VideoAnalysisSession
+    VideoAnalysisSession session(element.videoPath, rhythmOptions, { thumbnailWidth, thumbnailHeight });
+    VideoAnalysisSession::Result result = session.run();
+
+    if (!result.isUsable()) {
+        ofLogWarning() << "Video analysis of " << element.videoPath << " failed (" << VideoAnalysisSession::getStatusName(result.status) << "): " << result.message;
+        return false;
     }
-    catch (const std::exception& e) {
-        std::cout << "Error generating thumbnail: " << e.what() << std::endl;
+    if (result.status != VideoAnalysisSession::SUCCEEDED) {
+        ofLogNotice() << "Video analysis of " << element.videoPath << " incomplete (" << VideoAnalysisSession::getStatusName(result.status) << "): " << result.message;
     }
+
+    element.image.setFromPixels(result.thumbnail);
+    element.features.rhythmMetric = result.rhythmMetric;
+    element.features.rhythmFrameStride = result.frameStride;
+    element.features.complete = result.status == VideoAnalysisSession::SUCCEEDED;
+    ofLog() << "Rhythm metric computed: " << result.rhythmMetric << " (" << result.comparisons << " comparisons, stride " << result.frameStride << ")";
+    return true;
 }
 
-void FeatureHandler::computeRhythmMetric(MediaElement& element) {
-    int frameStep = 2;
-    ofImage prevFrame, currentFrame;
-    float totalChange = 0.0;
-    int numComparisons = 0;
-    ofVideoPlayer& video = element.videoPlayer;
-
-    if (!video.isLoaded()) {
-        video.load(element.videoPath);
-        // Wait for first frame to be ready
-        while (!video.isFrameNew()) {
-            video.update();
-        }
-    }
-    int totalFrames = video.getTotalNumFrames();
 
-    ofLog() << "computeRhythmMetric called, totalFrames: " << totalFrames;
+void FeatureHandler::computeNormalizedRGBHistogram(MediaElement& element) {
+    computeColorFeatures(element, HISTOGRAM_OUTPUT);
+}
 
-    if (!video.isLoaded()) {
-        ofLogWarning() << "Video is not loaded yet.";
-        element.rhythmMetric = 0.0f;
-        return;
+void FeatureHandler::computeEdgeMap(MediaElement& element) {
+    if (!element.image.isAllocated()) return;
+    const int width = element.image.getWidth();
+    const int height = element.image.getHeight();
+    const int gridX = element.features.edgeGridCols;
+    const int gridY = element.features.edgeGridRows;
+    if (width == 0 || height == 0) return;
+    EdgeScratch& scratch = edgeScratch;
+
+    cv::Canny(getGrayPlane(element), scratch.edges, 50, 150);
+
+    // Pixel x belongs to the grid column x * gridX / width: the columns of a cell are contiguous,
+    // so every row is reduced cell by cell. Canny writes 0 or 255, the sums are divided by 255 once at the end
+    scratch.cellStart.resize(gridX + 1);
+    for (int col = 0; col <= gridX; col++) {
+        scratch.cellStart[col] = (col * width + gridX - 1) / gridX;
     }
-
-    if (totalFrames <= frameStep) {
-        ofLogWarning() << "Not enough frames to compute rhythm metric.";
-        element.rhythmMetric = 0.0f;
-        return;
+    scratch.cellSums.assign(gridX * gridY, 0);
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = scratch.edges.ptr<uint8_t>(y);
+        uint32_t* cells = &scratch.cellSums[(y * gridY / height) * gridX];
+        for (int col = 0; col < gridX; col++) {
+            uint32_t sum = 0;
+            for (int x = scratch.cellStart[col]; x < scratch.cellStart[col + 1]; x++) {
+                sum += row[x];
+            }
+            cells[col] += sum;
+        }
     }
 
-    for (int i = 0; i < totalFrames - frameStep; i += frameStep) {
-        video.setFrame(i);
-        video.update();
-        prevFrame.setFromPixels(video.getPixels());
-
-        video.setFrame(i + frameStep);
-        video.update();
-        currentFrame.setFromPixels(video.getPixels());
-
-        prevFrame.resize(64, 64);
-        currentFrame.resize(64, 64);
-
-        float diff = computeFrameDifference(prevFrame, currentFrame);
-        totalChange += diff;
-        numComparisons++;
+    // Normalize by the busiest cell
+    std::vector<float>& histogram = element.features.edgeHist;
+    histogram.resize(gridX * gridY);
+    uint32_t maxSum = *std::max_element(scratch.cellSums.begin(), scratch.cellSums.end());
+    for (size_t i = 0; i < histogram.size(); i++) {
+        histogram[i] = maxSum > 0 ? float(scratch.cellSums[i]) / maxSum : 0.0f;
     }
+}
 
-    float avgChange = (numComparisons > 0) ? totalChange / numComparisons : 0.0f;
-    element.rhythmMetric = avgChange;
 
-    ofLog() << "Rhythm metric computed: " << avgChange;
+void FeatureHandler::computeDominantColor(MediaElement& element) {
+    computeColorFeatures(element, DOMINANT_COLOR_OUTPUT);
 }
 
+void FeatureHandler::computeLuminanceMap(MediaElement& element) {
+    computeColorFeatures(element, LUMINANCE_MAP_OUTPUT);
+}
 
-void FeatureHandler::computeNormalizedRGBHistogram(MediaElement& element) {
-    ofPixels pixels = element.image.getPixels();
-    int numPixels = pixels.size() / 3;
-    const int numBins = 256;
-    element.redHist.assign(numBins, 0.0f);
-    element.greenHist.assign(numBins, 0.0f);
-    element.blueHist.assign(numBins, 0.0f);
-
-    for (int y = 0; y < element.image.getHeight(); y++) {
-        for (int x = 0; x < element.image.getWidth(); x++) {
-            ofColor c = element.image.getColor(x, y);
-            element.redHist[c.r]++;
-            element.greenHist[c.g]++;
-            element.blueHist[c.b]++;
-        }
-    }
+void FeatureHandler::computeAverageLuminance(MediaElement& element) {
+    computeColorFeatures(element, AVERAGE_LUMINANCE_OUTPUT);
+}
 
-    for (int i = 0; i < numBins; i++) {
-        element.redHist[i] /= numPixels;
-        element.greenHist[i] /= numPixels;
-        element.blueHist[i] /= numPixels;
+void FeatureHandler::computeColorFeatures(MediaElement& element, int outputs) {
+    // Fused kernel: one sweep over the raw pixel buffer produces every requested color output.
+    // The pixels are processed in L1-sized chunks, each chunk goes through all the SIMD kernels it needs
+    if (!element.image.isAllocated()) return;
+    const ofPixels* pixels = &element.image.getPixels();
+    ofPixels rgbPixels;
+    if (pixels->getNumChannels() != 3) {
+        // The kernels work on packed RGB, grayscale and RGBA images are converted first
+        rgbPixels = *pixels;
+        rgbPixels.setImageType(OF_IMAGE_COLOR);
+        pixels = &rgbPixels;
     }
-}
+    const unsigned char* data = pixels->getData();
+    const int w = pixels->getWidth();
+    const int h = pixels->getHeight();
+    const int numPixels = w * h;
+    if (numPixels == 0) return;
 
-void FeatureHandler::computeEdgeMap(MediaElement& element) {
-    int gridX = element.edgeGridCols;
-    int gridY = element.edgeGridRows;
-    std::vector<float> histogram(gridX * gridY, 0.0f);
+    const bool wantHistogram = outputs & HISTOGRAM_OUTPUT;
+    const bool wantLuminanceMap = outputs & LUMINANCE_MAP_OUTPUT;
+    const PixelKernels& kernels = PixelKernels::get();
 
-    ofImage img = element.image;
-    int width = img.getWidth();
-    int height = img.getHeight();
+    uint32_t redCount[256] = { 0 }, greenCount[256] = { 0 }, blueCount[256] = { 0 };
+    PixelKernels::ChannelSums sums;
 
-    ofxCvColorImage colorImg;
-    ofxCvGrayscaleImage grayImg, edgeImg;
-    colorImg.allocate(width, height);
-    grayImg.allocate(width, height);
-    edgeImg.allocate(width, height);
+    ofPixels heatmapPixels;
+    unsigned char* heat = nullptr;
+    if (wantLuminanceMap) {
+        heatmapPixels.allocate(w, h, OF_PIXELS_RGB);
+        heat = heatmapPixels.getData();
+    }
 
-    colorImg.setFromPixels(img.getPixels());
-    grayImg = colorImg;
+    const int chunkSize = 4096;
+    float luminance[chunkSize];
+    for (int start = 0; start < numPixels; start += chunkSize) {
+        const int count = std::min(chunkSize, numPixels - start);
+        const unsigned char* chunk = data + 3 * start;
 
-    cv::Mat grayMat = cv::cvarrToMat(grayImg.getCvImage());
-    cv::Mat edges;
-    cv::Canny(grayMat, edges, 50, 150);
+        PixelKernels::ChannelSums chunkSums = kernels.channelSums(chunk, count);
+        sums.r += chunkSums.r;
+        sums.g += chunkSums.g;
+        sums.b += chunkSums.b;
 
-    edgeImg.setFromPixels(edges.data, edges.cols, edges.rows);
+        if (wantHistogram) {
+            kernels.histogram(chunk, count, redCount, greenCount, blueCount);
+        }
 
-    // Accumulate by pixel
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            if (edgeImg.getPixels()[y * width + x] > 0) {
-                int gridCol = x * gridX / width;
-                int gridRow = y * gridY / height;
-                int index = gridRow * gridX + gridCol;
-                histogram[index]++;
+        if (wantLuminanceMap) {
+            kernels.luminance(chunk, count, luminance);
+            for (int i = 0; i < count; i++) {
+                float normLum = ofClamp(luminance[i] / 255.0f, 0.0f, 1.0f);
+                ofColor heatColor = element.getHeatmapColor(normLum);
+                heat[0] = heatColor.r;
+                heat[1] = heatColor.g;
+                heat[2] = heatColor.b;
+                heat += 3;
             }
         }
     }
 
-    // Normalize
-    float maxCount = *std::max_element(histogram.begin(), histogram.end());
-    if (maxCount > 0) {
-        for (auto& h : histogram) {
-            h /= maxCount;
+    if (wantHistogram) {
+        const int numBins = 256;
+        element.features.redHist.resize(numBins);
+        element.features.greenHist.resize(numBins);
+        element.features.blueHist.resize(numBins);
+        for (int i = 0; i < numBins; i++) {
+            element.features.redHist[i] = float(redCount[i]) / numPixels;
+            element.features.greenHist[i] = float(greenCount[i]) / numPixels;
+            element.features.blueHist[i] = float(blueCount[i]) / numPixels;
         }
     }
-
-    element.edgeHist = histogram;
-}
-
-
-void FeatureHandler::computeDominantColor(MediaElement& element) {
-    if (!element.image.isAllocated()) return;
-    ofPixels& pixels = element.image.getPixels();
-    uint64_t r = 0, g = 0, b = 0;
-    int count = 0;
-    for (int i = 0; i < pixels.size(); i += 3) {
-        r += pixels[i];
-        g += pixels[i + 1];
-        b += pixels[i + 2];
-        count++;
+    if (outputs & DOMINANT_COLOR_OUTPUT) {
+        element.features.dominantColor = ofColor(sums.r / numPixels, sums.g / numPixels, sums.b / numPixels);
     }
-    if (count > 0) {
-        r /= count;
-        g /= count;
-        b /= count;
-        element.dominantColor = ofColor(r, g, b);
+    if (wantLuminanceMap) {
+        element.luminanceMap.setFromPixels(heatmapPixels);
     }
-}
-
-void FeatureHandler::computeLuminanceMap(MediaElement& element) {
-    ofPixels& pixels = element.image.getPixels();
-    int w = pixels.getWidth();
-    int h = pixels.getHeight();
-
-    ofPixels heatmapPixels;
-    heatmapPixels.allocate(w, h, OF_PIXELS_RGB);
-
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            ofColor color = pixels.getColor(x, y);
-            float luminance = 0.2126 * color.r + 0.7152 * color.g + 0.0722 * color.b;
-            float normLum = ofClamp(luminance / 255.0f, 0.0f, 1.0f);
-            ofColor heatColor = element.getHeatmapColor(normLum);
-            heatmapPixels.setColor(x, y, heatColor);
-        }
-    }
-
-    element.luminanceMap.setFromPixels(heatmapPixels);
-}
-
-void FeatureHandler::computeAverageLuminance(MediaElement& element) {
-    ofPixels& pixels = element.image.getPixels();
-    float totalLuminance = 0;
-    for (int y = 0; y < pixels.getHeight(); y++) {
-        for (int x = 0; x < pixels.getWidth(); x++) {
-            ofColor color = pixels.getColor(x, y);
-            float luminance = 0.2126 * color.r + 0.7152 * color.g + 0.0722 * color.b;
-            totalLuminance += luminance;
-        }
+    if (outputs & AVERAGE_LUMINANCE_OUTPUT) {
+        // Luminance is linear in the channels, so its average comes straight from the channel sums
+        element.features.averageLuminance = (0.2126 * sums.r + 0.7152 * sums.g + 0.0722 * sums.b) / numPixels;
     }
-    element.averageLuminance = totalLuminance / (pixels.getWidth() * pixels.getHeight());
 }
 
 void FeatureHandler::computeTextureDescriptor(MediaElement& element) {
     if (!element.image.isAllocated()) return;
+    const cv::Mat& gray = getGrayPlane(element);
+    const int width = gray.cols;
+    const int height = gray.rows;
+    if (width == 0 || height == 0) return;
+
+    // Variance of the Laplacian (texture strength), streamed row by row: the 4-neighbour Laplacian of every pixel
+    // goes straight into a sum and a sum of squares, no Laplacian image is written. Borders are reflected
+    // without repeating the edge pixel, like cv::Laplacian. The sums are exact integers
+    int64_t sum = 0;
+    int64_t sumOfSquares = 0;
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = gray.ptr<uint8_t>(y);
+        const uint8_t* up = gray.ptr<uint8_t>(height == 1 ? 0 : y == 0 ? 1 : y - 1);
+        const uint8_t* down = gray.ptr<uint8_t>(height == 1 ? 0 : y == height - 1 ? height - 2 : y + 1);
+
+        auto accumulate = [&](int x, int left, int right) {
+            int laplacian = int(up[x]) + int(down[x]) + int(row[left]) + int(row[right]) - 4 * int(row[x]);
+            sum += laplacian;
+            sumOfSquares += laplacian * laplacian;
+        };
+        if (width == 1) {
+            accumulate(0, 0, 0);
+            continue;
+        }
+        accumulate(0, 1, 1);
+        int64_t rowSum = 0;
+        int64_t rowSquares = 0;
+        for (int x = 1; x < width - 1; x++) {
+            int laplacian = int(up[x]) + int(down[x]) + int(row[x - 1]) + int(row[x + 1]) - 4 * int(row[x]);
+            rowSum += laplacian;
+            rowSquares += laplacian * laplacian;
+        }
+        sum += rowSum;
+        sumOfSquares += rowSquares;
+        accumulate(width - 1, width - 2, width - 2);
+    }
 
-    // Convert to grayscale
-    ofxCvGrayscaleImage grayImg;
-    grayImg.allocate(element.image.getWidth(), element.image.getHeight());
-    ofxCvColorImage colorImg;
-    colorImg.allocate(element.image.getWidth(), element.image.getHeight());
-    colorImg.setFromPixels(element.image.getPixels());
-    grayImg = colorImg;
-
-    // Convert to OpenCV Mat
-    cv::Mat grayMat = cv::cvarrToMat(grayImg.getCvImage());
-
-    // Apply Laplacian
-    cv::Mat laplacian;
-    cv::Laplacian(grayMat, laplacian, CV_64F);
-
-    // Compute variance of the Laplacian (texture strength)
-    cv::Scalar mean, stddev;
-    cv::meanStdDev(laplacian, mean, stddev);
-    element.textureVariance = stddev.val[0] * stddev.val[0]; // variance = stddev^2
+    const double numPixels = double(width) * height;
+    const double mean = sum / numPixels;
+    element.features.textureVariance = std::max(0.0, sumOfSquares / numPixels - mean * mean);
 }
 
 
 void FeatureHandler::assignLuminanceGroup(MediaElement& element) {
-    computeAverageLuminance(element);
-    if (element.averageLuminance < 85) {
-        element.luminanceGroup = LOW;
+    // Uses the average luminance computed by computeColorFeatures
+    if (element.features.averageLuminance < 85) {
+        element.features.luminanceGroup = LOW;
     }
-    else if (element.averageLuminance < 170) {
-        element.luminanceGroup = LuminanceGroup::MEDIUM;
+    else if (element.features.averageLuminance < 170) {
+        element.features.luminanceGroup = LuminanceGroup::MEDIUM;
     }
     else {
-        element.luminanceGroup = HIGH;
+        element.features.luminanceGroup = HIGH;
     }
 }
 
 void FeatureHandler::assignHueGroup(MediaElement& element) {
-    float hue = element.dominantColor.getHueAngle(); // 0360
+    float hue = element.features.dominantColor.getHueAngle(); // 0360
 
     if (hue < 60 || hue >= 300) {
-        element.colorGroup = RED; // Red-ish
+        element.features.colorGroup = RED; // Red-ish
     }
     else if (hue < 180) {
-        element.colorGroup = GREEN; // Green-ish
+        element.features.colorGroup = GREEN; // Green-ish
     }
     else {
-        element.colorGroup = BLUE; // Blue-ish
+        element.features.colorGroup = BLUE; // Blue-ish
     }
    
 }
 
 void FeatureHandler::assignTextureGroup(MediaElement& element) {
-    float v = element.textureVariance;
+    float v = element.features.textureVariance;
     if (v < 100.0f) {
-        element.textureGroup = SMOOTH_TEXTURE;
+        element.features.textureGroup = SMOOTH_TEXTURE;
     }
     else if (v < 500.0f) {
-        element.textureGroup = MEDIUM_TEXTURE;
+        element.features.textureGroup = MEDIUM_TEXTURE;
     }
     else {
-        element.textureGroup = COARSE_TEXTURE;
+        element.features.textureGroup = COARSE_TEXTURE;
     }
 }
 
 void FeatureHandler::assignRhythmGroup(MediaElement& element) {
-    RhythmGroup rhythm = getRhythmGroup(element.rhythmMetric);
-	element.rhythmGroup = rhythm;
+    RhythmGroup rhythm = getRhythmGroup(element.features.rhythmMetric);
+	element.features.rhythmGroup = rhythm;
+}
+
+
+// ----------------------------------------------------------------------------------------------------------------
+// SORTING AND GROUPING
+// ----------------------------------------------------------------------------------------------------------------
+
+void FeatureHandler::computeFeature(MediaElement& element, FeatureType feature) {
+    if (!element.image.isAllocated()) return;
+    switch (feature) {
+    case RGBHISTOGRAM:
+        computeColorFeatures(element, HISTOGRAM_OUTPUT);
+        break;
+    case COLOR:
+        computeColorFeatures(element, DOMINANT_COLOR_OUTPUT);
+        assignHueGroup(element);
+        break;
+    case LUMINANCE:
+        computeColorFeatures(element, AVERAGE_LUMINANCE_OUTPUT); // the luminance map is an overlay, see OverlayCache
+        assignLuminanceGroup(element);
+        break;
+    case EDGE:
+        computeEdgeMap(element);
+        break;
+    case TEXTURE:
+        computeTextureDescriptor(element);
+        assignTextureGroup(element);
+        break;
+    }
+}
+
+bool FeatureHandler::hasFeature(const FeatureStore& store, MediaId id, FeatureType feature) const {
+    switch (feature) {
+    case RGBHISTOGRAM: return store.hasColorHistogram[id];
+    case EDGE: return store.hasEdgeHistogram[id];
+    default: return true; // scalar features, always computed by computeAllFeatures
+    }
+}
+
+float FeatureHandler::getFeatureKey(const FeatureStore& store, MediaId id, FeatureType feature) const {
+    switch (feature) {
+    case RGBHISTOGRAM: {
+        // Entropy of the color histograms: flat images first, images with many tones last
+        thread_local std::vector<float> buffer(3 * FeatureStore::histogramBins);
+        const float* row = store.getColorHistograms(id, buffer.data());
+        if (!row) return 0.0f;
+        float entropy = 0.0f;
+        for (int i = 0; i < 3 * FeatureStore::histogramBins; i++) {
+            if (row[i] > 0.0f) entropy -= row[i] * std::log2(row[i]);
+        }
+        return entropy;
+    }
+    case COLOR:
+        return store.dominantColor[id].getHueAngle();
+    case LUMINANCE:
+        return store.averageLuminance[id];
+    case EDGE: {
+        // Edge density: mean of the edge grid, 0 while the lazy edge map is missing
+        thread_local std::vector<float> buffer;
+        buffer.resize(store.getEdgeCells());
+        const float* row = store.getEdgeHistogram(id, buffer.data());
+        if (!row) return 0.0f;
+        float sum = 0.0f;
+        for (int i = 0; i < store.getEdgeCells(); i++) sum += row[i];
+        return sum / store.getEdgeCells();
+    }
+    case TEXTURE:
+        return store.textureVariance[id];
+    }
+    return 0.0f;
+}
+
+int FeatureHandler::compareFeatures(const FeatureStore& store, MediaId id1, MediaId id2, FeatureType feature) {
+    float key1 = getFeatureKey(store, id1, feature);
+    float key2 = getFeatureKey(store, id2, feature);
+    return (key1 > key2) - (key1 < key2);
+}
+
+std::vector<MediaId> FeatureHandler::sortByFeature(const FeatureStore& store, FeatureType feature, bool descending) {
+    return sortByFeatures(store, { feature }, descending);
+}
+
+std::vector<MediaId> FeatureHandler::sortByFeatures(const FeatureStore& store, const std::vector<FeatureType>& features, bool descending) {
+    // The keys are computed once, one linear sweep over the columns of each feature, into a compact row per
+    // media; only the ids are sorted
+    const size_t numKeys = features.size();
+    const size_t n = store.size();
+    std::vector<float> keys(n * numKeys);
+    for (size_t k = 0; k < numKeys; k++) {
+        for (size_t id = 0; id < n; id++) {
+            keys[id * numKeys + k] = getFeatureKey(store, id, features[k]);
+        }
+    }
+
+    std::vector<MediaId> order(n);
+    for (size_t i = 0; i < n; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](MediaId a, MediaId b) {
+        const float* keysA = &keys[a * numKeys];
+        const float* keysB = &keys[b * numKeys];
+        for (size_t k = 0; k < numKeys; k++) {
+            if (keysA[k] != keysB[k]) return descending ? keysA[k] > keysB[k] : keysA[k] < keysB[k];
+        }
+        return false; // equal keys keep their original order
+    });
+    return order;
+}
+
+std::vector<std::vector<MediaId>> FeatureHandler::groupByFeature(const FeatureStore& store, FeatureType feature, const std::vector<MediaId>& order) {
+    // One group per LuminanceGroup, ColorGroup or TextureGroup value; the other features have no groups
+    // and give a single one. Medias keep the relative order of "order" (all the medias when empty)
+    const std::vector<uint8_t>* column = nullptr;
+    if (feature == LUMINANCE) column = &store.luminanceGroup;
+    else if (feature == COLOR) column = &store.colorGroup;
+    else if (feature == TEXTURE) column = &store.textureGroup;
+
+    std::vector<std::vector<MediaId>> groups(column ? 3 : 1);
+    auto add = [&](MediaId id) {
+        groups[column ? (*column)[id] : 0].push_back(id);
+    };
+    if (order.empty()) {
+        for (size_t id = 0; id < store.size(); id++) add(id);
+    }
+    else {
+        for (MediaId id : order) add(id);
+    }
+    return groups;
 }
@@ -1,17 +1,39 @@
 #pragma once
 #include "utils.h"
 #include "MediaElement.h"
+#include "FeatureStore.h"
+#include "PixelKernels.h"
 
 class FeatureHandler
 {
 	public:
 		FeatureHandler() {};
-		void computeAllFeatures(MediaElement& element);
-		void computeFeature(MediaElement& element, FeatureType feature);
-		void groupByFeature(std::vector<MediaElement>& elements, FeatureType feature);
-		void sortByFeature(std::vector<MediaElement>& elements, FeatureType feature);
-		int compareFeatures(const MediaElement& element1, const MediaElement& element2, FeatureType feature);
-		void generateThumbnail(MediaElement& element, int width = 300, int height = 300);
+
+		static constexpr int extractorVersion = 5; // Bump whenever an extractor changes its output, this invalidates the FeatureCache
+
+		// Sampling of the streaming video analysis (see VideoAnalysisSession), bounds the time spent on long videos
+		struct RhythmOptions {
+			int frameStride = 2; // compare every frameStride-th frame with the previous sample
+			int maxSamples = 2000; // the stride grows so that long videos use at most this many samples, 0 = no limit
+			float timeBudgetSeconds = 10.0f; // the analysis stops and averages what it has after this time, 0 = no limit
+			int sampleSize = 64; // frames are downsampled to sampleSize x sampleSize before comparing them
+			float openTimeoutSeconds = 5.0f; // a decoder that takes longer to open or to read a frame fails the video
+		};
+		RhythmOptions rhythmOptions;
+		static FeatureStore::AnalysisSettings getAnalysisSettings(const RhythmOptions& options, std::pair<int, int> imageSize); // stamp of the columns file
+
+		bool computeAllFeatures(MediaElement& element); // Eager features only: no luminance map nor edge map. False if the media has no image to analyse
+		void computeFeature(MediaElement& element, FeatureType feature); // Runs only the extractors the feature depends on
+		bool hasFeature(const FeatureStore& store, MediaId id, FeatureType feature) const; // false for the lazy features not computed yet
+
+		// Sorting and grouping read the FeatureStore columns and return media ids: the MediaElements, which hold
+		// images, are never moved, the caller draws them in the returned order
+		float getFeatureKey(const FeatureStore& store, MediaId id, FeatureType feature) const; // Scalar the feature is sorted by
+		int compareFeatures(const FeatureStore& store, MediaId id1, MediaId id2, FeatureType feature); // -1, 0 or 1, like strcmp
+		std::vector<MediaId> sortByFeature(const FeatureStore& store, FeatureType feature, bool descending = false);
+		std::vector<MediaId> sortByFeatures(const FeatureStore& store, const std::vector<FeatureType>& features, bool descending = false); // ties of a feature are broken by the next one
+		std::vector<std::vector<MediaId>> groupByFeature(const FeatureStore& store, FeatureType feature, const std::vector<MediaId>& order = {});
+		bool analyzeVideo(MediaElement& element, int thumbnailWidth = 280, int thumbnailHeight = 280); // Thumbnail and rhythm metric in a single pass, false if the video cannot be decoded
 
 		float computeColorDistance(const ofColor& a, const ofColor& b) {
 			float dr = float(a.r) - float(b.r);
@@ -24,18 +46,24 @@ class FeatureHandler
 		float computeHistogramDistance(const MediaElement& el1, const MediaElement& el2) const {
 			// Use Euclidean distance between concatenated RGB histograms
 			float dist = 0.0f;
-			for (size_t i = 0; i < el1.redHist.size(); i++) {
-				float dr = el1.redHist[i] - el2.redHist[i];
-				float dg = el1.greenHist[i] - el2.greenHist[i];
-				float db = el1.blueHist[i] - el2.blueHist[i];
+			for (size_t i = 0; i < el1.features.redHist.size(); i++) {
+				float dr = el1.features.redHist[i] - el2.features.redHist[i];
+				float dg = el1.features.greenHist[i] - el2.features.greenHist[i];
+				float db = el1.features.blueHist[i] - el2.features.blueHist[i];
 				dist += dr * dr + dg * dg + db * db;
 			}
 			return sqrt(dist);
 		}
 
 		float computeFrameDifference(const ofImage& a, const ofImage& b) {
-			float sum = 0.0f;
+			const ofPixels& pixelsA = a.getPixels();
+			const ofPixels& pixelsB = b.getPixels();
+			int numPixels = pixelsA.getWidth() * pixelsA.getHeight();
+			if (pixelsA.getNumChannels() == 3 && pixelsB.getNumChannels() == 3 && pixelsA.size() == pixelsB.size()) {
+				return PixelKernels::get().frameDifference(pixelsA.getData(), pixelsB.getData(), numPixels) / numPixels;
+			}
 
+			float sum = 0.0f;
 			for (int y = 0; y < a.getHeight(); ++y) {
 				for (int x = 0; x < a.getWidth(); ++x) {
 					ofColor colorA = a.getColor(x, y);
@@ -48,17 +76,26 @@ class FeatureHandler
 		}
 
 
+		// Outputs of computeColorFeatures, combine them with |
+		enum ColorOutput {
+			HISTOGRAM_OUTPUT = 1 << 0,
+			DOMINANT_COLOR_OUTPUT = 1 << 1,
+			LUMINANCE_MAP_OUTPUT = 1 << 2,
+			AVERAGE_LUMINANCE_OUTPUT = 1 << 3,
+			ALL_COLOR_OUTPUTS = HISTOGRAM_OUTPUT | DOMINANT_COLOR_OUTPUT | LUMINANCE_MAP_OUTPUT | AVERAGE_LUMINANCE_OUTPUT
+		};
+
 		// Feature extraction methods
+		void computeColorFeatures(MediaElement& element, int outputs = ALL_COLOR_OUTPUTS); // Single pass over the pixels for all the color outputs
 		void computeNormalizedRGBHistogram(MediaElement& element);
-		void computeEdgeMap(MediaElement& element);
+		void computeEdgeMap(MediaElement& element); // Lazy: not part of computeAllFeatures. Shares the gray plane with computeTextureDescriptor within one extraction
 		void computeDominantColor(MediaElement& element);
-		void computeLuminanceMap(MediaElement& element);
+		void computeLuminanceMap(MediaElement& element); // Lazy: not part of computeAllFeatures
 		void computeAverageLuminance(MediaElement& element);
-		void computeTextureDescriptor(MediaElement& element);
-		void assignLuminanceGroup(MediaElement& element); // Assigns the luminance group based on the average luminance value
+		void computeTextureDescriptor(MediaElement& element); // Variance of the Laplacian of the gray plane
+		void assignLuminanceGroup(MediaElement& element); // Assigns the luminance group based on the average luminance value (computeAverageLuminance must run first)
 		void assignHueGroup(MediaElement& element); // Assigns the hue group based on the dominant color's hue value
 		void assignTextureGroup(MediaElement& element);
-		void computeRhythmMetric(MediaElement& element);
 		void assignRhythmGroup(MediaElement& element); // Assigns the rhythm group based on the rhythm metric value
 };
 
@@ -0,0 +1,701 @@
+#include "FeatureStore.h"
+#include "FeatureCache.h"
+#include "FeatureHandler.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+    const uint32_t columnsMagic = 0x53434647; // "GFCS"
+    const uint32_t columnsVersion = 3;
+    const uint64_t columnAlignment = 64; // every column starts on a cache line
+
+    // Columns of the file, in file order
+    enum Column {
+        PATH_OFFSETS, // rows + 1 uint64, offsets in PATH_CHARS
+        PATH_CHARS,
+        FILE_SIZE, // uint64 per row
+        MODIFIED_TIME, // int64 per row
+        AVERAGE_LUMINANCE, // float per row
+        TEXTURE_VARIANCE,
+        RHYTHM_METRIC,
+        RHYTHM_FRAME_STRIDE, // int32 per row
+        LUMINANCE_GROUP, // uint8 per row
+        COLOR_GROUP,
+        TEXTURE_GROUP,
+        RHYTHM_GROUP,
+        DOMINANT_COLOR, // r, g, b, a per row
+        HAS_COLOR_HISTOGRAM,
+        HAS_EDGE_HISTOGRAM,
+        COLOR_HISTOGRAMS, // encoded rows
+        COLOR_SCALES, // UINT8: float per segment and row, otherwise empty
+        EDGE_HISTOGRAMS,
+        EDGE_SCALES,
+        COLUMN_COUNT
+    };
+
+    struct ColumnsHeader {
+        uint32_t magic = columnsMagic;
+        uint32_t version = columnsVersion;
+        uint32_t extractorVersion = FeatureHandler::extractorVersion;
+        uint32_t histogramEncoding = 0;
+        uint64_t rows = 0;
+        uint32_t histogramBins = FeatureStore::histogramBins;
+        uint32_t edgeGridRows = 0;
+        uint32_t edgeGridCols = 0;
+        FeatureStore::AnalysisSettings analysisSettings;
+        uint32_t columnCount = COLUMN_COUNT;
+        uint64_t columns[COLUMN_COUNT][2] = {}; // offset and size in bytes
+    };
+
+    // IEEE half precision, rounded to nearest. Histogram values are in [0, 1]: no infinities nor NaNs to keep
+    uint16_t floatToHalf(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000;
+        int exponent = int((bits >> 23) & 0xFF) - 127 + 15;
+        uint32_t mantissa = bits & 0x7FFFFF;
+        if (exponent >= 31) return uint16_t(sign | 0x7BFF); // largest half
+        if (exponent <= 0) {
+            if (exponent < -10) return uint16_t(sign); // below the smallest subnormal
+            mantissa |= 0x800000;
+            int shift = 14 - exponent;
+            return uint16_t(sign | ((mantissa + (1u << (shift - 1))) >> shift)); // subnormal
+        }
+        uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+        return uint16_t(half + ((mantissa >> 12) & 1)); // a carry into the exponent is still the right rounding
+    }
+
+    float halfToFloat(uint16_t half) {
+        uint32_t sign = uint32_t(half & 0x8000) << 16;
+        uint32_t exponent = (half >> 10) & 0x1F;
+        uint32_t mantissa = half & 0x3FF;
+        uint32_t bits;
+        if (exponent == 0) {
+            float value = mantissa * (1.0f / 16777216.0f); // subnormal: mantissa * 2^-24
+            return sign ? -value : value;
+        }
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    uint64_t alignColumn(uint64_t offset) {
+        return (offset + columnAlignment - 1) / columnAlignment * columnAlignment;
+    }
+}
+
+FeatureStore::FeatureStore(int edgeGridRows, int edgeGridCols, HistogramEncoding encoding)
+    : edgeGridRows(edgeGridRows), edgeGridCols(edgeGridCols) {
+    colorHistograms.reset(3 * histogramBins, histogramBins, encoding);
+    edgeHistograms.reset(getEdgeCells(), getEdgeCells(), encoding);
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// HISTOGRAM COLUMNS
+// -------------------------------------------------------------------------------------------------------------------------
+
+void FeatureStore::HistogramColumn::reset(int newLength, int newSegmentLength, HistogramEncoding newEncoding) {
+    length = newLength;
+    segmentLength = std::max(1, newSegmentLength);
+    encoding = newEncoding;
+    scaleCount = encoding == HISTOGRAM_UINT8 ? (length + segmentLength - 1) / segmentLength : 0;
+    rowBytes = size_t(length) * (encoding == HISTOGRAM_FLOAT32 ? 4 : encoding == HISTOGRAM_FLOAT16 ? 2 : 1);
+    attach(nullptr, nullptr, 0);
+}
+
+void FeatureStore::HistogramColumn::attach(const uint8_t* rows, const float* scales, size_t count) {
+    mapped = rows;
+    mappedScales = scales;
+    mappedRows = count;
+    owned.clear();
+    ownedScales.clear();
+    copied.clear();
+    copies.clear();
+    copyScales.clear();
+}
+
+void FeatureStore::HistogramColumn::append() {
+    owned.resize(owned.size() + rowBytes, 0);
+    ownedScales.resize(ownedScales.size() + scaleCount, 0.0f);
+}
+
+const uint8_t* FeatureStore::HistogramColumn::getRowData(size_t row) const {
+    if (row >= mappedRows) return &owned[(row - mappedRows) * rowBytes];
+    if (!copied.empty()) {
+        auto it = copied.find(row);
+        if (it != copied.end()) return &copies[it->second * rowBytes];
+    }
+    return mapped + row * rowBytes;
+}
+
+const float* FeatureStore::HistogramColumn::getRowScales(size_t row) const {
+    if (scaleCount == 0) return nullptr;
+    if (row >= mappedRows) return &ownedScales[(row - mappedRows) * scaleCount];
+    if (!copied.empty()) {
+        auto it = copied.find(row);
+        if (it != copied.end()) return &copyScales[it->second * scaleCount];
+    }
+    return mappedScales + row * scaleCount;
+}
+
+uint8_t* FeatureStore::HistogramColumn::writableRow(size_t row, float*& scales) {
+    if (row >= mappedRows) {
+        scales = scaleCount ? &ownedScales[(row - mappedRows) * scaleCount] : nullptr;
+        return &owned[(row - mappedRows) * rowBytes];
+    }
+    auto it = copied.find(row);
+    if (it == copied.end()) {
+        it = copied.emplace(row, copied.size()).first;
+        copies.resize(copies.size() + rowBytes);
+        copyScales.resize(copyScales.size() + scaleCount);
+    }
+    scales = scaleCount ? &copyScales[it->second * scaleCount] : nullptr;
+    return &copies[it->second * rowBytes];
+}
+
+void FeatureStore::HistogramColumn::write(size_t row, const float* values) {
+    float* scales = nullptr;
+    uint8_t* data = writableRow(row, scales);
+    if (!values) {
+        std::fill(data, data + rowBytes, 0);
+        if (scales) std::fill(scales, scales + scaleCount, 0.0f);
+        return;
+    }
+
+    if (encoding == HISTOGRAM_FLOAT32) {
+        std::memcpy(data, values, rowBytes);
+    }
+    else if (encoding == HISTOGRAM_FLOAT16) {
+        uint16_t* halves = reinterpret_cast<uint16_t*>(data);
+        for (int i = 0; i < length; i++) halves[i] = floatToHalf(values[i]);
+    }
+    else {
+        // Every segment is scaled to its own largest value, which is stored exactly
+        for (int segment = 0; segment < scaleCount; segment++) {
+            int begin = segment * segmentLength;
+            int end = std::min(length, begin + segmentLength);
+            float largest = 0.0f;
+            for (int i = begin; i < end; i++) largest = std::max(largest, values[i]);
+            scales[segment] = largest / 255.0f;
+            float inverse = largest > 0.0f ? 255.0f / largest : 0.0f;
+            for (int i = begin; i < end; i++) data[i] = uint8_t(std::min(255.0f, std::max(0.0f, values[i]) * inverse + 0.5f));
+        }
+    }
+}
+
+void FeatureStore::HistogramColumn::copy(size_t row, const HistogramColumn& source, size_t sourceRow) {
+    if (source.encoding == encoding && source.length == length && source.segmentLength == segmentLength) {
+        float* scales = nullptr;
+        uint8_t* data = writableRow(row, scales);
+        std::memcpy(data, source.getRowData(sourceRow), rowBytes);
+        if (scales) std::memcpy(scales, source.getRowScales(sourceRow), scaleCount * sizeof(float));
+        return;
+    }
+    std::vector<float> buffer(source.length);
+    write(row, source.length == length ? source.read(sourceRow, buffer.data()) : nullptr); // another encoding
+}
+
+const float* FeatureStore::HistogramColumn::read(size_t row, float* buffer) const {
+    const uint8_t* data = getRowData(row);
+    if (encoding == HISTOGRAM_FLOAT32) {
+        return reinterpret_cast<const float*>(data);
+    }
+    if (encoding == HISTOGRAM_FLOAT16) {
+        const uint16_t* halves = reinterpret_cast<const uint16_t*>(data);
+        for (int i = 0; i < length; i++) buffer[i] = halfToFloat(halves[i]);
+        return buffer;
+    }
+    const float* scales = getRowScales(row);
+    for (int segment = 0; segment < scaleCount; segment++) {
+        int begin = segment * segmentLength;
+        int end = std::min(length, begin + segmentLength);
+        float scale = scales[segment];
+        for (int i = begin; i < end; i++) buffer[i] = data[i] * scale;
+    }
+    return buffer;
+}
+
+void FeatureStore::HistogramColumn::detach() {
+    if (!mapped) return;
+    std::vector<uint8_t> rows(size() * rowBytes);
+    std::vector<float> scales(size() * scaleCount);
+    for (size_t row = 0; row < size(); row++) {
+        std::memcpy(&rows[row * rowBytes], getRowData(row), rowBytes);
+        if (scaleCount) std::memcpy(&scales[row * scaleCount], getRowScales(row), scaleCount * sizeof(float));
+    }
+    attach(nullptr, nullptr, 0);
+    owned.swap(rows);
+    ownedScales.swap(scales);
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// STORE METHODS
+// -------------------------------------------------------------------------------------------------------------------------
+
+void FeatureStore::appendRow() {
+    averageLuminance.push_back(0);
+    textureVariance.push_back(0);
+    rhythmMetric.push_back(0);
+    rhythmFrameStride.push_back(1);
+    luminanceGroup.push_back(0);
+    colorGroup.push_back(0);
+    textureGroup.push_back(0);
+    rhythmGroup.push_back(0);
+    dominantColor.push_back(ofColor());
+    hasColorHistogram.push_back(false);
+    hasEdgeHistogram.push_back(false);
+    colorHistograms.append();
+    edgeHistograms.append();
+}
+
+MediaId FeatureStore::add(MediaFeatures&& features) {
+    MediaId id = (MediaId)size();
+    appendRow();
+    set(id, std::move(features));
+    return id;
+}
+
+MediaId FeatureStore::add(const FeatureStore& source, MediaId row) {
+    MediaId id = (MediaId)size();
+    appendRow();
+    averageLuminance[id] = source.averageLuminance[row];
+    textureVariance[id] = source.textureVariance[row];
+    rhythmMetric[id] = source.rhythmMetric[row];
+    rhythmFrameStride[id] = source.rhythmFrameStride[row];
+    luminanceGroup[id] = source.luminanceGroup[row];
+    colorGroup[id] = source.colorGroup[row];
+    textureGroup[id] = source.textureGroup[row];
+    rhythmGroup[id] = source.rhythmGroup[row];
+    dominantColor[id] = source.dominantColor[row];
+    hasColorHistogram[id] = source.hasColorHistogram[row];
+    revision++;
+    colorHistograms.copy(id, source.colorHistograms, row);
+    if (source.getEdgeCells() == getEdgeCells()) {
+        hasEdgeHistogram[id] = source.hasEdgeHistogram[row];
+        edgeHistograms.copy(id, source.edgeHistograms, row);
+    }
+    return id;
+}
+
+void FeatureStore::set(MediaId id, MediaFeatures&& features) {
+    if (id >= size()) return;
+    revision++;
+
+    averageLuminance[id] = features.averageLuminance;
+    textureVariance[id] = features.textureVariance;
+    rhythmMetric[id] = features.rhythmMetric;
+    rhythmFrameStride[id] = std::max(1, features.rhythmFrameStride);
+    luminanceGroup[id] = features.luminanceGroup;
+    colorGroup[id] = features.colorGroup;
+    textureGroup[id] = features.textureGroup;
+    rhythmGroup[id] = features.rhythmGroup;
+    dominantColor[id] = features.dominantColor;
+
+    // Elements without histograms (e.g. a video whose thumbnail failed) keep a zero row
+    bool hasColor = features.redHist.size() == histogramBins && features.greenHist.size() == histogramBins && features.blueHist.size() == histogramBins;
+    hasColorHistogram[id] = hasColor;
+    if (hasColor) {
+        std::vector<float> row(3 * histogramBins);
+        std::copy(features.redHist.begin(), features.redHist.end(), row.begin());
+        std::copy(features.greenHist.begin(), features.greenHist.end(), row.begin() + histogramBins);
+        std::copy(features.blueHist.begin(), features.blueHist.end(), row.begin() + 2 * histogramBins);
+        colorHistograms.write(id, row.data());
+    }
+    else {
+        colorHistograms.write(id, nullptr);
+    }
+
+    hasEdgeHistogram[id] = false;
+    edgeHistograms.write(id, nullptr);
+    if (features.edgeGridRows == edgeGridRows && features.edgeGridCols == edgeGridCols) {
+        setEdgeHistogram(id, features.edgeHist);
+    }
+
+    // The record now lives in the columns
+    features.redHist = std::vector<float>();
+    features.greenHist = std::vector<float>();
+    features.blueHist = std::vector<float>();
+    features.edgeHist = std::vector<float>();
+}
+
+void FeatureStore::setRhythmMetric(MediaId id, float metric) {
+    if (id >= size() || rhythmMetric[id] == metric) return;
+    revision++;
+    rhythmMetric[id] = metric;
+    rhythmGroup[id] = getRhythmGroup(metric);
+}
+
+void FeatureStore::setEdgeHistogram(MediaId id, const std::vector<float>& edgeHist) {
+    if (id >= size() || edgeHist.size() != (size_t)getEdgeCells()) return;
+    edgeHistograms.write(id, edgeHist.data());
+    hasEdgeHistogram[id] = true;
+    revision++;
+}
+
+MediaFeatures FeatureStore::get(MediaId id) const {
+    MediaFeatures features;
+    features.averageLuminance = averageLuminance[id];
+    features.textureVariance = textureVariance[id];
+    features.rhythmMetric = rhythmMetric[id];
+    features.rhythmFrameStride = rhythmFrameStride[id];
+    features.luminanceGroup = static_cast<LuminanceGroup>(luminanceGroup[id]);
+    features.colorGroup = static_cast<ColorGroup>(colorGroup[id]);
+    features.textureGroup = static_cast<TextureGroup>(textureGroup[id]);
+    features.rhythmGroup = static_cast<RhythmGroup>(rhythmGroup[id]);
+    features.dominantColor = dominantColor[id];
+    std::vector<float> buffer(std::max(3 * histogramBins, getEdgeCells()));
+    if (const float* row = getColorHistograms(id, buffer.data())) {
+        features.redHist.assign(row, row + histogramBins);
+        features.greenHist.assign(row + histogramBins, row + 2 * histogramBins);
+        features.blueHist.assign(row + 2 * histogramBins, row + 3 * histogramBins);
+    }
+    if (const float* row = getEdgeHistogram(id, buffer.data())) {
+        features.edgeHist.assign(row, row + getEdgeCells());
+    }
+    features.edgeGridRows = edgeGridRows;
+    features.edgeGridCols = edgeGridCols;
+    return features;
+}
+
+void FeatureStore::clear() {
+    averageLuminance.clear();
+    textureVariance.clear();
+    rhythmMetric.clear();
+    rhythmFrameStride.clear();
+    luminanceGroup.clear();
+    colorGroup.clear();
+    textureGroup.clear();
+    rhythmGroup.clear();
+    dominantColor.clear();
+    hasColorHistogram.clear();
+    hasEdgeHistogram.clear();
+    colorHistograms.attach(nullptr, nullptr, 0);
+    edgeHistograms.attach(nullptr, nullptr, 0);
+    mapping.reset();
+    fileSizes.clear();
+    modifiedTimes.clear();
+    revision++;
+}
+
+void FeatureStore::swap(FeatureStore& other) {
+    if (other.getEdgeCells() != getEdgeCells()) return;
+    averageLuminance.swap(other.averageLuminance);
+    textureVariance.swap(other.textureVariance);
+    rhythmMetric.swap(other.rhythmMetric);
+    rhythmFrameStride.swap(other.rhythmFrameStride);
+    luminanceGroup.swap(other.luminanceGroup);
+    colorGroup.swap(other.colorGroup);
+    textureGroup.swap(other.textureGroup);
+    rhythmGroup.swap(other.rhythmGroup);
+    dominantColor.swap(other.dominantColor);
+    hasColorHistogram.swap(other.hasColorHistogram);
+    hasEdgeHistogram.swap(other.hasEdgeHistogram);
+    std::swap(colorHistograms, other.colorHistograms);
+    std::swap(edgeHistograms, other.edgeHistograms);
+    mapping.swap(other.mapping);
+    fileSizes.swap(other.fileSizes);
+    modifiedTimes.swap(other.modifiedTimes);
+    std::swap(revision, other.revision);
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// FILE METHODS
+// -------------------------------------------------------------------------------------------------------------------------
+
+bool FeatureStore::save(const std::string& path, const std::vector<std::string>& paths) {
+    std::vector<MediaId> rows;
+    for (MediaId id = 0; id < size() && id < paths.size(); id++) {
+        if (!paths[id].empty()) rows.push_back(id);
+    }
+
+    ColumnsHeader header;
+    header.histogramEncoding = getHistogramEncoding();
+    header.rows = rows.size();
+    header.edgeGridRows = edgeGridRows;
+    header.edgeGridCols = edgeGridCols;
+    header.analysisSettings = analysisSettings;
+    uint64_t pathChars = 0;
+    for (MediaId id : rows) pathChars += paths[id].size();
+    const uint64_t n = rows.size();
+    const uint64_t sizes[COLUMN_COUNT] = {
+        (n + 1) * sizeof(uint64_t), pathChars, n * sizeof(uint64_t), n * sizeof(int64_t),
+        n * sizeof(float), n * sizeof(float), n * sizeof(float), n * sizeof(int32_t),
+        n, n, n, n, n * 4, n, n,
+        n * colorHistograms.getRowBytes(), n * colorHistograms.getScaleCount() * sizeof(float),
+        n * edgeHistograms.getRowBytes(), n * edgeHistograms.getScaleCount() * sizeof(float)
+    };
+    uint64_t offset = alignColumn(sizeof(ColumnsHeader));
+    for (int column = 0; column < COLUMN_COUNT; column++) {
+        header.columns[column][0] = offset;
+        header.columns[column][1] = sizes[column];
+        offset = alignColumn(offset + sizes[column]);
+    }
+
+    // Written next to the file then renamed over it: the old file may be mapped, by this store or by a running gallery
+    std::string target = ofToDataPath(path, true);
+    std::string temporary = target + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        uint64_t written = 0;
+        auto write = [&](const void* data, uint64_t size) {
+            out.write(static_cast<const char*>(data), size);
+            written += size;
+        };
+        auto startColumn = [&](int column) {
+            static const char padding[columnAlignment] = {};
+            write(padding, header.columns[column][0] - written);
+        };
+        write(&header, sizeof(header));
+
+        startColumn(PATH_OFFSETS);
+        uint64_t pathOffset = 0;
+        write(&pathOffset, sizeof(pathOffset));
+        for (MediaId id : rows) {
+            pathOffset += paths[id].size();
+            write(&pathOffset, sizeof(pathOffset));
+        }
+        startColumn(PATH_CHARS);
+        for (MediaId id : rows) write(paths[id].data(), paths[id].size());
+
+        startColumn(FILE_SIZE);
+        std::vector<int64_t> times;
+        for (MediaId id : rows) {
+            FeatureCache::FileIdentity identity;
+            FeatureCache::getFileIdentity(paths[id], identity); // zero for a missing file: never unchanged
+            write(&identity.size, sizeof(identity.size));
+            times.push_back(identity.modifiedTime);
+        }
+        startColumn(MODIFIED_TIME);
+        write(times.data(), times.size() * sizeof(int64_t));
+
+        // Scalar columns are gathered a row at a time, the store may hold rows that are not saved
+        auto writeColumn = [&](int column, auto& values) {
+            startColumn(column);
+            for (MediaId id : rows) write(&values[id], sizeof(values[id]));
+        };
+        writeColumn(AVERAGE_LUMINANCE, averageLuminance);
+        writeColumn(TEXTURE_VARIANCE, textureVariance);
+        writeColumn(RHYTHM_METRIC, rhythmMetric);
+        writeColumn(RHYTHM_FRAME_STRIDE, rhythmFrameStride);
+        writeColumn(LUMINANCE_GROUP, luminanceGroup);
+        writeColumn(COLOR_GROUP, colorGroup);
+        writeColumn(TEXTURE_GROUP, textureGroup);
+        writeColumn(RHYTHM_GROUP, rhythmGroup);
+        startColumn(DOMINANT_COLOR);
+        for (MediaId id : rows) {
+            const ofColor& color = dominantColor[id];
+            uint8_t rgba[4] = { color.r, color.g, color.b, color.a };
+            write(rgba, sizeof(rgba));
+        }
+        writeColumn(HAS_COLOR_HISTOGRAM, hasColorHistogram);
+        writeColumn(HAS_EDGE_HISTOGRAM, hasEdgeHistogram);
+
+        auto writeHistograms = [&](int dataColumn, int scaleColumn, const HistogramColumn& histograms) {
+            startColumn(dataColumn);
+            for (MediaId id : rows) write(histograms.getRowData(id), histograms.getRowBytes());
+            startColumn(scaleColumn);
+            for (MediaId id : rows) write(histograms.getRowScales(id), histograms.getScaleCount() * sizeof(float));
+        };
+        writeHistograms(COLOR_HISTOGRAMS, COLOR_SCALES, colorHistograms);
+        writeHistograms(EDGE_HISTOGRAMS, EDGE_SCALES, edgeHistograms);
+        if (!out) return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, target, error);
+    if (error && mapping) {
+        // Windows cannot replace a mapped file: the rows are copied out and the mapping released first
+        colorHistograms.detach();
+        edgeHistograms.detach();
+        mapping.reset();
+        error.clear();
+        std::filesystem::rename(temporary, target, error);
+    }
+    if (error) {
+        ofLogError() << "Cannot replace " << target << ": " << error.message();
+        return false;
+    }
+    return true;
+}
+
+bool FeatureStore::map(const std::string& path, std::vector<std::string>& paths) {
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(ofToDataPath(path, true)) || file->size() < sizeof(ColumnsHeader)) return false;
+
+    ColumnsHeader header;
+    std::memcpy(&header, file->getData(), sizeof(header));
+    if (header.magic != columnsMagic || header.version != columnsVersion || header.extractorVersion != FeatureHandler::extractorVersion
+        || header.histogramBins != histogramBins || header.edgeGridRows != uint32_t(edgeGridRows) || header.edgeGridCols != uint32_t(edgeGridCols)
+        || header.columnCount != COLUMN_COUNT || header.histogramEncoding > HISTOGRAM_UINT8 || !(header.analysisSettings == analysisSettings)) {
+        return false;
+    }
+
+    // Every column must have the size its rows need and lie inside the file
+    const uint64_t n = header.rows;
+    HistogramColumn color, edge;
+    color.reset(3 * histogramBins, histogramBins, HistogramEncoding(header.histogramEncoding));
+    edge.reset(getEdgeCells(), getEdgeCells(), HistogramEncoding(header.histogramEncoding));
+    const uint64_t sizes[COLUMN_COUNT] = {
+        (n + 1) * sizeof(uint64_t), header.columns[PATH_CHARS][1], n * sizeof(uint64_t), n * sizeof(int64_t),
+        n * sizeof(float), n * sizeof(float), n * sizeof(float), n * sizeof(int32_t),
+        n, n, n, n, n * 4, n, n,
+        n * color.getRowBytes(), n * color.getScaleCount() * sizeof(float),
+        n * edge.getRowBytes(), n * edge.getScaleCount() * sizeof(float)
+    };
+    for (int column = 0; column < COLUMN_COUNT; column++) {
+        uint64_t offset = header.columns[column][0];
+        if (header.columns[column][1] != sizes[column] || offset % columnAlignment != 0 || offset > file->size()
+            || sizes[column] > file->size() - offset) {
+            return false;
+        }
+    }
+    const uint8_t* data = file->getData();
+    auto columnData = [&](int column) { return data + header.columns[column][0]; };
+
+    const uint64_t* pathOffsets = reinterpret_cast<const uint64_t*>(columnData(PATH_OFFSETS));
+    for (uint64_t row = 0; row < n; row++) {
+        if (pathOffsets[row] > pathOffsets[row + 1] || pathOffsets[row + 1] > sizes[PATH_CHARS]) return false;
+    }
+    // The groups index arrays of three and the flags gate the histogram reads: a value out of range is a corrupt file
+    const int byteColumns[] = { LUMINANCE_GROUP, COLOR_GROUP, TEXTURE_GROUP, RHYTHM_GROUP, HAS_COLOR_HISTOGRAM, HAS_EDGE_HISTOGRAM };
+    for (int column : byteColumns) {
+        uint8_t maxValue = column == HAS_COLOR_HISTOGRAM || column == HAS_EDGE_HISTOGRAM ? 1 : 2;
+        const uint8_t* values = columnData(column);
+        if (std::any_of(values, values + n, [maxValue](uint8_t value) { return value > maxValue; })) return false;
+    }
+
+    clear();
+    const char* pathChars = reinterpret_cast<const char*>(columnData(PATH_CHARS));
+    paths.resize(n);
+    for (uint64_t row = 0; row < n; row++) {
+        paths[row].assign(pathChars + pathOffsets[row], pathChars + pathOffsets[row + 1]);
+    }
+    auto copyColumn = [&](int column, auto& values) {
+        typedef typename std::decay<decltype(values[0])>::type Value;
+        const Value* first = reinterpret_cast<const Value*>(columnData(column));
+        values.assign(first, first + n);
+    };
+    copyColumn(FILE_SIZE, fileSizes);
+    copyColumn(MODIFIED_TIME, modifiedTimes);
+    copyColumn(AVERAGE_LUMINANCE, averageLuminance);
+    copyColumn(TEXTURE_VARIANCE, textureVariance);
+    copyColumn(RHYTHM_METRIC, rhythmMetric);
+    copyColumn(RHYTHM_FRAME_STRIDE, rhythmFrameStride);
+    for (int32_t& stride : rhythmFrameStride) stride = std::max(1, stride);
+    copyColumn(LUMINANCE_GROUP, luminanceGroup);
+    copyColumn(COLOR_GROUP, colorGroup);
+    copyColumn(TEXTURE_GROUP, textureGroup);
+    copyColumn(RHYTHM_GROUP, rhythmGroup);
+    copyColumn(HAS_COLOR_HISTOGRAM, hasColorHistogram);
+    copyColumn(HAS_EDGE_HISTOGRAM, hasEdgeHistogram);
+    const uint8_t* rgba = columnData(DOMINANT_COLOR);
+    dominantColor.resize(n);
+    for (uint64_t row = 0; row < n; row++) {
+        dominantColor[row] = ofColor(rgba[4 * row], rgba[4 * row + 1], rgba[4 * row + 2], rgba[4 * row + 3]);
+    }
+
+    // The histograms stay in the file
+    color.attach(columnData(COLOR_HISTOGRAMS), reinterpret_cast<const float*>(columnData(COLOR_SCALES)), n);
+    edge.attach(columnData(EDGE_HISTOGRAMS), reinterpret_cast<const float*>(columnData(EDGE_SCALES)), n);
+    std::swap(colorHistograms, color);
+    std::swap(edgeHistograms, edge);
+    mapping = std::move(file);
+    return true;
+}
+
+bool FeatureStore::parseHistogramEncoding(const std::string& name, HistogramEncoding& encoding) {
+    std::string lower = ofToLower(name);
+    if (lower == "float32" || lower == "float") encoding = HISTOGRAM_FLOAT32;
+    else if (lower == "float16" || lower == "fp16") encoding = HISTOGRAM_FLOAT16;
+    else if (lower == "uint8") encoding = HISTOGRAM_UINT8;
+    else return false;
+    return true;
+}
+
+bool FeatureStore::isFileUnchanged(MediaId id, const std::string& path) const {
+    FeatureCache::FileIdentity identity;
+    return id < fileSizes.size() && FeatureCache::getFileIdentity(path, identity)
+        && identity.size == fileSizes[id] && identity.modifiedTime == modifiedTimes[id];
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// DRAWER METHODS
+// -------------------------------------------------------------------------------------------------------------------------
+
+void FeatureStore::drawNormalizedRGBHistogram(MediaId id, int x, int y, int width, int height) const {
+    float buffer[3 * histogramBins];
+    const float* histograms = getColorHistograms(id, buffer);
+    if (!histograms) return;
+
+    const int numBins = histogramBins;
+    const float sectionWidth = width / 3.0f; // Width allocated per color channel
+    const float barSpacing = 1.0f;           // Spacing between bars in pixels
+
+    ofFill();
+
+    // Helper lambda to draw a single color histogram
+    auto drawHistogram = [&](const float* hist, float startX, const ofColor& color) {
+        ofSetColor(color);
+        float barWidth = (sectionWidth - (numBins - 1) * barSpacing) / numBins;
+
+        for (int i = 0; i < numBins; ++i) {
+            float barHeight = height * hist[i];
+            float barX = startX + i * (barWidth + barSpacing);
+            ofDrawRectangle(barX, y, barWidth, -barHeight);
+        }
+    };
+
+    // Draw Red histogram
+    drawHistogram(histograms, x, ofColor::red);
+    // Draw Green histogram
+    drawHistogram(histograms + histogramBins, x + sectionWidth, ofColor::green);
+    // Draw Blue histogram
+    drawHistogram(histograms + 2 * histogramBins, x + 2 * sectionWidth, ofColor::blue);
+
+    ofSetColor(ofColor::white); // Reset color
+}
+
+void FeatureStore::drawEdgeMap(MediaId id, int x, int y, int width, int height) const {
+    edgeDrawBuffer.resize(getEdgeCells());
+    const float* edgeHist = getEdgeHistogram(id, edgeDrawBuffer.data());
+    if (!edgeHist) return;
+    int gridCols = edgeGridCols;
+    int gridRows = edgeGridRows;
+    int totalCells = gridRows * gridCols;
+
+    // Determine max value for normalization
+    float maxVal = *std::max_element(edgeHist, edgeHist + totalCells);
+    if (maxVal <= 0.0f) return;
+
+    // Cell size based on provided drawing area
+    float cellWidth = static_cast<float>(width) / gridCols;
+    float cellHeight = static_cast<float>(height) / gridRows;
+    ofEnableAlphaBlending();
+
+    for (int row = 0; row < gridRows; ++row) {
+        for (int col = 0; col < gridCols; ++col) {
+            int index = row * gridCols + col;
+            float normalizedValue = edgeHist[index] / maxVal;
+            ofFill();
+            // Map normalized value to grayscale brightness
+            ofSetColor(255 * normalizedValue, 255 * normalizedValue, 255 * normalizedValue, 150); // Alpha blend
+
+            float cellX = x + col * cellWidth;
+            float cellY = y + row * cellHeight;
+            ofDrawRectangle(cellX, cellY, cellWidth, cellHeight);
+        }
+    }
+
+    // draw grid border
+    ofNoFill();
+    ofSetColor(100); // light gray
+    ofDrawRectangle(x, y, width, height);
+    ofFill();
+
+    // Reset color
+    ofSetColor(255);
+    ofDisableAlphaBlending();
+}
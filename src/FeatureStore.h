@@ -0,0 +1,156 @@
+#pragma once
+#include "ofMain.h"
+#include "MediaFeatures.h"
+#include "MappedFile.h"
+#include <memory>
+#include <unordered_map>
+
+typedef uint32_t MediaId; // index of a media in ofApp::medias and of its row in the FeatureStore, never reused
+
+class FeatureStore {
+	// The FeatureStore holds the features of every media as a structure of arrays: one contiguous column per
+	// feature, row i belongs to the media with id i. Grouping, sorting and similarity searches only read the
+	// columns they need, in a linear sweep, instead of hopping between MediaElements (which hold images and
+	// are hundreds of KB apart in memory).
+	// Histograms are stored as fixed size rows of a single array, as floats or quantized (see HistogramEncoding),
+	// and read through getColorHistograms() and getEdgeHistogram(): a float row is returned in place, a quantized
+	// one is decoded into the buffer of the caller. The edge histogram is lazy (see OverlayCache), rows without one
+	// are zero and hasEdgeHistogram is false.
+	// save() writes the store as a columnar file and map() maps such a file back: the scalar columns are copied
+	// (a few bytes per media), the histogram columns are read in place from the mapping, so a large catalog opens
+	// without reading its histograms. A mapped row that is written again is copied out first.
+	// Columns are public to be read directly; rows are only written through add(), set() and the other setters.
+
+public:
+
+	static constexpr int histogramBins = 256;
+
+	enum HistogramEncoding : uint32_t {
+		HISTOGRAM_FLOAT32 = 0, // exact
+		HISTOGRAM_FLOAT16 = 1, // half the size, 3 significant digits
+		HISTOGRAM_UINT8 = 2 // a quarter of the size, steps of 1/255 of the largest bin of every histogram
+	};
+
+	// Settings the features of the rows depend on besides the extractors (see FeatureHandler::getAnalysisSettings),
+	// stamped in the columns file: a file written with other settings is not mapped
+	struct AnalysisSettings {
+		int32_t frameStride = 0; // FeatureHandler::RhythmOptions
+		int32_t maxSamples = 0;
+		float timeBudgetSeconds = 0;
+		int32_t sampleSize = 0;
+		int32_t imageWidth = 0; // size the images are analysed at, IngestPipeline::imageSize
+		int32_t imageHeight = 0;
+		bool operator==(const AnalysisSettings& other) const {
+			return frameStride == other.frameStride && maxSamples == other.maxSamples && timeBudgetSeconds == other.timeBudgetSeconds
+				&& sampleSize == other.sampleSize && imageWidth == other.imageWidth && imageHeight == other.imageHeight;
+		};
+	};
+
+	// CONSTRUCTORS
+
+	FeatureStore(int edgeGridRows = 32, int edgeGridCols = 32, HistogramEncoding encoding = HISTOGRAM_FLOAT32);
+	FeatureStore(const FeatureStore&) = delete;
+	FeatureStore& operator=(const FeatureStore&) = delete;
+
+	// STORE METHODS
+
+	MediaId add(MediaFeatures&& features); // appends a row, the histograms are released from features
+	MediaId add(const FeatureStore& source, MediaId row); // appends a copy of a row of another store with the same edge grid
+	void set(MediaId id, MediaFeatures&& features); // replaces a row, when the file of a media changed
+	void setEdgeHistogram(MediaId id, const std::vector<float>& edgeHist); // ignored if the grid size differs
+	void setRhythmMetric(MediaId id, float metric); // also the rhythm group, when playback refined it (see RhythmTimeline)
+	MediaFeatures get(MediaId id) const; // gathers a row back into a record, for serialization
+	void clear(); // also releases the mapping
+	void swap(FeatureStore& other); // stores of the same edge grid
+	size_t size() const { return averageLuminance.size(); };
+
+	// Red, green then blue (3 * histogramBins values), nullptr if the media has none
+	const float* getColorHistograms(MediaId id, float* buffer) const { return hasColorHistogram[id] ? colorHistograms.read(id, buffer) : nullptr; };
+	// getEdgeCells() values, nullptr while the lazy edge map is missing
+	const float* getEdgeHistogram(MediaId id, float* buffer) const { return hasEdgeHistogram[id] ? edgeHistograms.read(id, buffer) : nullptr; };
+	int getEdgeCells() const { return edgeGridRows * edgeGridCols; };
+	HistogramEncoding getHistogramEncoding() const { return colorHistograms.getEncoding(); };
+	uint64_t getRevision() const { return revision; }; // changes with every write, tells if the store changed since it was saved
+	static bool parseHistogramEncoding(const std::string& name, HistogramEncoding& encoding); // "float32", "float16" or "uint8"
+
+	// FILE METHODS
+
+	// Writes the rows whose paths[id] is not empty, with the size and time of their file, to a new file renamed over path
+	bool save(const std::string& path, const std::vector<std::string>& paths);
+	// Replaces the content with a file written by save(), paths receives the path of every row. False if the file
+	// is missing, corrupt, or from another extractor version, edge grid or analysisSettings
+	bool map(const std::string& path, std::vector<std::string>& paths);
+	bool isFileUnchanged(MediaId id, const std::string& path) const; // the file of a mapped row has the size and time it had when saved
+	AnalysisSettings analysisSettings; // set before save() and map(), not exchanged by swap()
+
+	// DRAWER METHODS
+
+	void drawNormalizedRGBHistogram(MediaId id, int x, int y, int width, int height) const;
+	void drawEdgeMap(MediaId id, int x, int y, int width, int height) const;
+
+	// COLUMNS
+
+	std::vector<float> averageLuminance;
+	std::vector<float> textureVariance;
+	std::vector<float> rhythmMetric;
+	std::vector<int32_t> rhythmFrameStride; // frames between the samples the ingest pre-pass compared, see RhythmTimeline
+	std::vector<uint8_t> luminanceGroup; // LuminanceGroup values
+	std::vector<uint8_t> colorGroup; // ColorGroup values
+	std::vector<uint8_t> textureGroup; // TextureGroup values
+	std::vector<uint8_t> rhythmGroup; // RhythmGroup values
+	std::vector<ofColor> dominantColor;
+	std::vector<uint8_t> hasColorHistogram;
+	std::vector<uint8_t> hasEdgeHistogram;
+
+	const int edgeGridRows;
+	const int edgeGridCols;
+
+private:
+	class HistogramColumn {
+		// Rows of `length` values in one encoding. UINT8 rows carry one scale per segment of segmentLength values
+		// (a channel of the color histograms). The first mappedRows rows are read from a mapping, the rows
+		// appended later and the mapped rows written again live in owned memory.
+	public:
+		void reset(int length, int segmentLength, HistogramEncoding encoding); // empties the column
+		void attach(const uint8_t* rows, const float* scales, size_t count); // count mapped rows, read only
+		void append(); // zero row
+		void write(size_t row, const float* values); // nullptr writes zeros
+		void copy(size_t row, const HistogramColumn& source, size_t sourceRow);
+		const float* read(size_t row, float* buffer) const;
+		void detach(); // copies the mapped rows to owned memory, the mapping can then be released
+
+		const uint8_t* getRowData(size_t row) const;
+		const float* getRowScales(size_t row) const;
+		size_t getRowBytes() const { return rowBytes; };
+		int getScaleCount() const { return scaleCount; };
+		HistogramEncoding getEncoding() const { return encoding; };
+		size_t size() const { return mappedRows + owned.size() / rowBytes; };
+
+	private:
+		uint8_t* writableRow(size_t row, float*& scales); // owned memory of row, copied out of the mapping on the first write
+
+		int length = 0;
+		int segmentLength = 0;
+		int scaleCount = 0;
+		size_t rowBytes = 0;
+		HistogramEncoding encoding = HISTOGRAM_FLOAT32;
+		const uint8_t* mapped = nullptr;
+		const float* mappedScales = nullptr;
+		size_t mappedRows = 0;
+		std::vector<uint8_t> owned; // rows mappedRows and above
+		std::vector<float> ownedScales;
+		std::unordered_map<size_t, size_t> copied; // mapped row -> index of its copy in copies
+		std::vector<uint8_t> copies;
+		std::vector<float> copyScales;
+	};
+
+	void appendRow(); // zero row in every column
+
+	HistogramColumn colorHistograms; // 3 * histogramBins per row: red, green then blue
+	HistogramColumn edgeHistograms; // getEdgeCells() per row
+	std::unique_ptr<MappedFile> mapping; // file the histogram columns were mapped from, if any
+	std::vector<uint64_t> fileSizes; // of the mapped rows, see isFileUnchanged()
+	std::vector<int64_t> modifiedTimes;
+	uint64_t revision = 0;
+	mutable std::vector<float> edgeDrawBuffer; // decoded row of drawEdgeMap, reused from tile to tile
+};
@@ -0,0 +1,146 @@
+#include "FrameProfiler.h"
+#include <fstream>
+
+FrameProfiler::FrameProfiler(size_t historySize, size_t ringCapacity)
+    : historySize(std::max<size_t>(historySize, 1)), samples(ringCapacity) {
+    addSection("frame");
+}
+
+int FrameProfiler::addSection(const std::string& name) {
+    sectionNames.push_back(name);
+    history.assign(historySize * sectionNames.size(), 0.0f); // the window restarts with the new layout
+    currentNs.assign(sectionNames.size(), 0);
+    frameCount = 0;
+    return sectionNames.size() - 1;
+}
+
+void FrameProfiler::record(int section, Clock::time_point start, Clock::time_point end) {
+    if (!enabled) return;
+    Sample sample;
+    sample.section = section;
+    sample.durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    if (!samples.tryPush(sample)) lostSamples++;
+}
+
+void FrameProfiler::beginFrame() {
+    Clock::time_point now = Clock::now();
+    bool firstFrame = frameStart == Clock::time_point();
+    uint64_t frameNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - frameStart).count();
+    frameStart = now;
+
+    Sample sample;
+    while (samples.tryPop(sample)) {
+        if (sample.section > 0 && sample.section < int(currentNs.size())) currentNs[sample.section] += sample.durationNs;
+    }
+    if (firstFrame || !enabled) {
+        std::fill(currentNs.begin(), currentNs.end(), 0);
+        return;
+    }
+
+    currentNs[0] = frameNs;
+    float* row = &history[(frameCount % historySize) * sectionNames.size()];
+    for (size_t section = 0; section < sectionNames.size(); section++) {
+        row[section] = currentNs[section] / 1e6f;
+        currentNs[section] = 0;
+    }
+    frameCount++;
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// OUTPUT
+// -------------------------------------------------------------------------------------------------------------------------
+
+std::vector<FrameProfiler::SectionStats> FrameProfiler::getStats() const {
+    std::vector<SectionStats> stats(sectionNames.size());
+    size_t frames = getFrameCount();
+    std::vector<float> values(frames);
+    for (size_t section = 0; section < sectionNames.size(); section++) {
+        SectionStats& s = stats[section];
+        s.name = sectionNames[section];
+        if (frames == 0) continue;
+
+        double sum = 0;
+        for (size_t frame = 0; frame < frames; frame++) {
+            values[frame] = getFrameMs(frame, section);
+            sum += values[frame];
+        }
+        s.meanMs = sum / frames;
+        auto at = [&](float fraction) {
+            auto nth = values.begin() + std::min(frames - 1, size_t(fraction * frames));
+            std::nth_element(values.begin(), nth, values.end());
+            return *nth;
+        };
+        s.p50Ms = at(0.5f);
+        s.p99Ms = at(0.99f);
+        s.maxMs = *std::max_element(values.begin(), values.end());
+    }
+    return stats;
+}
+
+int FrameProfiler::getSlowFrames() const {
+    int slowFrames = 0;
+    for (size_t frame = 0; frame < getFrameCount(); frame++) {
+        if (getFrameMs(frame, 0) > 1.5f * frameBudgetMs) slowFrames++;
+    }
+    return slowFrames;
+}
+
+void FrameProfiler::draw(int x, int y) {
+    if (displayedStats.empty() || frameCount >= statsFrame + refreshFrames || frameCount < statsFrame) {
+        displayedStats = getStats();
+        statsFrame = frameCount;
+    }
+
+    int lineHeight = 14;
+    int width = 330;
+    int height = lineHeight * (displayedStats.size() + 2) + 10;
+    ofSetColor(0, 0, 0, 180);
+    ofDrawRectangle(x, y, width, height);
+
+    auto column = [](const std::string& name) { return name.substr(0, 14) + std::string(15 - std::min<size_t>(name.size(), 14), ' '); };
+    ofSetColor(255);
+    y += lineHeight;
+    ofDrawBitmapString(column("section") + "    p50     p99     max (ms)", x + 5, y);
+    for (const auto& s : displayedStats) {
+        y += lineHeight;
+        ofDrawBitmapString(column(s.name) + ofToString(s.p50Ms, 2, 7, ' ')
+            + ofToString(s.p99Ms, 2, 8, ' ') + ofToString(s.maxMs, 2, 8, ' '), x + 5, y);
+    }
+    y += lineHeight;
+    ofDrawBitmapString(ofToString(getSlowFrames()) + "/" + ofToString(getFrameCount()) + " frames over "
+        + ofToString(1.5f * frameBudgetMs, 1) + " ms", x + 5, y);
+}
+
+bool FrameProfiler::save(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) return false;
+    size_t frames = getFrameCount();
+    uint64_t firstFrame = frameCount - frames;
+
+    if (ofToLower(ofFilePath::getFileExt(path)) == "json") {
+        out << "{\"frame_budget_ms\":" << frameBudgetMs << ",\"frames\":" << frames << ",\"slow_frames\":" << getSlowFrames()
+            << ",\"lost_samples\":" << lostSamples << ",\"sections\":[";
+        std::vector<SectionStats> stats = getStats();
+        for (size_t section = 0; section < stats.size(); section++) {
+            const SectionStats& s = stats[section];
+            out << (section ? "," : "") << "\n{\"name\":\"" << s.name << "\",\"p50_ms\":" << s.p50Ms << ",\"p99_ms\":" << s.p99Ms
+                << ",\"max_ms\":" << s.maxMs << ",\"mean_ms\":" << s.meanMs << ",\"frames_ms\":[";
+            for (uint64_t frame = firstFrame; frame < frameCount; frame++) {
+                out << (frame > firstFrame ? "," : "") << getFrameMs(frame, section);
+            }
+            out << "]}";
+        }
+        out << "\n]}\n";
+    }
+    else {
+        out << "index";
+        for (const auto& name : sectionNames) out << "," << name;
+        out << "\n";
+        for (uint64_t frame = firstFrame; frame < frameCount; frame++) {
+            out << frame;
+            for (size_t section = 0; section < sectionNames.size(); section++) out << "," << getFrameMs(frame, section);
+            out << "\n";
+        }
+    }
+    return bool(out);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "ofMain.h"
+#include "SpscRing.h"
+#include <chrono>
+
+class FrameProfiler {
+	// The FrameProfiler measures where the time of each frame goes. Code sections are registered once with
+	// addSection() and timed with a Scope; a Scope only reads the clock twice and pushes a sample into a lock-free
+	// SpscRing, nothing is allocated nor locked in the hot path. beginFrame(), called at the start of every frame,
+	// drains the ring and adds the time of every section to a window of the last historySize frames, from which
+	// draw() shows the p50/p99 per section and save() writes the window as CSV or JSON.
+	// Scopes are recorded from the main loop, the thread that calls beginFrame(). Nested scopes are allowed,
+	// the same section timed several times in a frame is summed.
+
+public:
+
+	typedef std::chrono::steady_clock Clock;
+
+	struct Sample {
+		int section = 0;
+		uint64_t durationNs = 0;
+	};
+
+	struct SectionStats {
+		std::string name;
+		float p50Ms = 0;
+		float p99Ms = 0;
+		float maxMs = 0;
+		float meanMs = 0;
+	};
+
+	class Scope {
+		// Times the enclosing block as section of profiler.
+	public:
+		Scope(FrameProfiler& profiler, int section) : profiler(profiler), section(section), start(Clock::now()) {};
+		~Scope() { stop(); };
+		void stop() { // ends the measure before the end of the block
+			if (section < 0) return;
+			profiler.record(section, start, Clock::now());
+			section = -1;
+		};
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	private:
+		FrameProfiler& profiler;
+		int section;
+		Clock::time_point start;
+	};
+
+	// CONSTRUCTORS
+
+	FrameProfiler(size_t historySize = 600, size_t ringCapacity = 4096);
+
+	// PROFILING METHODS
+
+	int addSection(const std::string& name); // before the first frame, returns the id given to the Scopes
+	void beginFrame(); // closes the previous frame: total frame time and the sections timed during it
+	void record(int section, Clock::time_point start, Clock::time_point end);
+
+	// OUTPUT METHODS
+
+	std::vector<SectionStats> getStats() const; // over the frames in the window, the whole frame first
+	void draw(int x, int y); // overlay with the stats, refreshed a few times per second
+	bool save(const std::string& path) const; // .json: stats and frames, otherwise CSV with one row per frame
+
+	// ATTRIBUTES
+
+	size_t getFrameCount() const { return std::min<uint64_t>(frameCount, historySize); }; // frames in the window
+	int getSlowFrames() const; // frames of the window over 1.5x the frame budget
+	uint64_t getLostSamples() const { return lostSamples; }; // samples dropped because the ring was full
+
+	float frameBudgetMs = 1000.0f / 60; // target frame time, the app runs at 60 fps
+	bool enabled = true; // when false, the Scopes record nothing
+
+private:
+	float getFrameMs(size_t frame, int section) const { return history[(frame % historySize) * sectionNames.size() + section]; };
+
+	size_t historySize;
+	std::vector<std::string> sectionNames; // section 0 is the whole frame
+	std::vector<float> history; // historySize x sections, milliseconds, circular over the frames
+	std::vector<uint64_t> currentNs; // time of every section in the frame being recorded
+	SpscRing<Sample> samples;
+	uint64_t frameCount = 0; // frames closed since the start
+	uint64_t lostSamples = 0;
+	Clock::time_point frameStart;
+
+	std::vector<SectionStats> displayedStats; // what draw() shows, refreshed every refreshFrames
+	uint64_t statsFrame = 0;
+	int refreshFrames = 15;
+};
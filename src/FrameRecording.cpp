@@ -0,0 +1,224 @@
+#include "FrameRecording.h"
+#include "BinaryIO.h"
+
+namespace {
+    const uint32_t recordingMagic = 0x4D524647; // "GFRM"
+    const uint32_t recordingVersion = 1;
+
+    enum FrameEncoding : uint8_t {
+        RAW = 0,
+        DELTA_RLE = 1,
+        DELTA_NIBBLE = 2
+    };
+
+    const size_t maxRun = 0xFFFF;
+    const size_t minZeroRun = 4; // shorter runs of unchanged pixels stay in the literals: a run header costs 4 bytes
+
+    // Runs of (uint16 unchanged pixels, uint16 changed pixels, changed pixels as byte differences).
+    // Returns false as soon as the encoding gets larger than the raw frame
+    bool encodeDelta(const uint8_t* current, const uint8_t* previous, size_t size, std::vector<uint8_t>& encoded) {
+        encoded.clear();
+        size_t i = 0;
+        while (i < size) {
+            size_t zeros = 0;
+            while (i < size && current[i] == previous[i] && zeros < maxRun) {
+                zeros++;
+                i++;
+            }
+
+            size_t start = i;
+            while (i < size && i - start < maxRun) {
+                if (current[i] == previous[i]) {
+                    size_t unchanged = 1;
+                    while (unchanged < minZeroRun && i + unchanged < size && current[i + unchanged] == previous[i + unchanged]) unchanged++;
+                    if (unchanged == minZeroRun || i + unchanged == size) break;
+                }
+                i++;
+            }
+
+            size_t literals = i - start;
+            if (encoded.size() + 4 + literals >= size) return false;
+            encoded.push_back(uint8_t(zeros));
+            encoded.push_back(uint8_t(zeros >> 8));
+            encoded.push_back(uint8_t(literals));
+            encoded.push_back(uint8_t(literals >> 8));
+            for (size_t j = start; j < i; j++) {
+                encoded.push_back(uint8_t(current[j] - previous[j]));
+            }
+        }
+        return true;
+    }
+
+    // One 4 bits difference per pixel, for the sensor noise of a still camera that defeats the run-length encoding.
+    // Differences outside [-7, 7] are marked with the nibble 8 and stored as bytes after the nibbles.
+    // Returns false as soon as the encoding gets larger than the raw frame
+    bool encodeNibbles(const uint8_t* current, const uint8_t* previous, size_t size, std::vector<uint8_t>& encoded) {
+        size_t numNibbleBytes = (size + 1) / 2;
+        encoded.assign(numNibbleBytes, 0);
+        for (size_t i = 0; i < size; i++) {
+            int8_t difference = int8_t(uint8_t(current[i] - previous[i]));
+            uint8_t nibble = 0x8;
+            if (difference >= -7 && difference <= 7) {
+                nibble = uint8_t(difference) & 0xF;
+            }
+            else {
+                if (encoded.size() + 1 >= size) return false;
+                encoded.push_back(uint8_t(difference));
+            }
+            encoded[i / 2] |= (i & 1) ? nibble << 4 : nibble;
+        }
+        return true;
+    }
+
+    bool decodeNibbles(const std::vector<uint8_t>& encoded, std::vector<uint8_t>& frame) {
+        size_t numNibbleBytes = (frame.size() + 1) / 2;
+        if (encoded.size() < numNibbleBytes) return false;
+        size_t escape = numNibbleBytes;
+        for (size_t i = 0; i < frame.size(); i++) {
+            uint8_t nibble = (i & 1) ? encoded[i / 2] >> 4 : encoded[i / 2] & 0xF;
+            if (nibble == 0x8) {
+                if (escape == encoded.size()) return false;
+                frame[i] += encoded[escape++];
+            }
+            else {
+                frame[i] += uint8_t(int8_t(nibble << 4) >> 4); // sign extension of the 4 bits
+            }
+        }
+        return escape == encoded.size();
+    }
+
+    bool decodeDelta(const std::vector<uint8_t>& encoded, std::vector<uint8_t>& frame) {
+        size_t pos = 0;
+        size_t in = 0;
+        while (in + 4 <= encoded.size()) {
+            size_t zeros = encoded[in] | (encoded[in + 1] << 8);
+            size_t literals = encoded[in + 2] | (encoded[in + 3] << 8);
+            in += 4;
+            pos += zeros;
+            if (pos + literals > frame.size() || in + literals > encoded.size()) return false;
+            for (size_t j = 0; j < literals; j++) {
+                frame[pos + j] += encoded[in + j];
+            }
+            pos += literals;
+            in += literals;
+        }
+        return in == encoded.size() && pos <= frame.size();
+    }
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// RECORDER
+// -------------------------------------------------------------------------------------------------------------------------
+
+bool FrameRecorder::open(const std::string& path, int frameWidth, int frameHeight) {
+    close();
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+
+    width = frameWidth;
+    height = frameHeight;
+    frameCount = rawBytes = writtenBytes = 0;
+    previous.clear();
+    writeBinary(out, recordingMagic);
+    writeBinary(out, recordingVersion);
+    writeBinary(out, uint32_t(width));
+    writeBinary(out, uint32_t(height));
+    return bool(out);
+}
+
+bool FrameRecorder::write(const uint8_t* gray, uint64_t timeUs) {
+    if (!out.is_open()) return false;
+    size_t size = size_t(width) * height;
+
+    // The first frame, and frames with too much change, are stored as they are.
+    // Otherwise the smallest of the two difference encodings is kept
+    FrameEncoding encoding = RAW;
+    if (previous.size() == size) {
+        if (encodeDelta(gray, previous.data(), size, encoded)) {
+            encoding = DELTA_RLE;
+        }
+        if (encodeNibbles(gray, previous.data(), size, nibbles) && (encoding == RAW || nibbles.size() < encoded.size())) {
+            encoding = DELTA_NIBBLE;
+        }
+    }
+    const uint8_t* payload = encoding == DELTA_RLE ? encoded.data() : encoding == DELTA_NIBBLE ? nibbles.data() : gray;
+    size_t payloadSize = encoding == DELTA_RLE ? encoded.size() : encoding == DELTA_NIBBLE ? nibbles.size() : size;
+
+    writeBinary(out, timeUs);
+    writeBinary(out, uint8_t(encoding));
+    writeBinary(out, uint32_t(payloadSize));
+    out.write(reinterpret_cast<const char*>(payload), payloadSize);
+    previous.assign(gray, gray + size);
+
+    frameCount++;
+    rawBytes += size;
+    writtenBytes += payloadSize + sizeof(uint64_t) + sizeof(uint8_t) + sizeof(uint32_t);
+    return bool(out);
+}
+
+void FrameRecorder::close() {
+    if (out.is_open()) out.close();
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// REPLAY
+// -------------------------------------------------------------------------------------------------------------------------
+
+bool FrameReplay::open(const std::string& path) {
+    in.close();
+    in.clear();
+    in.open(path, std::ios::binary);
+    if (!in.is_open()) return false;
+
+    uint32_t magic = 0, version = 0, fileWidth = 0, fileHeight = 0;
+    if (!readBinary(in, magic) || !readBinary(in, version) || !readBinary(in, fileWidth) || !readBinary(in, fileHeight)
+        || magic != recordingMagic || version != recordingVersion || fileWidth == 0 || fileHeight == 0) {
+        in.close();
+        return false;
+    }
+    width = fileWidth;
+    height = fileHeight;
+    firstFrame = in.tellg();
+    frameIndex = 0;
+    corrupt = false;
+    frame.assign(size_t(width) * height, 0);
+    return true;
+}
+
+bool FrameReplay::read(const uint8_t*& gray, uint64_t& timeUs) {
+    uint8_t encoding = RAW;
+    uint32_t size = 0;
+    if (!readBinary(in, timeUs)) return false; // end of the recording
+    corrupt = true; // until the frame is complete
+
+    if (!readBinary(in, encoding) || !readBinary(in, size)) return false;
+    if (encoding == RAW) {
+        if (size != frame.size()) return false;
+        in.read(reinterpret_cast<char*>(frame.data()), size);
+        if (!in) return false;
+    }
+    else if (encoding == DELTA_RLE || encoding == DELTA_NIBBLE) {
+        if (frameIndex == 0 || size > frame.size()) return false; // a difference needs a previous frame
+        payload.resize(size);
+        in.read(reinterpret_cast<char*>(payload.data()), size);
+        if (!in) return false;
+        if (!(encoding == DELTA_RLE ? decodeDelta(payload, frame) : decodeNibbles(payload, frame))) return false;
+    }
+    else {
+        return false;
+    }
+
+    corrupt = false;
+    gray = frame.data();
+    frameIndex++;
+    return true;
+}
+
+bool FrameReplay::rewind() {
+    if (!in.is_open()) return false;
+    in.clear();
+    in.seekg(firstFrame);
+    frameIndex = 0;
+    corrupt = false;
+    return bool(in);
+}
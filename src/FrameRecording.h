@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Compact recordings of grayscale camera frames, used to replay gestures without a camera.
+//
+// File layout: a header (magic, version, width, height) followed by one record per frame:
+// capture time in microseconds, encoding, payload size and payload. A frame is stored raw or as its difference
+// with the previous frame, either run-length encoded (unchanged areas) or packed in 4 bits per pixel (sensor noise),
+// whichever is smaller: a still camera mostly produces small differences, so a recording of a swipe is a fraction
+// of the raw size. Frames are stored losslessly, a replay gives exactly the recorded pixels.
+
+class FrameRecorder {
+	// The FrameRecorder appends frames to a recording file.
+
+public:
+
+	// CONSTRUCTORS
+
+	FrameRecorder() {};
+	~FrameRecorder() { close(); };
+
+	// RECORDING METHODS
+
+	bool open(const std::string& path, int width, int height);
+	bool write(const uint8_t* gray, uint64_t timeUs); // width * height bytes, rows packed
+	void close();
+
+	// ATTRIBUTES
+
+	bool isOpen() const { return out.is_open(); };
+	uint64_t getFrameCount() const { return frameCount; };
+	uint64_t getRawBytes() const { return rawBytes; }; // size the frames would take uncompressed
+	uint64_t getWrittenBytes() const { return writtenBytes; };
+
+private:
+	std::ofstream out;
+	int width = 0;
+	int height = 0;
+	uint64_t frameCount = 0;
+	uint64_t rawBytes = 0;
+	uint64_t writtenBytes = 0;
+	std::vector<uint8_t> previous;
+	std::vector<uint8_t> encoded; // reused between frames
+	std::vector<uint8_t> nibbles;
+};
+
+class FrameReplay {
+	// The FrameReplay reads the frames of a recording back, in order.
+
+public:
+
+	// CONSTRUCTORS
+
+	FrameReplay() {};
+
+	// REPLAY METHODS
+
+	bool open(const std::string& path);
+	bool read(const uint8_t*& gray, uint64_t& timeUs); // false at the end of the file or on a corrupt frame, see isCorrupt()
+	bool rewind(); // back to the first frame
+
+	// ATTRIBUTES
+
+	int getWidth() const { return width; };
+	int getHeight() const { return height; };
+	uint64_t getFrameIndex() const { return frameIndex; }; // frames read since open() or rewind()
+	bool isCorrupt() const { return corrupt; }; // the last read() stopped on a truncated or invalid frame
+
+private:
+	std::ifstream in;
+	std::streampos firstFrame;
+	int width = 0;
+	int height = 0;
+	uint64_t frameIndex = 0;
+	bool corrupt = false;
+	std::vector<uint8_t> frame; // last decoded frame, base of the next difference
+	std::vector<uint8_t> payload;
+};
@@ -0,0 +1,94 @@
+#include "GalleryLayout.h"
+
+void GalleryLayout::setOrder(const std::vector<MediaId>& newOrder) {
+    order = newOrder;
+    dirty = true;
+}
+
+void GalleryLayout::setGrouping(const std::vector<uint8_t>* newGroupColumn, int newGroupCount) {
+    if (newGroupColumn == groupColumn && (newGroupColumn == nullptr || newGroupCount == groupCount)) return;
+    groupColumn = newGroupColumn;
+    groupCount = newGroupColumn ? std::max(newGroupCount, 1) : 1;
+    dirty = true;
+}
+
+bool GalleryLayout::update() {
+    if (!dirty) return false;
+    dirty = false;
+
+    // One bucket per group, the empty ones are dropped
+    std::vector<std::vector<MediaId>> groups(groupCount);
+    for (MediaId id : order) {
+        groups[std::min(getGroup(id), groupCount - 1)].push_back(id);
+    }
+
+    rows.clear();
+    rowGroups.clear();
+    positions.assign(positions.size(), GridPosition());
+    for (int group = 0; group < groupCount; group++) {
+        if (groups[group].empty()) continue;
+        rows.push_back(std::move(groups[group]));
+        rowGroups.push_back(group);
+        indexRow(rows.size() - 1);
+    }
+    return true;
+}
+
+void GalleryLayout::indexRow(int row, int firstCol) {
+    for (int col = firstCol; col < (int)rows[row].size(); col++) {
+        MediaId id = rows[row][col];
+        if (id >= positions.size()) positions.resize(id + 1);
+        positions[id] = { row, col };
+    }
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// INCREMENTAL UPDATES
+// -------------------------------------------------------------------------------------------------------------------------
+
+int GalleryLayout::findRow(int group) const {
+    for (size_t row = 0; row < rowGroups.size(); row++) {
+        if (rowGroups[row] == group) return row;
+    }
+    return -1;
+}
+
+void GalleryLayout::insert(MediaId id) {
+    order.push_back(id);
+    if (dirty) return; // the whole layout is rebuilt anyway
+
+    int group = std::min(getGroup(id), groupCount - 1);
+    int row = findRow(group);
+    if (row < 0) {
+        // First media of its group: new row, kept in group order
+        auto position = std::lower_bound(rowGroups.begin(), rowGroups.end(), group);
+        row = position - rowGroups.begin();
+        rowGroups.insert(position, group);
+        rows.insert(rows.begin() + row, std::vector<MediaId>());
+        for (int next = row + 1; next < (int)rows.size(); next++) indexRow(next); // shifted down
+    }
+    rows[row].push_back(id);
+    indexRow(row, rows[row].size() - 1);
+}
+
+void GalleryLayout::remove(MediaId id) {
+    auto it = std::find(order.begin(), order.end(), id);
+    if (it == order.end()) return;
+    order.erase(it);
+    if (dirty) return;
+
+    GridPosition position = locate(id);
+    if (position.row < 0) return;
+    positions[id] = GridPosition();
+
+    int row = position.row;
+    rows[row].erase(rows[row].begin() + position.col);
+    if (rows[row].empty()) {
+        rows.erase(rows.begin() + row);
+        rowGroups.erase(rowGroups.begin() + row);
+        for (int next = row; next < (int)rows.size(); next++) indexRow(next); // shifted up
+    }
+    else {
+        indexRow(row, position.col); // the following tiles moved left
+    }
+}
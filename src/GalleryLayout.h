@@ -0,0 +1,57 @@
+#pragma once
+#include "ofMain.h"
+#include "FeatureStore.h"
+
+class GalleryLayout {
+	// The GalleryLayout holds the rows of the gallery grid: the display order split by a group column of the
+	// FeatureStore (luminance, color or texture group), or a single row without grouping.
+	// Rows are rebuilt only when the order or the grouping changes, not every frame: update() and draw() of the
+	// gallery both read the same rows. A media added to or removed from the gallery is patched into its row in
+	// place, it goes at the end of its group until the next sort.
+	// Empty groups have no row, getRowGroup() gives the group value of a row (0 without grouping).
+	// The position of every media in the grid is kept alongside the rows, so going from a media to its tile
+	// (selection, auto-scroll) is a lookup like going from a tile to its media.
+
+public:
+
+	struct GridPosition {
+		int row = -1; // -1 if the media is not in the layout
+		int col = -1;
+	};
+
+	// CONSTRUCTORS
+
+	GalleryLayout() {};
+
+	// LAYOUT METHODS
+
+	void setOrder(const std::vector<MediaId>& order); // ids in the order they are drawn
+	void setGrouping(const std::vector<uint8_t>* groupColumn, int groupCount = 3); // nullptr puts every media in one row
+	bool update(); // rebuilds the rows if the order or the grouping changed, returns true if it did
+
+	void insert(MediaId id); // the group column must already hold a value for id
+	void remove(MediaId id);
+
+	// ATTRIBUTES
+
+	const std::vector<std::vector<MediaId>>& getRows() const { return rows; };
+	int getRowGroup(int row) const { return rowGroups[row]; };
+	MediaId at(int row, int col) const { return rows[row][col]; };
+	GridPosition locate(MediaId id) const { return id < positions.size() ? positions[id] : GridPosition(); };
+	bool isGrouped() const { return groupColumn != nullptr; };
+	size_t size() const { return order.size(); };
+
+private:
+	int getGroup(MediaId id) const { return groupColumn ? (*groupColumn)[id] : 0; };
+	int findRow(int group) const; // -1 if the group has no row
+	void indexRow(int row, int firstCol = 0); // records the positions of rows[row][firstCol..]
+
+	std::vector<MediaId> order;
+	const std::vector<uint8_t>* groupColumn = nullptr; // not owned, a column of the FeatureStore
+	int groupCount = 1;
+	bool dirty = true;
+
+	std::vector<std::vector<MediaId>> rows;
+	std::vector<int> rowGroups; // group value of every row, increasing
+	std::vector<GridPosition> positions; // indexed by MediaId
+};
@@ -0,0 +1,68 @@
+#include "GestureDetector.h"
+
+void GestureDetector::reset() {
+    previous.clear();
+    width = height = 0;
+    cooldown = 0;
+}
+
+GestureDetector::Detection GestureDetector::process(const uint8_t* gray, int frameWidth, int frameHeight) {
+    Detection detection;
+    size_t numPixels = size_t(frameWidth) * frameHeight;
+
+    if (frameWidth != width || frameHeight != height || previous.size() != numPixels) {
+        // First frame, or the camera changed resolution: nothing to compare with yet
+        width = frameWidth;
+        height = frameHeight;
+        previous.assign(gray, gray + numPixels);
+        return detection;
+    }
+
+    if (keepDiff && ((int)diff.getWidth() != width || (int)diff.getHeight() != height)) {
+        diff.allocate(width, height, OF_PIXELS_GRAY);
+    }
+
+    // Difference, threshold and count in one pass; the rows outside the band only feed the debug view
+    int yMin = height * options.bandTop;
+    int yMax = height * options.bandBottom;
+    int midX = width / 2;
+    for (int y = 0; y < height; y++) {
+        bool inBand = y >= yMin && y < yMax;
+        if (!inBand && !keepDiff) continue;
+
+        const uint8_t* current = gray + size_t(y) * width;
+        const uint8_t* before = previous.data() + size_t(y) * width;
+        uint8_t* out = keepDiff ? diff.getData() + size_t(y) * width : nullptr;
+        int left = 0;
+        int right = 0;
+        for (int x = 0; x < width; x++) {
+            bool moving = std::abs(int(current[x]) - int(before[x])) > options.diffThreshold;
+            if (out) out[x] = moving ? 255 : 0;
+            if (x < midX) left += moving;
+            else right += moving;
+        }
+        if (inBand) {
+            detection.leftMovement += left;
+            detection.rightMovement += right;
+        }
+    }
+    std::copy(gray, gray + numPixels, previous.begin());
+
+    if (cooldown > 0) {
+        cooldown--;
+        detection.coolingDown = true;
+        return detection;
+    }
+
+    int threshold = options.movementThreshold;
+    if (detection.leftMovement > threshold && detection.rightMovement < threshold / 2) {
+        detection.gesture = SWIPE_LEFT;
+    }
+    else if (detection.rightMovement > threshold && detection.leftMovement < threshold / 2) {
+        detection.gesture = SWIPE_RIGHT;
+    }
+    if (detection.gesture != NONE) {
+        cooldown = options.cooldownFrames;
+    }
+    return detection;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "ofMain.h"
+
+class GestureDetector {
+	// The GestureDetector finds horizontal swipes in a stream of grayscale camera frames: every frame is
+	// compared with the previous one, the pixels that changed by more than diffThreshold are counted in a
+	// horizontal band of the frame, split in a left and a right half. A swipe is reported when one half moved
+	// a lot and the other barely, then detection pauses for cooldownFrames frames.
+	// It only sees pixels, so it runs the same on the camera thread of MotionDetection and on recorded frames.
+
+public:
+
+	enum Gesture {
+		NONE,
+		SWIPE_LEFT,
+		SWIPE_RIGHT
+	};
+
+	struct Options {
+		int diffThreshold = 30; // gray level change for a pixel to count as moving
+		int movementThreshold = 1000; // moving pixels in a half for a swipe, the other half must stay below half of it
+		int cooldownFrames = 30; // frames ignored after a swipe (about one second of camera)
+		float bandTop = 0.3f; // vertical band where movement is counted, in fractions of the height
+		float bandBottom = 0.7f;
+	};
+
+	struct Detection {
+		Gesture gesture = NONE;
+		int leftMovement = 0;
+		int rightMovement = 0;
+		bool coolingDown = false; // the frame was analysed but swipes were ignored
+	};
+
+	// CONSTRUCTORS
+
+	GestureDetector() {};
+	GestureDetector(const Options& options) : options(options) {};
+
+	// DETECTION METHODS
+
+	Detection process(const uint8_t* gray, int width, int height); // one byte per pixel, rows packed
+	void reset(); // forgets the previous frame and the cooldown
+
+	// ATTRIBUTES
+
+	int getCooldown() const { return cooldown; };
+	const ofPixels& getDiff() const { return diff; }; // moving pixels of the last frame (255), only with keepDiff
+
+	Options options;
+	bool keepDiff = true; // fills getDiff(), for the debug view
+
+private:
+	std::vector<uint8_t> previous;
+	int width = 0;
+	int height = 0;
+	int cooldown = 0;
+	ofPixels diff;
+};
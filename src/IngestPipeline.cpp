@@ -0,0 +1,202 @@
+#include "IngestPipeline.h"
+#include <atomic>
+#include <thread>
+
+IngestPipeline::IngestPipeline(int numThreads, std::pair<int, int> imageSize, FeatureCache* featureCache)
+    : imageSize(imageSize), featureCache(featureCache) {
+    if (numThreads <= 0) {
+        numThreads = std::thread::hardware_concurrency();
+    }
+    this->numThreads = std::max(1, numThreads);
+}
+
+bool IngestPipeline::isSupportedFile(const std::string& path) {
+    std::string extension = ofToLower(ofFilePath::getFileExt(path));
+    return extension == "jpg" || extension == "mp4";
+}
+
+std::vector<std::string> IngestPipeline::listMediaFiles(const std::string& directory, bool recursive) {
+    std::vector<std::string> paths;
+    ofDirectory dir(directory);
+    if (!dir.exists()) {
+        ofLogWarning() << "Media directory " << directory << " does not exist";
+        return paths;
+    }
+    dir.listDir();
+    dir.sort();
+    for (size_t i = 0; i < dir.size(); i++) {
+        std::string path = dir.getPath(i);
+        if (dir.getFile(i).isDirectory()) {
+            if (!recursive) continue;
+            std::vector<std::string> children = listMediaFiles(path, true);
+            paths.insert(paths.end(), children.begin(), children.end());
+        }
+        else if (isSupportedFile(path)) {
+            paths.push_back(path);
+        }
+    }
+    return paths;
+}
+
+bool IngestPipeline::createElement(const std::string& path, MediaElement& media) {
+    std::string extension = ofToLower(ofFilePath::getFileExt(path));
+
+    if (extension == "jpg") {
+        media = MediaElement();
+        media.filePath = path;
+    }
+    else if (extension == "mp4") {
+        media = MediaElement(path);
+    }
+    else {
+        return false; // Skip unsupported formats
+    }
+    media.image.setUseTexture(false); // workers have no GL context, textures are uploaded on the main thread
+    media.luminanceMap.setUseTexture(false);
+    return true;
+}
+
+bool IngestPipeline::ingestFile(const std::string& path, MediaElement& media, FeatureHandler& featureHandler, FileReport* report) const {
+    if (!createElement(path, media)) {
+        if (report) report->failure = "unsupported format";
+        return false;
+    }
+
+    // An unchanged file restores its features, its image only has to be decoded if the gallery keeps it
+    bool cached = featureCache && featureCache->lookup(path, media);
+    if (report) report->cached = cached;
+    if (!media.isVideo() && (!cached || !releaseImages) && !loadImage(media)) {
+        if (report) report->failure = "cannot decode the image";
+        return false;
+    }
+
+    if (!cached) {
+        // Extract all relevant features using the handler
+        if (!featureHandler.computeAllFeatures(media)) {
+            if (report) report->failure = "cannot decode the video"; // the FeatureHandler logged why
+            return false;
+        }
+        if (featureCache && media.features.complete) {
+            featureCache->store(path, media); // an incomplete analysis is tried again on the next launch
+        }
+    }
+    if (releaseImages) {
+        media.image.clear(); // loaded again by the ThumbnailCache when the tile is shown
+    }
+    return true;
+}
+
+bool IngestPipeline::loadImage(MediaElement& media) const {
+    ofPixels pixels;
+    if (!ThumbnailCache::loadPixels(media.filePath, false, imageSize.first, imageSize.second, pixels)) {
+        ofLogWarning() << "Failed to load image " << media.filePath;
+        return false;
+    }
+    media.image.setFromPixels(pixels);
+    return true;
+}
+
+void IngestPipeline::parallelFor(size_t count, const std::function<void(size_t, FeatureHandler&)>& task) const {
+    std::atomic<size_t> nextIndex(0);
+
+    // Workers pull the next index until every one has been claimed
+    auto worker = [&]() {
+        FeatureHandler featureHandler;
+        featureHandler.rhythmOptions = rhythmOptions;
+        for (size_t i = nextIndex++; i < count; i = nextIndex++) {
+            task(i, featureHandler);
+        }
+    };
+
+    int threadCount = (int)std::min<size_t>(numThreads, count);
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threadCount; t++) {
+        workers.emplace_back(worker);
+    }
+    worker(); // the calling thread works too
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+std::vector<MediaElement> IngestPipeline::ingest(const std::vector<std::string>& paths) {
+    std::vector<MediaElement> results(paths.size());
+    std::vector<char> loaded(paths.size(), 0);
+    uint64_t startTime = ofGetElapsedTimeMillis();
+
+    // Each result is written to its own slot so no locking is needed
+    parallelFor(paths.size(), [&](size_t i, FeatureHandler& featureHandler) {
+        FileReport report;
+        report.path = paths[i];
+        try {
+            report.loaded = ingestFile(paths[i], results[i], featureHandler, &report);
+        }
+        catch (const std::exception& e) {
+            ofLogError() << "Error ingesting " << paths[i] << ": " << e.what();
+            report.failure = e.what();
+        }
+        loaded[i] = report.loaded;
+        if (onFileDone) onFileDone(report);
+    });
+
+    // Merge in input order, dropping the files that failed
+    std::vector<MediaElement> medias;
+    medias.reserve(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (loaded[i]) {
+            medias.push_back(std::move(results[i]));
+        }
+    }
+
+    ofLogNotice() << "Ingested " << medias.size() << "/" << paths.size() << " files in "
+        << (ofGetElapsedTimeMillis() - startTime) << " ms using " << std::max(std::min<int>(numThreads, paths.size()), 1) << " threads";
+    return medias;
+}
+
+std::vector<IngestPipeline::MissingFeature> IngestPipeline::listMissingFeature(const std::vector<MediaElement>& medias,
+    const FeatureStore& store, FeatureType feature) {
+    std::vector<MissingFeature> missing;
+    FeatureHandler featureHandler;
+    for (size_t id = 0; id < store.size(); id++) {
+        if (featureHandler.hasFeature(store, id, feature)) continue;
+        MissingFeature entry;
+        entry.id = id;
+        entry.path = medias[id].isVideo() ? medias[id].videoPath : medias[id].filePath;
+        entry.features = store.get(id);
+        missing.push_back(std::move(entry));
+    }
+    return missing;
+}
+
+void IngestPipeline::computeMissingFeature(std::vector<MissingFeature>& missing, FeatureType feature) const {
+    if (missing.empty()) return;
+
+    // Every worker decodes its files into an element of its own, the gallery keeps drawing its medias meanwhile
+    uint64_t startTime = ofGetElapsedTimeMillis();
+    parallelFor(missing.size(), [&](size_t i, FeatureHandler& featureHandler) {
+        MissingFeature& entry = missing[i];
+        MediaElement media;
+        FeatureCache::FileIdentity identity;
+        ofPixels pixels;
+        if (!createElement(entry.path, media) || !FeatureCache::getFileIdentity(entry.path, identity)) return;
+        if (!ThumbnailCache::loadPixels(entry.path, media.isVideo(), imageSize.first, imageSize.second, pixels, false, rhythmOptions.openTimeoutSeconds)) return;
+        media.image.setFromPixels(pixels);
+        media.features = std::move(entry.features);
+        featureHandler.computeFeature(media, feature);
+        if (featureCache) {
+            featureCache->update(entry.path, media, identity); // files left out of the cache stay out
+        }
+        entry.features = std::move(media.features);
+        entry.computed = true;
+    });
+    ofLogNotice() << "Computed the missing features of " << missing.size() << " elements in " << (ofGetElapsedTimeMillis() - startTime) << " ms";
+}
+
+void IngestPipeline::mergeMissingFeature(const std::vector<MissingFeature>& missing, FeatureStore& store, FeatureType feature) {
+    for (const MissingFeature& entry : missing) {
+        if (!entry.computed || entry.id >= store.size()) continue;
+        if (feature == EDGE) {
+            store.setEdgeHistogram(entry.id, entry.features.edgeHist);
+        }
+    }
+}
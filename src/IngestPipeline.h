@@ -0,0 +1,74 @@
+#pragma once
+#include "ofMain.h"
+#include "MediaElement.h"
+#include "FeatureHandler.h"
+#include "FeatureCache.h"
+#include "FeatureStore.h"
+#include "ThumbnailCache.h"
+#include <functional>
+
+class IngestPipeline {
+	// The IngestPipeline loads media files and extracts their features on a pool of worker threads.
+	// Every worker decodes, resizes and runs FeatureHandler::computeAllFeatures on its own files,
+	// results are then merged back in the order of the input paths, so the gallery layout does not
+	// depend on which worker finished first.
+	// With a FeatureCache, unchanged files restore their features instead of being analysed again.
+	// Elements are produced without GPU textures (workers have no GL context): call
+	// MediaElement::uploadTextures() on the main thread before drawing them.
+	// With releaseImages the elements come out without pixels, the gallery then loads the visible ones with a
+	// ThumbnailCache; a file found in the FeatureCache is then not even decoded.
+	// The gallery and the headless indexer (tools/indexer) share this pipeline, so the FeatureCache written by
+	// the indexer is the one the gallery reads.
+
+public:
+
+	// CONSTRUCTORS
+
+	IngestPipeline(int numThreads = 0, std::pair<int, int> imageSize = { 280, 280 }, FeatureCache* featureCache = nullptr); // numThreads <= 0 uses one thread per hardware core
+
+	// INGEST METHODS
+
+	std::vector<MediaElement> ingest(const std::vector<std::string>& paths); // blocks until every file has been processed
+	struct FileReport;
+	bool ingestFile(const std::string& path, MediaElement& media, FeatureHandler& featureHandler, FileReport* report = nullptr) const; // returns false for unsupported or unreadable files, report tells why
+
+	static bool isSupportedFile(const std::string& path);
+	static bool createElement(const std::string& path, MediaElement& media); // empty element of the file's type, false if unsupported
+	static std::vector<std::string> listMediaFiles(const std::string& directory, bool recursive = false); // supported files, sorted, paths as ofDirectory gives them
+
+	// Outcome of one file of ingest(), given to onFileDone
+	struct FileReport {
+		std::string path;
+		bool loaded = false;
+		bool cached = false; // features restored from the FeatureCache
+		std::string failure; // why the file was dropped, empty when loaded
+	};
+
+	// A media whose row of the store lacks a lazy feature (EDGE). Listed and merged on the main thread, computed
+	// in between on any thread: computeMissingFeature touches neither the medias nor the store
+	struct MissingFeature {
+		MediaId id = 0;
+		std::string path;
+		MediaFeatures features; // the row of the store, the computed feature is added to it
+		bool computed = false; // false if the file could not be decoded
+	};
+	static std::vector<MissingFeature> listMissingFeature(const std::vector<MediaElement>& medias, const FeatureStore& store, FeatureType feature);
+	// Decodes the files again and computes the feature, in parallel, and refreshes their FeatureCache entries
+	void computeMissingFeature(std::vector<MissingFeature>& missing, FeatureType feature) const;
+	static void mergeMissingFeature(const std::vector<MissingFeature>& missing, FeatureStore& store, FeatureType feature);
+
+	// ATTRIBUTES
+
+	int getNumThreads() const { return numThreads; };
+	FeatureHandler::RhythmOptions rhythmOptions; // given to the FeatureHandler of every worker
+	bool releaseImages = false; // drop the pixels of every element once its features are extracted
+	std::function<void(const FileReport&)> onFileDone; // optional, called by the workers after every file: must be thread safe
+
+private:
+	bool loadImage(MediaElement& media) const; // decodes media.filePath resized to imageSize
+	void parallelFor(size_t count, const std::function<void(size_t, FeatureHandler&)>& task) const; // runs task(0..count-1) on the workers
+
+	int numThreads = 1;
+	std::pair<int, int> imageSize; // size every image is resized to before feature extraction
+	FeatureCache* featureCache = nullptr; // optional, not owned
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class MappedFile {
+	// The MappedFile maps a whole file read-only in the address space: its pages are read from the disk (or the
+	// page cache) the first time they are touched, so opening a large file costs nothing until it is read and
+	// data that is never read is never loaded. The mapping lives as long as the object.
+	// The file must not be truncated while it is mapped: files are rewritten under another name and renamed.
+
+public:
+
+	// CONSTRUCTORS
+
+	MappedFile() {};
+	~MappedFile() { close(); };
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// MAPPING METHODS
+
+	bool open(const std::string& path); // absolute path, false if the file is missing, empty or cannot be mapped
+	void close();
+
+	// ATTRIBUTES
+
+	bool isOpen() const { return data != nullptr; };
+	const uint8_t* getData() const { return data; };
+	size_t size() const { return length; };
+
+private:
+	const uint8_t* data = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void* file = nullptr; // HANDLE
+	void* mapping = nullptr; // HANDLE
+#endif
+};
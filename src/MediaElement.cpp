@@ -1,4 +1,7 @@
 #include "MediaElement.h"
+#include "BinaryIO.h"
+
+static const uint32_t maxThumbnailSide = 8192; // cached thumbnails are ingest sized, a larger one is a corrupt entry
 
 
 
@@ -14,6 +17,18 @@ ofColor MediaElement::getHeatmapColor(float value) {
     }
 }
 
+void MediaElement::uploadTextures() {
+    // Must be called from the main thread: images loaded by the ingest workers only hold pixels
+    if (image.isAllocated() && !image.isUsingTexture()) {
+        image.setUseTexture(true);
+        image.update();
+    }
+    if (luminanceMap.isAllocated() && !luminanceMap.isUsingTexture()) {
+        luminanceMap.setUseTexture(true);
+        luminanceMap.update();
+    }
+}
+
 
 // -------------------------------------------------------------------------------------------------------------------------
 // DRAWER METHODS 
@@ -35,81 +50,6 @@ void MediaElement::drawImageWithContour(int x, int y, ofColor contourColor, int
     ofSetColor(ofColor::white);
 }
 
-void MediaElement::drawNormalizedRGBHistogram(int x, int y, int width, int height) const {
-
-    const int numBins = (int)redHist.size(); // Assuming all histograms have same bin count
-    const float sectionWidth = width / 3.0f; // Width allocated per color channel
-    const float barSpacing = 1.0f;           // Spacing between bars in pixels
-
-    ofFill();
-
-    // Helper lambda to draw a single color histogram
-    auto drawHistogram = [&](const std::vector<float>& hist, float startX, const ofColor& color) {
-        ofSetColor(color);
-        float barWidth = (sectionWidth - (numBins - 1) * barSpacing) / numBins;
-
-        for (int i = 0; i < numBins; ++i) {
-            float barHeight = height * hist[i];
-            float barX = startX + i * (barWidth + barSpacing);
-            ofDrawRectangle(barX, y, barWidth, -barHeight);
-        }
-    };
-
-    // Draw Red histogram
-    drawHistogram(redHist, x, ofColor::red);
-    // Draw Green histogram
-    drawHistogram(greenHist, x + sectionWidth, ofColor::green);
-    // Draw Blue histogram
-    drawHistogram(blueHist, x + 2 * sectionWidth, ofColor::blue);
-
-    ofSetColor(ofColor::white); // Reset color
-}
-
-
-
-void MediaElement::drawEdgeMap(int x, int y, int width, int height) const {
-    
-    if (edgeHist.empty()) return;
-	int gridCols = this->edgeGridCols;
-	int gridRows = this->edgeGridRows;
-    int totalCells = gridRows * gridCols;
-    if (edgeHist.size() != totalCells) return;
-
-    // Determine max value for normalization
-    float maxVal = *std::max_element(edgeHist.begin(), edgeHist.end());
-    if (maxVal <= 0.0f) return;
-
-    // Cell size based on provided drawing area
-    float cellWidth = static_cast<float>(width) / gridCols;
-    float cellHeight = static_cast<float>(height) / gridRows;
-    ofEnableAlphaBlending();
-
-    for (int row = 0; row < gridRows; ++row) {
-        for (int col = 0; col < gridCols; ++col) {
-            int index = row * gridCols + col;
-            float normalizedValue = edgeHist[index] / maxVal;
-            ofFill();
-            // Map normalized value to grayscale brightness
-            ofSetColor(255 * normalizedValue, 255 * normalizedValue, 255 * normalizedValue, 150); // Alpha blend
-
-            float cellX = x + col * cellWidth;
-            float cellY = y + row * cellHeight;
-            ofDrawRectangle(cellX, cellY, cellWidth, cellHeight);
-        }
-    }
-
-    // draw grid border
-    ofNoFill();
-    ofSetColor(100); // light gray
-    ofDrawRectangle(x, y, width, height);
-    ofFill();
-
-    // Reset color
-    ofSetColor(255);
-    ofDisableAlphaBlending();
-
-}
-
 void MediaElement::drawLuminanceMap(int x, int y) const {
     ofEnableAlphaBlending(); // Enable transparency
 
@@ -121,7 +61,7 @@ void MediaElement::drawLuminanceMap(int x, int y) const {
 }
 
 
-void MediaElement::saveToXML(ofxXmlSettings& xml, int index) const {
+void MediaElement::saveToXML(ofxXmlSettings& xml, int index, const MediaFeatures& features) const {
     std::string tag = "media";
     xml.addTag(tag);
     xml.pushTag(tag, index);
@@ -131,24 +71,24 @@ void MediaElement::saveToXML(ofxXmlSettings& xml, int index) const {
     xml.addValue("isVideoFlag", isVideoFlag);
     xml.addValue("isPaused", isPaused);
 
-    xml.addValue("averageLuminance", averageLuminance);
-    xml.addValue("rhythmScore", rhythmMetric); // Updated from rhythmScore
-    xml.addValue("textureVariance", textureVariance);
+    xml.addValue("averageLuminance", features.averageLuminance);
+    xml.addValue("rhythmScore", features.rhythmMetric); // Updated from rhythmScore
+    xml.addValue("textureVariance", features.textureVariance);
 
-    xml.addValue("luminanceGroup", int(luminanceGroup));
-    xml.addValue("colorGroup", int(colorGroup));
-    xml.addValue("textureGroup", int(textureGroup));
-    xml.addValue("rhythmGroup", int(rhythmGroup));
+    xml.addValue("luminanceGroup", int(features.luminanceGroup));
+    xml.addValue("colorGroup", int(features.colorGroup));
+    xml.addValue("textureGroup", int(features.textureGroup));
+    xml.addValue("rhythmGroup", int(features.rhythmGroup));
 
-    xml.addValue("dominantColorR", dominantColor.r);
-    xml.addValue("dominantColorG", dominantColor.g);
-    xml.addValue("dominantColorB", dominantColor.b);
+    xml.addValue("dominantColorR", features.dominantColor.r);
+    xml.addValue("dominantColorG", features.dominantColor.g);
+    xml.addValue("dominantColorB", features.dominantColor.b);
 
 
     xml.popTag(); // media
 }
 
-void MediaElement::loadFromXML(ofxXmlSettings& xml, int index) {
+void MediaElement::loadFromXML(ofxXmlSettings& xml, int index, MediaFeatures& features) {
     std::string tag = "media";
     if (!xml.tagExists(tag)) return;
 
@@ -159,18 +99,108 @@ void MediaElement::loadFromXML(ofxXmlSettings& xml, int index) {
     isVideoFlag = xml.getValue("isVideoFlag", false);
     isPaused = xml.getValue("isPaused", false);
 
-    averageLuminance = xml.getValue("averageLuminance", 0.0f);
-    rhythmMetric = xml.getValue("rhythmScore", 0.0f);
-    textureVariance = xml.getValue("textureVariance", 0.0f);
+    features.averageLuminance = xml.getValue("averageLuminance", 0.0f);
+    features.rhythmMetric = xml.getValue("rhythmScore", 0.0f);
+    features.textureVariance = xml.getValue("textureVariance", 0.0f);
 
-    luminanceGroup = static_cast<LuminanceGroup>(xml.getValue("luminanceGroup", 0));
-    colorGroup = static_cast<ColorGroup>(xml.getValue("colorGroup", 0));
-    textureGroup = static_cast<TextureGroup>(xml.getValue("textureGroup", 0));
-    rhythmGroup = static_cast<RhythmGroup>(xml.getValue("rhythmGroup", 0));
+    features.luminanceGroup = static_cast<LuminanceGroup>(xml.getValue("luminanceGroup", 0));
+    features.colorGroup = static_cast<ColorGroup>(xml.getValue("colorGroup", 0));
+    features.textureGroup = static_cast<TextureGroup>(xml.getValue("textureGroup", 0));
+    features.rhythmGroup = static_cast<RhythmGroup>(xml.getValue("rhythmGroup", 0));
 
-    dominantColor.r = xml.getValue("dominantColorR", 0);
-    dominantColor.g = xml.getValue("dominantColorG", 0);
-    dominantColor.b = xml.getValue("dominantColorB", 0);
+    features.dominantColor.r = xml.getValue("dominantColorR", 0);
+    features.dominantColor.g = xml.getValue("dominantColorG", 0);
+    features.dominantColor.b = xml.getValue("dominantColorB", 0);
 
     xml.popTag(); // media
 }
+
+
+// -------------------------------------------------------------------------------------------------------------------------
+// BINARY METHODS 
+// -------------------------------------------------------------------------------------------------------------------------
+
+void MediaElement::saveFeatures(std::ostream& out) const {
+    writeBinary(out, features.averageLuminance);
+    writeBinary(out, features.textureVariance);
+    writeBinary(out, features.rhythmMetric);
+    writeBinary(out, int32_t(features.rhythmFrameStride));
+
+    writeBinary(out, int32_t(features.luminanceGroup));
+    writeBinary(out, int32_t(features.colorGroup));
+    writeBinary(out, int32_t(features.textureGroup));
+    writeBinary(out, int32_t(features.rhythmGroup));
+
+    writeBinary(out, features.dominantColor.r);
+    writeBinary(out, features.dominantColor.g);
+    writeBinary(out, features.dominantColor.b);
+
+    writeBinary(out, features.redHist);
+    writeBinary(out, features.greenHist);
+    writeBinary(out, features.blueHist);
+    writeBinary(out, int32_t(features.edgeGridRows));
+    writeBinary(out, int32_t(features.edgeGridCols));
+    writeBinary(out, features.edgeHist);
+
+    // Video thumbnails come out of the extraction too, store them so a cached video is never decoded
+    bool hasThumbnail = isVideo() && image.isAllocated();
+    writeBinary(out, hasThumbnail);
+    if (hasThumbnail) {
+        const ofPixels& pixels = image.getPixels();
+        writeBinary(out, uint32_t(pixels.getWidth()));
+        writeBinary(out, uint32_t(pixels.getHeight()));
+        writeBinary(out, uint32_t(pixels.getNumChannels()));
+        out.write(reinterpret_cast<const char*>(pixels.getData()), pixels.size());
+    }
+}
+
+bool MediaElement::loadFeatures(std::istream& in) {
+    int32_t luminance = 0, color = 0, texture = 0, rhythm = 0;
+    int32_t gridRows = 0, gridCols = 0;
+
+    readBinary(in, features.averageLuminance);
+    readBinary(in, features.textureVariance);
+    readBinary(in, features.rhythmMetric);
+    int32_t frameStride = 1;
+    readBinary(in, frameStride);
+    features.rhythmFrameStride = std::max(1, frameStride);
+
+    readBinary(in, luminance);
+    readBinary(in, color);
+    readBinary(in, texture);
+    readBinary(in, rhythm);
+    if (std::max({ luminance, color, texture, rhythm }) > 2 || std::min({ luminance, color, texture, rhythm }) < 0) return false;
+    features.luminanceGroup = static_cast<LuminanceGroup>(luminance);
+    features.colorGroup = static_cast<ColorGroup>(color);
+    features.textureGroup = static_cast<TextureGroup>(texture);
+    features.rhythmGroup = static_cast<RhythmGroup>(rhythm);
+
+    readBinary(in, features.dominantColor.r);
+    readBinary(in, features.dominantColor.g);
+    readBinary(in, features.dominantColor.b);
+
+    readBinary(in, features.redHist);
+    readBinary(in, features.greenHist);
+    readBinary(in, features.blueHist);
+    readBinary(in, gridRows);
+    readBinary(in, gridCols);
+    readBinary(in, features.edgeHist);
+    features.edgeGridRows = gridRows;
+    features.edgeGridCols = gridCols;
+
+    bool hasThumbnail = false;
+    if (!readBinary(in, hasThumbnail)) return false;
+    if (hasThumbnail) {
+        uint32_t width = 0, height = 0, channels = 0;
+        readBinary(in, width);
+        readBinary(in, height);
+        if (!readBinary(in, channels) || channels == 0 || channels > 4) return false;
+        if (width == 0 || height == 0 || width > maxThumbnailSide || height > maxThumbnailSide) return false;
+        ofPixels pixels;
+        pixels.allocate(width, height, channels);
+        in.read(reinterpret_cast<char*>(pixels.getData()), pixels.size());
+        if (!in) return false;
+        image.setFromPixels(pixels);
+    }
+    return true;
+}
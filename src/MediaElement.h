@@ -3,11 +3,14 @@
 #include "utils.h"
 #include "ofxXmlSettings.h"
 #include "ofxOpenCv.h"
+#include "MediaFeatures.h"
 
 class MediaElement {
 	// The MediaElement class is used to handle both videos and images in the gallery. 
 	// The "image" field will contain the thumbnail of the video if the element is a video, 
 	// otherwise the image itself (and the path  to the video will be null). 
+	// A MediaElement owns its pixels, so it can be moved but not copied. Videos are played by the VideoPlayback.
+	// Its features are only held in "features" during ingest, the gallery then moves them to the FeatureStore.
 
 public:
 	
@@ -17,48 +20,44 @@ public:
 	MediaElement(ofImage img) : image(img) {};
 	MediaElement(ofImage img, int width, int height, string filePath) : image(img), filePath(filePath) { image.resize(width, height); }; // resize the image to the given width and height
 	MediaElement(string path) : videoPath(path) { isVideoFlag = true; }; // constructor for video elements
+	MediaElement(const MediaElement&) = delete;
+	MediaElement& operator=(const MediaElement&) = delete;
+	MediaElement(MediaElement&&) = default;
+	MediaElement& operator=(MediaElement&&) = default;
 	
 	// MISC METHODS
 
 	bool isVideo() const { return !(this->videoPath.empty()); };
 	bool isVideoFlag = false; // Flag to indicate if the element is a video (used for xml serialization)
 	ofColor getHeatmapColor(float value); // Returns a color based on the luminance value for heatmap visualization
+	void uploadTextures(); // Creates the GPU textures of elements built off the main thread (see IngestPipeline)
 
 	// DRAWER METHODS 
 
 	void drawImage(int x, int y) const { image.draw(x, y); };
 	void drawImageWithContour(int x, int y, ofColor contourColor = ofColor::white, int thickness = 5) const;
-	void drawEdgeMap(int x, int y, int width, int height) const;
-	void drawNormalizedRGBHistogram(int x, int y, int width, int height) const;
 	void drawLuminanceMap(int x, int y) const;
 
 
 	// XML METHODS
-	void saveToXML(ofxXmlSettings& xml, int index) const;
-	void loadFromXML(ofxXmlSettings& xml, int index);
+	void saveToXML(ofxXmlSettings& xml, int index, const MediaFeatures& features) const; // features come from the FeatureStore once ingested
+	void loadFromXML(ofxXmlSettings& xml, int index, MediaFeatures& features);
+
+	// BINARY METHODS
+	void saveFeatures(std::ostream& out) const; // Writes "features", including the full histograms, and the video thumbnail (see FeatureCache)
+	bool loadFeatures(std::istream& in); // Returns false if the data is truncated
 
 
 	// ATTRIBUTES
 
-	bool isPaused = false; // needed as openFramework's "isPlaying()" returns true evern if the video is currently paused
-	ofVideoPlayer videoPlayer; // Video player for the video element
-	ofImage image;
+	bool isPaused = false; // state of the last play/pause of the video, kept for the xml metadata
+	ofImage image; // grid thumbnail, resident only around the viewport (see ThumbnailCache)
+	ofImage screenImage; // fullscreen level of the image pyramid, loaded on demand (see ThumbnailCache)
 	string videoPath = ""; // Path to the video file, empty if this is an image element
 	string filePath = ""; // Path to the image file, empty if this is a video element
 
 	// string xml_data;
-	ofColor dominantColor;
-	ofImage luminanceMap; // Heatmap-style luminance visualization
-	LuminanceGroup luminanceGroup = LOW; // Grouping of luminance values into LOW, MEDIUM, HIGH
-	ColorGroup colorGroup = RED; // Grouping of colors into RED, GREEN, BLUE
-	TextureGroup textureGroup = SMOOTH_TEXTURE; // Grouping of textures into SMOOTH, MEDIUM, COARSE
-	RhythmGroup rhythmGroup = STATIC; // Grouping of rhythm into STATIC, MODERATE, FAST
-	std::vector<float> redHist, greenHist, blueHist;
-	std::vector<float> edgeHist; // Edge histogram
-	int edgeGridRows = 32;
-	int edgeGridCols = 32;
-	float averageLuminance = 0;
-	float textureVariance = 0.0f;
-	float rhythmMetric = 0.0f; // Metric for rhythm analysis
+	ofImage luminanceMap; // Heatmap-style luminance visualization (lazy, see OverlayCache)
+	MediaFeatures features; // Output of the extractors, empty once moved to the FeatureStore
 };
 
@@ -0,0 +1,24 @@
+#pragma once
+#include "ofMain.h"
+#include "utils.h"
+
+struct MediaFeatures {
+	// MediaFeatures is the record the extractors of FeatureHandler write into, one per MediaElement while it is
+	// being ingested. Once ingest is done the gallery moves every record into the FeatureStore, where the features
+	// are kept column by column, so the record of an ingested element is empty.
+
+	ofColor dominantColor;
+	LuminanceGroup luminanceGroup = LOW; // Grouping of luminance values into LOW, MEDIUM, HIGH
+	ColorGroup colorGroup = RED; // Grouping of colors into RED, GREEN, BLUE
+	TextureGroup textureGroup = SMOOTH_TEXTURE; // Grouping of textures into SMOOTH, MEDIUM, COARSE
+	RhythmGroup rhythmGroup = STATIC; // Grouping of rhythm into STATIC, MODERATE, FAST
+	std::vector<float> redHist, greenHist, blueHist;
+	std::vector<float> edgeHist; // Edge histogram
+	int edgeGridRows = 32;
+	int edgeGridCols = 32;
+	float averageLuminance = 0;
+	float textureVariance = 0.0f;
+	float rhythmMetric = 0.0f; // Metric for rhythm analysis
+	int rhythmFrameStride = 1; // frames between the samples the rhythm metric compares, grows for long videos
+	bool complete = true; // false when the video analysis stopped early, the FeatureCache does not keep such records
+};
@@ -0,0 +1,257 @@
+#include "MediaWatcher.h"
+#include "IngestPipeline.h"
+#include <filesystem>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const int tickMs = 100; // longest wait of the watcher thread, so that stop() stays responsive
+}
+
+MediaWatcher::~MediaWatcher() {
+    stop();
+}
+
+void MediaWatcher::setup(const std::vector<std::string>& directories, bool recursive, const std::vector<std::string>& knownPaths,
+    std::pair<int, int> imageSize, FeatureCache* featureCache) {
+    stop();
+    this->directories = directories;
+    this->recursive = recursive;
+    this->imageSize = imageSize;
+    this->featureCache = featureCache;
+    featureHandler.rhythmOptions = rhythmOptions;
+
+    openNotifier();
+    if (!usesNotifications()) {
+        ofLogNotice() << "No file notifications, the media directories are rescanned every " << pollIntervalMs << " ms";
+    }
+    running = true;
+    watchThread = std::thread(&MediaWatcher::watchLoop, this, knownPaths);
+}
+
+void MediaWatcher::stop() {
+    if (!watchThread.joinable()) return;
+    running = false;
+    watchThread.join();
+    closeNotifier();
+}
+
+std::vector<MediaWatcher::Change> MediaWatcher::poll() {
+    std::vector<Change> ready;
+    std::lock_guard<std::mutex> lock(mutex);
+    ready.swap(changes);
+    return ready;
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// WATCHER THREAD
+// -------------------------------------------------------------------------------------------------------------------------
+
+void MediaWatcher::watchLoop(std::vector<std::string> knownPaths) {
+    typedef std::chrono::steady_clock Clock;
+    bool allWatched = watchDirectories();
+
+    // The gallery holds knownPaths: files created during the startup ingest are new, the deleted ones get
+    // a state no scan can match so that they are reported as removed
+    Snapshot current = scan();
+    Snapshot snapshot;
+    for (const auto& path : knownPaths) {
+        auto it = current.find(path);
+        FileState state;
+        state.exists = true;
+        snapshot[path] = it != current.end() ? it->second : state;
+    }
+
+    Snapshot unsettled;
+    bool dirty = true; // the first scan compares the directories with knownPaths
+    Clock::time_point lastEvent = Clock::now() - std::chrono::milliseconds(debounceMs);
+    Clock::time_point lastScan = Clock::now();
+    while (running) {
+        if (waitForEvents(tickMs)) {
+            dirty = true;
+            lastEvent = Clock::now();
+        }
+        Clock::time_point now = Clock::now();
+        if (!allWatched && now - lastScan >= std::chrono::milliseconds(pollIntervalMs)) dirty = true;
+        if (!dirty || now - lastEvent < std::chrono::milliseconds(debounceMs)) continue;
+
+        dirty = rescan(snapshot, unsettled);
+        lastScan = lastEvent = Clock::now(); // a confirmation scan comes debounceMs later
+        allWatched = watchDirectories(); // new subdirectories, or a directory created again
+    }
+}
+
+MediaWatcher::Snapshot MediaWatcher::scan() const {
+    Snapshot snapshot;
+    for (const auto& directory : directories) {
+        if (!ofDirectory(directory).exists()) continue; // not created yet, or deleted
+        for (const auto& path : IngestPipeline::listMediaFiles(directory, recursive)) {
+            std::error_code error;
+            std::filesystem::path file(ofToDataPath(path, true));
+            FileState state;
+            state.size = std::filesystem::file_size(file, error);
+            if (error) continue; // deleted since the listing
+            state.modifiedTime = std::filesystem::last_write_time(file, error).time_since_epoch().count();
+            if (error) continue;
+            state.exists = true;
+            snapshot[path] = state;
+        }
+    }
+    return snapshot;
+}
+
+bool MediaWatcher::rescan(Snapshot& snapshot, Snapshot& unsettled) {
+    Snapshot current = scan();
+    std::vector<std::pair<std::string, FileState>> differences;
+    for (const auto& file : current) {
+        auto it = snapshot.find(file.first);
+        if (it == snapshot.end() || !(it->second == file.second)) differences.push_back(file);
+    }
+    for (const auto& file : snapshot) {
+        if (!current.count(file.first)) differences.push_back({ file.first, FileState() });
+    }
+
+    // A difference found identical by the previous scan is settled, the others wait for the next scan
+    Snapshot waiting;
+    std::vector<std::pair<std::string, ChangeType>> settled;
+    for (const auto& difference : differences) {
+        auto it = unsettled.find(difference.first);
+        if (it == unsettled.end() || !(it->second == difference.second)) {
+            waiting.insert(difference);
+            continue;
+        }
+        const std::string& path = difference.first;
+        if (!difference.second.exists) {
+            settled.push_back({ path, REMOVED });
+            snapshot.erase(path);
+        }
+        else {
+            settled.push_back({ path, snapshot.count(path) ? MODIFIED : ADDED });
+            snapshot[path] = difference.second;
+        }
+    }
+    unsettled.swap(waiting);
+
+    if (!settled.empty()) ingest(settled);
+    return !unsettled.empty();
+}
+
+void MediaWatcher::ingest(const std::vector<std::pair<std::string, ChangeType>>& settled) {
+    IngestPipeline ingestPipeline(1, imageSize, featureCache);
+    ingestPipeline.releaseImages = true; // the gallery loads the thumbnails when the tiles are shown
+    bool extracted = false;
+
+    for (const auto& file : settled) {
+        if (!running) return;
+        Change change;
+        change.path = file.first;
+        change.type = file.second;
+        if (change.type != REMOVED) {
+            IngestPipeline::FileReport report;
+            bool loaded = false;
+            try {
+                loaded = ingestPipeline.ingestFile(change.path, change.media, featureHandler, &report);
+            }
+            catch (const std::exception& e) {
+                report.failure = e.what();
+            }
+            if (!loaded) {
+                ofLogWarning() << "Cannot ingest " << change.path << " (" << report.failure << "), it leaves the gallery";
+                change.type = REMOVED;
+                change.media = MediaElement();
+            }
+            extracted = extracted || (loaded && !report.cached);
+        }
+        ofLogNotice() << (change.type == ADDED ? "New media " : change.type == MODIFIED ? "Changed media " : "Removed media ") << change.path;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        changes.push_back(std::move(change));
+    }
+    if (extracted && featureCache) {
+        featureCache->save(false); // keep them for the next launch
+    }
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// FILE NOTIFICATIONS
+// -------------------------------------------------------------------------------------------------------------------------
+
+void MediaWatcher::openNotifier() {
+#ifdef __linux__
+    notifier = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+void MediaWatcher::closeNotifier() {
+#ifdef __linux__
+    if (notifier >= 0) close(notifier);
+#endif
+    notifier = -1;
+    watchedDirectories.clear();
+}
+
+bool MediaWatcher::watchDirectories() {
+    if (!usesNotifications()) return false;
+    bool allWatched = true;
+    for (const auto& directory : directories) {
+        allWatched = watchDirectory(directory) && allWatched;
+    }
+    return allWatched;
+}
+
+bool MediaWatcher::watchDirectory(const std::string& directory) {
+#ifdef __linux__
+    // Watching a directory again returns its existing watch descriptor
+    std::string path = ofToDataPath(directory, true);
+    const uint32_t mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF;
+    int watch = inotify_add_watch(notifier, path.c_str(), mask);
+    if (watch < 0) return false;
+    watchedDirectories[watch] = path;
+    if (!recursive) return true;
+
+    bool allWatched = true;
+    ofDirectory dir(path);
+    dir.listDir();
+    for (size_t i = 0; i < dir.size(); i++) {
+        if (dir.getFile(i).isDirectory()) allWatched = watchDirectory(dir.getPath(i)) && allWatched;
+    }
+    return allWatched;
+#else
+    return false;
+#endif
+}
+
+bool MediaWatcher::waitForEvents(int timeoutMs) {
+#ifdef __linux__
+    if (usesNotifications()) {
+        pollfd descriptor = { notifier, POLLIN, 0 };
+        if (::poll(&descriptor, 1, timeoutMs) <= 0) return false;
+
+        // Only the directories matter here: the rescan finds which files changed
+        alignas(inotify_event) char buffer[4096];
+        bool changed = false;
+        ssize_t length;
+        while ((length = ::read(notifier, buffer, sizeof(buffer))) > 0) {
+            const inotify_event* event = nullptr;
+            for (char* p = buffer; p < buffer + length; p += sizeof(inotify_event) + event->len) {
+                event = reinterpret_cast<const inotify_event*>(p);
+                changed = true;
+                if (event->mask & IN_IGNORED) {
+                    watchedDirectories.erase(event->wd); // the directory was deleted
+                }
+                else if (recursive && (event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                    // Watched right away, files copied into a new subdirectory must not be missed
+                    auto it = watchedDirectories.find(event->wd);
+                    if (it != watchedDirectories.end()) watchDirectory(it->second + "/" + event->name);
+                }
+            }
+        }
+        return changed;
+    }
+#endif
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+    return false;
+}
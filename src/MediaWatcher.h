@@ -0,0 +1,94 @@
+#pragma once
+#include "ofMain.h"
+#include "MediaElement.h"
+#include "FeatureCache.h"
+#include "FeatureHandler.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+
+class MediaWatcher {
+	// The MediaWatcher follows the media directories while the gallery runs: files added, changed or deleted
+	// after the startup ingest are reported without a restart.
+	// A background thread waits for file events (inotify on Linux, a periodic rescan elsewhere), rescans the
+	// directories once the events stop for debounceMs, and compares the size and modification time of every file
+	// with the previous scan. A difference is only trusted when the next scan, debounceMs later, finds the same
+	// file again: a file still being copied keeps changing and is reported once complete, a burst of events
+	// (a whole folder copied) ends in a single rescan.
+	// Added and changed files are then ingested on the same thread, with the IngestPipeline and the FeatureCache
+	// of the gallery, and queued for the main thread; poll() only swaps that queue, it never waits for the
+	// watcher. The elements come out without pixels nor textures, like the startup ingest with releaseImages.
+
+public:
+
+	enum ChangeType {
+		ADDED,
+		MODIFIED,
+		REMOVED // deleted, or no longer readable
+	};
+
+	struct Change {
+		ChangeType type;
+		std::string path; // as IngestPipeline::listMediaFiles gives it
+		MediaElement media; // ADDED and MODIFIED: the ingested element, with its features
+	};
+
+	// CONSTRUCTORS
+
+	MediaWatcher() {};
+	~MediaWatcher();
+	MediaWatcher(const MediaWatcher&) = delete;
+	MediaWatcher& operator=(const MediaWatcher&) = delete;
+
+	// knownPaths are the files already in the gallery: files of the directories missing from it are reported as added
+	void setup(const std::vector<std::string>& directories, bool recursive, const std::vector<std::string>& knownPaths,
+		std::pair<int, int> imageSize, FeatureCache* featureCache = nullptr); // starts the watcher thread
+	void stop();
+
+	// WATCHER METHODS
+
+	std::vector<Change> poll(); // changes ingested since the last call, oldest first
+
+	// ATTRIBUTES
+
+	bool isRunning() const { return watchThread.joinable(); };
+	bool usesNotifications() const { return notifier >= 0; }; // false: the directories are rescanned every pollIntervalMs
+	int debounceMs = 500; // quiet time after the last event before a rescan, and between the two scans that confirm a change
+	int pollIntervalMs = 2000; // rescan period without file notifications, or while a directory cannot be watched
+	FeatureHandler::RhythmOptions rhythmOptions; // given to the FeatureHandler of the watcher
+
+private:
+	struct FileState {
+		bool exists = false;
+		uint64_t size = 0;
+		int64_t modifiedTime = 0;
+		bool operator==(const FileState& other) const { return exists == other.exists && size == other.size && modifiedTime == other.modifiedTime; };
+	};
+	typedef std::map<std::string, FileState> Snapshot; // path -> state
+
+	void watchLoop(std::vector<std::string> knownPaths);
+	Snapshot scan() const; // every supported file of the directories
+	bool rescan(Snapshot& snapshot, Snapshot& unsettled); // returns true while differences wait for their confirmation scan
+	void ingest(const std::vector<std::pair<std::string, ChangeType>>& settled); // queues the changes for poll()
+
+	void openNotifier();
+	bool watchDirectories(); // (re)watches every directory, false if one cannot be watched
+	bool watchDirectory(const std::string& directory); // also its subdirectories when recursive
+	bool waitForEvents(int timeoutMs); // true if files changed, false on timeout
+	void closeNotifier();
+
+	std::vector<std::string> directories;
+	bool recursive = false;
+	std::pair<int, int> imageSize = { 280, 280 };
+	FeatureCache* featureCache = nullptr; // optional, not owned
+	FeatureHandler featureHandler; // watcher thread only
+
+	std::thread watchThread;
+	std::atomic<bool> running{ false };
+	int notifier = -1; // inotify descriptor, -1 when polling
+	std::map<int, std::string> watchedDirectories; // inotify watch descriptor -> absolute directory, watcher thread only
+
+	std::mutex mutex; // guards changes
+	std::vector<Change> changes;
+};
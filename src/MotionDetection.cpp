@@ -2,39 +2,206 @@
 
 #include "MotionDetection.h"
 #include "MediaElement.h"
+#include "FeatureStore.h"
 #include "ofApp.h"
+#include <opencv2/opencv.hpp>
+
+MotionDetection::~MotionDetection() {
+    stop();
+}
 
 void MotionDetection::SetupMotionDetection() {
     ofSetFrameRate(60);
-    cam.setup(camWidth, camHeight);
-    colorImg.allocate(camWidth, camHeight);
-    grayImg.allocate(camWidth, camHeight);
-    prevGrayImg.allocate(camWidth, camHeight);
-    diffImg.allocate(camWidth, camHeight);
+    if (!replayPath.empty()) {
+        // Recorded frames instead of the camera, to reproduce a gesture session
+        if (!replay.open(ofToDataPath(replayPath))) {
+            ofLogError() << "Cannot replay the gesture recording " << replayPath;
+            return;
+        }
+        ofLogNotice() << "Replaying the gesture recording " << replayPath << " instead of the camera";
+    }
+    else {
+        cam.setUseTexture(false); // the frames are only read by the camera thread
+        cam.setup(camWidth, camHeight);
+        if (!cam.isInitialized()) {
+            ofLogWarning() << "No camera, gesture navigation is disabled";
+            return;
+        }
+    }
+    capturing = true;
+    captureThread = std::thread(&MotionDetection::captureLoop, this);
 }
 
+void MotionDetection::stop() {
+    if (!captureThread.joinable()) return;
+    capturing = false;
+    captureThread.join();
+    if (cam.isInitialized()) cam.close();
+}
+
+bool MotionDetection::startRecording(const std::string& path) {
+    if (!captureThread.joinable() || !replayPath.empty()) return false; // only live camera frames are recorded
+    {
+        std::lock_guard<std::mutex> lock(recordingMutex);
+        recordingPath = path;
+    }
+    recordingRequested = true;
+    return true;
+}
+
+void MotionDetection::stopRecording() {
+    recordingRequested = false;
+}
+
+bool MotionDetection::nextFrame(ofPixels& gray, cv::Mat& colorMat, uint64_t& timeUs) {
+    if (replay.getWidth() > 0) {
+        // Replay: frames are released at the pace they were recorded, and the recording loops
+        const uint8_t* data = nullptr;
+        if (!replay.read(data, timeUs)) {
+            if (!replay.rewind() || !replay.read(data, timeUs)) return false;
+        }
+        if (replay.getFrameIndex() == 1) {
+            replayStartUs = timeUs;
+            replayClock = std::chrono::steady_clock::now();
+        }
+        std::this_thread::sleep_until(replayClock + std::chrono::microseconds(timeUs - replayStartUs));
+
+        int width = replay.getWidth();
+        int height = replay.getHeight();
+        if (gray.getWidth() != width || gray.getHeight() != height) {
+            gray.allocate(width, height, OF_PIXELS_GRAY);
+        }
+        std::copy(data, data + size_t(width) * height, gray.getData());
+        cv::Mat grayMat(height, width, CV_8UC1, gray.getData());
+        cv::cvtColor(grayMat, colorMat, cv::COLOR_GRAY2RGB); // for the debug preview
+        return true;
+    }
+
+    cam.update();
+    if (!cam.isFrameNew()) return false;
+
+    const ofPixels& pixels = cam.getPixels();
+    int width = pixels.getWidth();
+    int height = pixels.getHeight();
+    if (gray.getWidth() != width || gray.getHeight() != height) {
+        gray.allocate(width, height, OF_PIXELS_GRAY);
+    }
+    colorMat = cv::Mat(height, width, CV_8UC3, const_cast<unsigned char*>(pixels.getData()));
+    cv::Mat grayMat(height, width, CV_8UC1, gray.getData());
+    cv::cvtColor(colorMat, grayMat, cv::COLOR_RGB2GRAY);
+    timeUs = ofGetElapsedTimeMicros();
+    return true;
+}
+
+void MotionDetection::updateRecorder(const ofPixels& gray, uint64_t timeUs) {
+    if (recordingRequested && !recorder.isOpen()) {
+        std::string path;
+        {
+            std::lock_guard<std::mutex> lock(recordingMutex);
+            path = recordingPath;
+        }
+        if (!recorder.open(path, gray.getWidth(), gray.getHeight())) {
+            ofLogError() << "Cannot record the camera to " << path;
+            recordingRequested = false;
+            return;
+        }
+        ofLogNotice() << "Recording the camera to " << path;
+    }
+    else if (!recordingRequested && recorder.isOpen()) {
+        recorder.close();
+        ofLogNotice() << "Recorded " << recorder.getFrameCount() << " frames, " << recorder.getWrittenBytes() / 1024
+            << " KB (" << recorder.getRawBytes() / 1024 << " KB raw)";
+    }
+
+    if (recorder.isOpen() && !recorder.write(gray.getData(), timeUs)) {
+        ofLogError() << "Recording stopped, the camera frames could not be written";
+        recorder.close();
+        recordingRequested = false;
+    }
+    recording = recorder.isOpen();
+}
+
+void MotionDetection::captureLoop() {
+    GestureDetector detector(gestureOptions);
+    ofPixels gray;
+    cv::Mat colorMat;
+    DebugPreview preview; // filled here, swapped with the render thread
+    uint64_t frameIndex = 0;
+    uint64_t timeUs = 0;
+
+    while (capturing) {
+        if (!nextFrame(gray, colorMat, timeUs)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        if (replay.getFrameIndex() == 1) {
+            detector.reset(); // the recording looped, its first frame does not follow the last one
+        }
+        updateRecorder(gray, timeUs);
+
+        int width = gray.getWidth();
+        int height = gray.getHeight();
+        GestureDetector::Detection detection = detector.process(gray.getData(), width, height);
+        detectorCooldown = detector.getCooldown();
+        if (detection.gesture != GestureDetector::NONE) {
+            gestureEvents.tryPush(GestureEvent{ detection.gesture, frameIndex, ofGetElapsedTimeMillis() });
+        }
+
+        // Small copies for the debug view, skipped while the render thread has not taken the previous ones
+        if (preview.color.getWidth() != previewWidth) {
+            preview.color.allocate(previewWidth, previewHeight, OF_PIXELS_RGB);
+            preview.diff.allocate(previewWidth, previewHeight, OF_PIXELS_GRAY);
+        }
+        if (detector.getDiff().isAllocated()) {
+            cv::Mat diffMat(height, width, CV_8UC1, const_cast<unsigned char*>(detector.getDiff().getData()));
+            cv::Mat colorPreviewMat(previewHeight, previewWidth, CV_8UC3, preview.color.getData());
+            cv::Mat diffPreviewMat(previewHeight, previewWidth, CV_8UC1, preview.diff.getData());
+            cv::resize(colorMat, colorPreviewMat, colorPreviewMat.size(), 0, 0, cv::INTER_NEAREST);
+            cv::resize(diffMat, diffPreviewMat, diffPreviewMat.size(), 0, 0, cv::INTER_NEAREST);
+            debugPreviews.tryPush(preview);
+        }
+        frameIndex++;
+    }
 
-void MotionDetection::UpdateMotionDetection(std::vector<std::vector<MediaElement*>>& mediaMatrix,
+    recordingRequested = false;
+    updateRecorder(gray, timeUs); // closes an unfinished recording
+}
+
+void MotionDetection::UpdateMotionDetection(const std::vector<std::vector<MediaId>>& mediaMatrix,
     int& selectedRow,
     int& selectedCol,
     int& currentMedia,
     std::vector<MediaElement>& medias) {
-    cam.update();
     uint64_t now = ofGetElapsedTimeMillis();
 
-    if (cam.isFrameNew()) {
-        colorImg.setFromPixels(cam.getPixels());
-        grayImg = colorImg;
-        detectGesture(mediaMatrix, selectedRow, selectedCol, currentMedia, medias);
-        prevGrayImg = grayImg;
+    // Swipes detected by the camera thread since the last frame
+    GestureEvent event;
+    while (gestureEvents.tryPop(event)) {
+        if (event.gesture == GestureDetector::SWIPE_LEFT) {
+            navigateLeft(mediaMatrix, selectedRow, selectedCol, currentMedia, medias);
+        }
+        else if (event.gesture == GestureDetector::SWIPE_RIGHT) {
+            navigateRight(mediaMatrix, selectedRow, selectedCol, currentMedia, medias);
+        }
+    }
+
+    // Only the latest preview is shown
+    bool newPreview = false;
+    while (debugPreviews.tryPop(uiPreview)) {
+        newPreview = true;
+    }
+    if (newPreview) {
+        colorPreview.setFromPixels(uiPreview.color);
+        diffPreview.setFromPixels(uiPreview.diff);
     }
 
     // Set systemStatus based on cooldown and idle rotation logic
-    if (movementCooldown > 0) {
+    if (movementCooldown > 0 || detectorCooldown > 0) {
         systemStatus = "Cooldown...";
-        movementCooldown--;
+        if (movementCooldown > 0) movementCooldown--;
     }
     else {
+        gestureStatus = "None";
         if (now - lastInteractionTime > autoSwipeDelayMs) {
             if (now - lastAutoSwipeTime > autoSwipeIntervalMs) {
                 movementCooldown = 30;
@@ -53,23 +220,20 @@ void MotionDetection::UpdateMotionDetection(std::vector<std::vector<MediaElement
     }
 }
 
-void MotionDetection::selectCurrentMedia(MediaElement* selectedPtr, int& currentMedia, std::vector<MediaElement>& medias) {
-    auto it = std::find_if(medias.begin(), medias.end(),
-        [selectedPtr](MediaElement& m) { return &m == selectedPtr; });
-
-    if (it != medias.end()) {
-        currentMedia = std::distance(medias.begin(), it);
+void MotionDetection::selectCurrentMedia(MediaId selectedId, int& currentMedia, std::vector<MediaElement>& medias) {
+    if (selectedId < medias.size()) {
+        currentMedia = selectedId;
     }
 }
 
 void MotionDetection::navigateLeft(
-    std::vector<std::vector<MediaElement*>>& mediaMatrix,
+    const std::vector<std::vector<MediaId>>& mediaMatrix,
     int& selectedRow,
     int& selectedCol,
     int& currentMedia,
     std::vector<MediaElement>& medias)
 {
-    if (mediaMatrix.empty() || mediaMatrix[selectedRow].empty()) return;
+    if (selectedRow >= (int)mediaMatrix.size() || mediaMatrix[selectedRow].empty()) return;
 
     if (selectedCol > 0) {
         selectedCol--;
@@ -78,22 +242,20 @@ void MotionDetection::navigateLeft(
         selectedCol = mediaMatrix[selectedRow].size() - 1;
     }
 
-    MediaElement* selectedPtr = mediaMatrix[selectedRow][selectedCol];
-    selectCurrentMedia(selectedPtr, currentMedia, medias);
+    selectCurrentMedia(mediaMatrix[selectedRow][selectedCol], currentMedia, medias);
 
     gestureStatus = "Swipe Left";
-    movementCooldown = 60;
     lastInteractionTime = ofGetElapsedTimeMillis();
 }
 
 void MotionDetection::navigateRight(
-    std::vector<std::vector<MediaElement*>>& mediaMatrix,
+    const std::vector<std::vector<MediaId>>& mediaMatrix,
     int& selectedRow,
     int& selectedCol,
     int& currentMedia,
     std::vector<MediaElement>& medias)
 {
-    if (mediaMatrix.empty() || mediaMatrix[selectedRow].empty()) return;
+    if (selectedRow >= (int)mediaMatrix.size() || mediaMatrix[selectedRow].empty()) return;
 
     if (selectedCol + 1 < mediaMatrix[selectedRow].size()) {
         selectedCol++;
@@ -102,66 +264,28 @@ void MotionDetection::navigateRight(
         selectedCol = 0;
     }
 
-    MediaElement* selectedPtr = mediaMatrix[selectedRow][selectedCol];
-    selectCurrentMedia(selectedPtr, currentMedia, medias);
+    selectCurrentMedia(mediaMatrix[selectedRow][selectedCol], currentMedia, medias);
 
     gestureStatus = "Swipe Right";
-    movementCooldown = 60;
     lastInteractionTime = ofGetElapsedTimeMillis();
 }
 
-void MotionDetection::detectGesture(
-    std::vector<std::vector<MediaElement*>>& mediaMatrix,
-    int& selectedRow,
-    int& selectedCol,
-    int& currentMedia,
-    std::vector<MediaElement>& medias)
-{
-    diffImg.absDiff(grayImg, prevGrayImg);
-    diffImg.threshold(30);
-
-    int leftMovement = 0;
-    int rightMovement = 0;
-    int midX = camWidth / 2;
-    unsigned char* pixels = diffImg.getPixels().getData();
-
-    int yMin = camHeight * 0.3;
-    int yMax = camHeight * 0.7;
-
-    for (int y = yMin; y < yMax; y++) {
-        for (int x = 0; x < camWidth; x++) {
-            int index = y * camWidth + x;
-            if (pixels[index] > 0) {
-                if (x < midX) leftMovement++;
-                else rightMovement++;
-            }
-        }
-    }
-
-    const int threshold = 1000;
-
-    if (movementCooldown == 0) {
-        if (leftMovement > threshold && rightMovement < threshold / 2) {
-            navigateLeft(mediaMatrix, selectedRow, selectedCol, currentMedia, medias);
-        }
-        else if (rightMovement > threshold && leftMovement < threshold / 2) {
-            navigateRight(mediaMatrix, selectedRow, selectedCol, currentMedia, medias);
-        }
-        else {
-            gestureStatus = "None";
-        }
-    }
-}
-
 void MotionDetection::DrawDebugCameras() {
     // Debug camera views
-    colorImg.draw(10, 10, 160, 120);
-    diffImg.draw(180, 10, 160, 120);
+    if (colorPreview.isAllocated()) {
+        colorPreview.draw(10, 10, 160, 120);
+        diffPreview.draw(180, 10, 160, 120);
+    }
 
     ofSetColor(255);
     ofDrawBitmapString("Gesture: " + gestureStatus, 10, 140);
     ofDrawBitmapString("Status: " + systemStatus, 10, 160);
 
     // Optional: visualize movement counts
-    ofDrawBitmapString("Cooldown: " + ofToString(movementCooldown), 10, 180);
+    ofDrawBitmapString("Cooldown: " + ofToString(std::max<int>(movementCooldown, detectorCooldown)), 10, 180);
+    if (recording) {
+        ofSetColor(255, 0, 0);
+        ofDrawBitmapString("REC", 10, 200);
+        ofSetColor(255);
+    }
 }
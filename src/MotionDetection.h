@@ -1,35 +1,63 @@
 #pragma once
 
 #include "ofMain.h"
-#include "ofxOpenCv.h"
 #include "MediaElement.h"
+#include "FeatureStore.h"
+#include "GestureDetector.h"
+#include "SpscRing.h"
+#include "FrameRecording.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace cv { class Mat; }
 
 class MotionDetection {
+	// MotionDetection navigates the gallery with hand swipes in front of the camera.
+	// Capture, gray conversion and gesture detection run on a camera thread, so the render thread never waits
+	// for the camera. The camera thread posts the swipes it detects and small debug previews to the render
+	// thread through lock-free SpscRings; UpdateMotionDetection() consumes them once per frame.
+	// The camera frames can be recorded to a file (startRecording), and a recording can be played instead of the
+	// camera (replayPath), so that a gesture session can be reproduced without a camera, see tools/gesture_replay.
 
 public:
 	MotionDetection() {};
+	~MotionDetection();
 	void SetupMotionDetection();
 	void UpdateMotionDetection(
-		std::vector<std::vector<MediaElement*>>& mediaMatrix,
+		const std::vector<std::vector<MediaId>>& mediaMatrix,
 		int& selectedRow,
 		int& selectedCol,
 		int& currentMedia,
 		std::vector<MediaElement>& medias);
 	void DrawDebugCameras();
+	void stop(); // joins the camera thread and closes the camera
+	bool startRecording(const std::string& path); // records the next camera frames, see FrameRecording.h
+	void stopRecording();
+	bool isRecording() const { return recording; };
 
-	void navigateLeft(std::vector<std::vector<MediaElement*>>& mediaMatrix, int& selectedRow, int& selectedCol, int& currentMedia, std::vector<MediaElement>& medias);
-	void navigateRight(std::vector<std::vector<MediaElement*>>& mediaMatrix, int& selectedRow, int& selectedCol, int& currentMedia, std::vector<MediaElement>& medias);
-	void detectGesture(std::vector<std::vector<MediaElement*>>& mediaMatrix, int& selectedRow, int& selectedCol, int& currentMedia, std::vector<MediaElement>& medias);
-	void selectCurrentMedia(MediaElement* selectedPtr, int& currentMedia, std::vector<MediaElement>& medias);
+	void navigateLeft(const std::vector<std::vector<MediaId>>& mediaMatrix, int& selectedRow, int& selectedCol, int& currentMedia, std::vector<MediaElement>& medias);
+	void navigateRight(const std::vector<std::vector<MediaId>>& mediaMatrix, int& selectedRow, int& selectedCol, int& currentMedia, std::vector<MediaElement>& medias);
+	void selectCurrentMedia(MediaId selectedId, int& currentMedia, std::vector<MediaElement>& medias);
 	void keyPressed(int key);
 	void mousePressed(int x, int y, int button);
 	void mouseMoved(int x, int y);
 
+	// Posted by the camera thread
+	struct GestureEvent {
+		GestureDetector::Gesture gesture = GestureDetector::NONE;
+		uint64_t frameIndex = 0; // camera frame the swipe was detected on
+		uint64_t timeMs = 0;
+	};
+	struct DebugPreview {
+		ofPixels color; // previewWidth x previewHeight
+		ofPixels diff;
+	};
+
 	ofVideoGrabber cam;
-	ofxCvColorImage colorImg;
-	ofxCvGrayscaleImage grayImg;
-	ofxCvGrayscaleImage prevGrayImg;
-	ofxCvGrayscaleImage diffImg;
+	ofImage colorPreview; // latest debug previews, drawn by DrawDebugCameras
+	ofImage diffPreview;
 	ofSoundPlayer swipeSound;
 
 	//ofEasyCam easyCam; // allows mouse control and camera movement 3D
@@ -46,6 +74,32 @@ public:
 
 	int camWidth = 640;
 	int camHeight = 480;
+	int previewWidth = 160;
+	int previewHeight = 120;
+
+	int movementCooldown = 0; // frames of the idle status, the swipe cooldown is counted by the GestureDetector
+	GestureDetector::Options gestureOptions; // read by the camera thread when it starts
+	std::string replayPath; // recording played instead of the camera, relative to bin/data, empty = camera
+
+private:
+	void captureLoop(); // camera thread
+	bool nextFrame(ofPixels& gray, cv::Mat& colorMat, uint64_t& timeUs); // from the camera or the replay
+	void updateRecorder(const ofPixels& gray, uint64_t timeUs); // opens, feeds and closes the recorder
+
+	std::thread captureThread;
+	std::atomic<bool> capturing{ false };
+	std::atomic<int> detectorCooldown{ 0 }; // cooldown of the GestureDetector, for the status
+	SpscRing<GestureEvent> gestureEvents{ 16 };
+	SpscRing<DebugPreview> debugPreviews{ 2 };
+	DebugPreview uiPreview; // buffers swapped with the camera thread through debugPreviews
 
-	int movementCooldown = 0;
-};
\ No newline at end of file
+	// Recording: requested by the render thread, the recorder itself is only touched by the camera thread
+	std::mutex recordingMutex;
+	std::string recordingPath;
+	std::atomic<bool> recordingRequested{ false };
+	std::atomic<bool> recording{ false };
+	FrameRecorder recorder;
+	FrameReplay replay;
+	uint64_t replayStartUs = 0; // time of the first replayed frame, in the recording clock
+	std::chrono::steady_clock::time_point replayClock;
+};
@@ -0,0 +1,60 @@
+#include "OverlayCache.h"
+
+bool OverlayCache::requireLuminanceMap(MediaId id, std::vector<MediaElement>& medias) {
+    MediaElement& media = medias[id];
+    if (!media.image.isAllocated()) return false;
+
+    if (!media.luminanceMap.isAllocated()) {
+        if (computedThisFrame >= maxComputePerFrame) return false; // computed in a later frame
+        computedThisFrame++;
+        featureHandler.computeColorFeatures(media, FeatureHandler::LUMINANCE_MAP_OUTPUT);
+        media.uploadTextures();
+    }
+    touch(id, medias);
+    return true;
+}
+
+bool OverlayCache::requireEdgeMap(MediaId id, std::vector<MediaElement>& medias, FeatureStore& store) {
+    if (store.hasEdgeHistogram[id]) return true;
+    MediaElement& media = medias[id];
+    if (!media.image.isAllocated() || computedThisFrame >= maxComputePerFrame) return false;
+
+    computedThisFrame++;
+    featureHandler.computeEdgeMap(media);
+    store.setEdgeHistogram(id, media.features.edgeHist);
+    media.features.edgeHist = std::vector<float>(); // the store holds it now
+    return store.hasEdgeHistogram[id];
+}
+
+void OverlayCache::touch(MediaId id, std::vector<MediaElement>& medias) {
+    auto it = positions.find(id);
+    if (it != positions.end()) {
+        recent.splice(recent.begin(), recent, it->second); // already cached, move to the front
+        return;
+    }
+
+    recent.push_front(id);
+    positions[id] = recent.begin();
+    while (recent.size() > std::max<size_t>(capacity, 1)) {
+        MediaId oldest = recent.back();
+        medias[oldest].luminanceMap.clear();
+        positions.erase(oldest);
+        recent.pop_back();
+    }
+}
+
+void OverlayCache::clear(std::vector<MediaElement>& medias) {
+    for (MediaId id : recent) {
+        medias[id].luminanceMap.clear();
+    }
+    recent.clear();
+    positions.clear();
+}
+
+void OverlayCache::forget(MediaId id, std::vector<MediaElement>& medias) {
+    medias[id].luminanceMap.clear();
+    auto it = positions.find(id);
+    if (it == positions.end()) return;
+    recent.erase(it->second);
+    positions.erase(it);
+}
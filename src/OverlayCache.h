@@ -0,0 +1,45 @@
+#pragma once
+#include "ofMain.h"
+#include "MediaElement.h"
+#include "FeatureHandler.h"
+#include "FeatureStore.h"
+#include <list>
+#include <unordered_map>
+
+class OverlayCache {
+	// The OverlayCache computes the overlays of the gallery tiles ('l' luminance map, 'e' edge map) the first time
+	// a tile is drawn with the overlay on, instead of computing them at ingest for every element.
+	// Luminance maps are full size images: only the `capacity` most recently drawn ones are kept, the others are freed.
+	// Edge histograms are small and are also used by the similarity index and the edge sort, once computed they stay.
+	// At most maxComputePerFrame overlays are computed per frame so that turning an overlay on never stalls the UI,
+	// the remaining tiles get theirs in the next frames.
+	// Main thread only: the luminance map texture is uploaded as soon as it is computed.
+
+public:
+
+	// CONSTRUCTORS
+
+	OverlayCache(size_t capacity = 128, int maxComputePerFrame = 8) : capacity(capacity), maxComputePerFrame(maxComputePerFrame) {};
+
+	// OVERLAY METHODS
+
+	void beginFrame() { computedThisFrame = 0; }; // call once per frame, before the require methods
+	bool requireLuminanceMap(MediaId id, std::vector<MediaElement>& medias); // returns true if medias[id].luminanceMap is ready to draw
+	bool requireEdgeMap(MediaId id, std::vector<MediaElement>& medias, FeatureStore& store); // returns true if the edge histogram of id is in the store
+	void clear(std::vector<MediaElement>& medias); // frees every cached luminance map
+	void forget(MediaId id, std::vector<MediaElement>& medias); // frees the luminance map of a media whose file changed or was deleted
+
+	// ATTRIBUTES
+
+	size_t size() const { return recent.size(); };
+	size_t capacity;
+	int maxComputePerFrame;
+
+private:
+	void touch(MediaId id, std::vector<MediaElement>& medias); // marks the luminance map of id as the most recently used, evicting the oldest
+
+	FeatureHandler featureHandler;
+	std::list<MediaId> recent; // medias holding a luminance map, most recently drawn first
+	std::unordered_map<MediaId, std::list<MediaId>::iterator> positions; // position of every media in recent
+	int computedThisFrame = 0;
+};
@@ -0,0 +1,417 @@
+#include "PixelKernels.h"
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define PIXEL_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define PIXEL_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang only accept AVX2 intrinsics in functions compiled for AVX2,
+// MSVC accepts them anywhere and relies on the runtime check alone
+#if defined(PIXEL_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PIXEL_KERNELS_AVX2 __attribute__((target("avx2")))
+#else
+#define PIXEL_KERNELS_AVX2
+#endif
+
+static const float redWeight = 0.2126f;
+static const float greenWeight = 0.7152f;
+static const float blueWeight = 0.0722f;
+
+// -------------------------------------------------------------------------------------------------------------------------
+// SCALAR KERNELS
+// -------------------------------------------------------------------------------------------------------------------------
+
+static PixelKernels::ChannelSums channelSumsScalar(const uint8_t* rgb, size_t numPixels) {
+    PixelKernels::ChannelSums sums;
+    for (size_t i = 0; i < numPixels; i++, rgb += 3) {
+        sums.r += rgb[0];
+        sums.g += rgb[1];
+        sums.b += rgb[2];
+    }
+    return sums;
+}
+
+static void histogramScalar(const uint8_t* rgb, size_t numPixels, uint32_t* red, uint32_t* green, uint32_t* blue) {
+    // Four sub-histograms per channel: consecutive pixels of the same color would otherwise
+    // increment the same counter back to back and stall on the store-to-load dependency
+    uint32_t counts[4][3][256];
+    std::memset(counts, 0, sizeof(counts));
+
+    size_t i = 0;
+    for (; i + 4 <= numPixels; i += 4, rgb += 12) {
+        counts[0][0][rgb[0]]++; counts[0][1][rgb[1]]++; counts[0][2][rgb[2]]++;
+        counts[1][0][rgb[3]]++; counts[1][1][rgb[4]]++; counts[1][2][rgb[5]]++;
+        counts[2][0][rgb[6]]++; counts[2][1][rgb[7]]++; counts[2][2][rgb[8]]++;
+        counts[3][0][rgb[9]]++; counts[3][1][rgb[10]]++; counts[3][2][rgb[11]]++;
+    }
+    for (; i < numPixels; i++, rgb += 3) {
+        counts[0][0][rgb[0]]++; counts[0][1][rgb[1]]++; counts[0][2][rgb[2]]++;
+    }
+
+    for (int bin = 0; bin < 256; bin++) {
+        red[bin] += counts[0][0][bin] + counts[1][0][bin] + counts[2][0][bin] + counts[3][0][bin];
+        green[bin] += counts[0][1][bin] + counts[1][1][bin] + counts[2][1][bin] + counts[3][1][bin];
+        blue[bin] += counts[0][2][bin] + counts[1][2][bin] + counts[2][2][bin] + counts[3][2][bin];
+    }
+}
+
+static void luminanceScalar(const uint8_t* rgb, size_t numPixels, float* out) {
+    for (size_t i = 0; i < numPixels; i++, rgb += 3) {
+        out[i] = redWeight * rgb[0] + greenWeight * rgb[1] + blueWeight * rgb[2];
+    }
+}
+
+static float frameDifferenceScalar(const uint8_t* a, const uint8_t* b, size_t numPixels) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < numPixels; i++, a += 3, b += 3) {
+        float dr = float(a[0]) - float(b[0]);
+        float dg = float(a[1]) - float(b[1]);
+        float db = float(a[2]) - float(b[2]);
+        sum += std::sqrt(dr * dr + dg * dg + db * db);
+    }
+    return sum;
+}
+
+// Folds per-byte-offset totals of a block of interleaved RGB into channel sums (the block size is a multiple of 3)
+static void addBlockTotals(PixelKernels::ChannelSums& sums, const uint64_t* totals, int blockBytes) {
+    for (int j = 0; j < blockBytes; j += 3) {
+        sums.r += totals[j];
+        sums.g += totals[j + 1];
+        sums.b += totals[j + 2];
+    }
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// SSE2 KERNELS
+// -------------------------------------------------------------------------------------------------------------------------
+
+#ifdef PIXEL_KERNELS_X86
+
+static PixelKernels::ChannelSums channelSumsSSE2(const uint8_t* rgb, size_t numPixels) {
+    // 16 pixels (48 bytes) per iteration, every 16-bit lane accumulates one byte offset of the block.
+    // The lanes are flushed before they can overflow (256 * 255 < 65536)
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t totals[48] = { 0 };
+    size_t numBlocks = numPixels / 16;
+
+    while (numBlocks > 0) {
+        size_t batch = numBlocks < 256 ? numBlocks : 256;
+        __m128i acc[6] = { zero, zero, zero, zero, zero, zero };
+        for (size_t i = 0; i < batch; i++, rgb += 48) {
+            for (int k = 0; k < 3; k++) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + 16 * k));
+                acc[2 * k] = _mm_add_epi16(acc[2 * k], _mm_unpacklo_epi8(v, zero));
+                acc[2 * k + 1] = _mm_add_epi16(acc[2 * k + 1], _mm_unpackhi_epi8(v, zero));
+            }
+        }
+        uint16_t lanes[48];
+        for (int k = 0; k < 6; k++) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 8 * k), acc[k]);
+        }
+        for (int j = 0; j < 48; j++) {
+            totals[j] += lanes[j];
+        }
+        numBlocks -= batch;
+    }
+
+    PixelKernels::ChannelSums sums = channelSumsScalar(rgb, numPixels % 16);
+    addBlockTotals(sums, totals, 48);
+    return sums;
+}
+
+// Loads 4 RGB pixels (12 bytes, 16 are read) as three float vectors [r0 g0 b0 r1] [g1 b1 r2 g2] [b2 r3 g3 b3]
+static inline void loadFourPixelsSSE2(const uint8_t* rgb, __m128& p0, __m128& p1, __m128& p2) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb));
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    p0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+    p1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+    p2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+}
+
+// Regroups [r0 g0 b0 r1] [g1 b1 r2 g2] [b2 r3 g3 b3] into [r0 r1 r2 r3] [g0 g1 g2 g3] [b0 b1 b2 b3]
+static inline void deinterleaveSSE2(__m128 a, __m128 b, __m128 c, __m128& r, __m128& g, __m128& bl) {
+    __m128 bc = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2)); // b2 b3 c0 c1
+    r = _mm_shuffle_ps(a, bc, _MM_SHUFFLE(3, 0, 3, 0)); // a0 a3 b2 c1
+    g = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)); // a1 b0 b3 c2
+    bl = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)); // a2 b1 c0 c3
+}
+
+static void luminanceSSE2(const uint8_t* rgb, size_t numPixels, float* out) {
+    const __m128 wr = _mm_set1_ps(redWeight);
+    const __m128 wg = _mm_set1_ps(greenWeight);
+    const __m128 wb = _mm_set1_ps(blueWeight);
+    size_t i = 0;
+    // Each step reads 16 bytes for 4 pixels, stop while 6 pixels (18 bytes) are left to stay in bounds
+    for (; i + 6 <= numPixels; i += 4, rgb += 12) {
+        __m128 p0, p1, p2, r, g, b;
+        loadFourPixelsSSE2(rgb, p0, p1, p2);
+        deinterleaveSSE2(p0, p1, p2, r, g, b);
+        __m128 lum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, wr), _mm_mul_ps(g, wg)), _mm_mul_ps(b, wb));
+        _mm_storeu_ps(out + i, lum);
+    }
+    luminanceScalar(rgb, numPixels - i, out + i);
+}
+
+static float frameDifferenceSSE2(const uint8_t* a, const uint8_t* b, size_t numPixels) {
+    __m128 acc = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 6 <= numPixels; i += 4, a += 12, b += 12) {
+        __m128 a0, a1, a2, b0, b1, b2, ar, ag, ab, br, bg, bb;
+        loadFourPixelsSSE2(a, a0, a1, a2);
+        loadFourPixelsSSE2(b, b0, b1, b2);
+        deinterleaveSSE2(a0, a1, a2, ar, ag, ab);
+        deinterleaveSSE2(b0, b1, b2, br, bg, bb);
+        __m128 dr = _mm_sub_ps(ar, br);
+        __m128 dg = _mm_sub_ps(ag, bg);
+        __m128 db = _mm_sub_ps(ab, bb);
+        __m128 squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+        acc = _mm_add_ps(acc, _mm_sqrt_ps(squared));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + frameDifferenceScalar(a, b, numPixels - i);
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// AVX2 KERNELS
+// -------------------------------------------------------------------------------------------------------------------------
+
+PIXEL_KERNELS_AVX2 static PixelKernels::ChannelSums channelSumsAVX2(const uint8_t* rgb, size_t numPixels) {
+    // 32 pixels (96 bytes) per iteration, same lane-per-byte-offset scheme as the SSE2 version
+    uint64_t totals[96] = { 0 };
+    size_t numBlocks = numPixels / 32;
+
+    while (numBlocks > 0) {
+        size_t batch = numBlocks < 256 ? numBlocks : 256;
+        __m256i acc[6];
+        for (int k = 0; k < 6; k++) acc[k] = _mm256_setzero_si256();
+        for (size_t i = 0; i < batch; i++, rgb += 96) {
+            for (int k = 0; k < 6; k++) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + 16 * k));
+                acc[k] = _mm256_add_epi16(acc[k], _mm256_cvtepu8_epi16(v));
+            }
+        }
+        uint16_t lanes[96];
+        for (int k = 0; k < 6; k++) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes + 16 * k), acc[k]);
+        }
+        for (int j = 0; j < 96; j++) {
+            totals[j] += lanes[j];
+        }
+        numBlocks -= batch;
+    }
+
+    PixelKernels::ChannelSums sums = channelSumsScalar(rgb, numPixels % 32);
+    addBlockTotals(sums, totals, 96);
+    return sums;
+}
+
+// Gathers the channels of 8 RGB pixels (24 bytes) as three float vectors
+PIXEL_KERNELS_AVX2 static inline void loadEightPixelsAVX2(const uint8_t* rgb, __m256& r, __m256& g, __m256& b) {
+    // lo holds bytes 0-15 and hi bytes 8-23, each channel is shuffled out of both and merged
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb));
+    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + 8));
+    const __m128i rLo = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i rHi = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i gLo = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i gHi = _mm_setr_epi8(-1, -1, -1, -1, -1, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i bLo = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i bHi = _mm_setr_epi8(-1, -1, -1, -1, -1, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m128i r8 = _mm_or_si128(_mm_shuffle_epi8(lo, rLo), _mm_shuffle_epi8(hi, rHi));
+    __m128i g8 = _mm_or_si128(_mm_shuffle_epi8(lo, gLo), _mm_shuffle_epi8(hi, gHi));
+    __m128i b8 = _mm_or_si128(_mm_shuffle_epi8(lo, bLo), _mm_shuffle_epi8(hi, bHi));
+    r = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(r8));
+    g = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(g8));
+    b = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(b8));
+}
+
+PIXEL_KERNELS_AVX2 static void luminanceAVX2(const uint8_t* rgb, size_t numPixels, float* out) {
+    const __m256 wr = _mm256_set1_ps(redWeight);
+    const __m256 wg = _mm256_set1_ps(greenWeight);
+    const __m256 wb = _mm256_set1_ps(blueWeight);
+    size_t i = 0;
+    for (; i + 8 <= numPixels; i += 8, rgb += 24) {
+        __m256 r, g, b;
+        loadEightPixelsAVX2(rgb, r, g, b);
+        // Separate multiply and add (no FMA) to round exactly like the scalar kernel
+        __m256 lum = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, wr), _mm256_mul_ps(g, wg)), _mm256_mul_ps(b, wb));
+        _mm256_storeu_ps(out + i, lum);
+    }
+    luminanceScalar(rgb, numPixels - i, out + i);
+}
+
+PIXEL_KERNELS_AVX2 static float frameDifferenceAVX2(const uint8_t* a, const uint8_t* b, size_t numPixels) {
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= numPixels; i += 8, a += 24, b += 24) {
+        __m256 ar, ag, ab, br, bg, bb;
+        loadEightPixelsAVX2(a, ar, ag, ab);
+        loadEightPixelsAVX2(b, br, bg, bb);
+        __m256 dr = _mm256_sub_ps(ar, br);
+        __m256 dg = _mm256_sub_ps(ag, bg);
+        __m256 db = _mm256_sub_ps(ab, bb);
+        __m256 squared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dr, dr), _mm256_mul_ps(dg, dg)), _mm256_mul_ps(db, db));
+        acc = _mm256_add_ps(acc, _mm256_sqrt_ps(squared));
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, acc);
+    float sum = 0.0f;
+    for (int k = 0; k < 8; k++) sum += lanes[k];
+    return sum + frameDifferenceScalar(a, b, numPixels - i);
+}
+
+static bool cpuSupportsAVX2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osUsesXSave = (info[2] & (1 << 27)) != 0;
+    bool hasAVX = (info[2] & (1 << 28)) != 0;
+    if (!osUsesXSave || !hasAVX) return false;
+    if ((_xgetbv(0) & 6) != 6) return false; // the OS must save the YMM registers
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // PIXEL_KERNELS_X86
+
+// -------------------------------------------------------------------------------------------------------------------------
+// NEON KERNELS
+// -------------------------------------------------------------------------------------------------------------------------
+
+#ifdef PIXEL_KERNELS_NEON
+
+static PixelKernels::ChannelSums channelSumsNEON(const uint8_t* rgb, size_t numPixels) {
+    // vld3q deinterleaves 16 pixels, pairwise accumulation into 16-bit lanes is flushed every 128 blocks
+    PixelKernels::ChannelSums sums;
+    size_t numBlocks = numPixels / 16;
+
+    while (numBlocks > 0) {
+        size_t batch = numBlocks < 128 ? numBlocks : 128;
+        uint16x8_t r = vdupq_n_u16(0), g = vdupq_n_u16(0), b = vdupq_n_u16(0);
+        for (size_t i = 0; i < batch; i++, rgb += 48) {
+            uint8x16x3_t v = vld3q_u8(rgb);
+            r = vpadalq_u8(r, v.val[0]);
+            g = vpadalq_u8(g, v.val[1]);
+            b = vpadalq_u8(b, v.val[2]);
+        }
+        sums.r += vaddlvq_u16(r);
+        sums.g += vaddlvq_u16(g);
+        sums.b += vaddlvq_u16(b);
+        numBlocks -= batch;
+    }
+
+    PixelKernels::ChannelSums tail = channelSumsScalar(rgb, numPixels % 16);
+    sums.r += tail.r;
+    sums.g += tail.g;
+    sums.b += tail.b;
+    return sums;
+}
+
+static inline float32x4_t lowToFloat(uint16x8_t v) { return vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))); }
+static inline float32x4_t highToFloat(uint16x8_t v) { return vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))); }
+
+static void luminanceNEON(const uint8_t* rgb, size_t numPixels, float* out) {
+    const float32x4_t wr = vdupq_n_f32(redWeight);
+    const float32x4_t wg = vdupq_n_f32(greenWeight);
+    const float32x4_t wb = vdupq_n_f32(blueWeight);
+    size_t i = 0;
+    for (; i + 8 <= numPixels; i += 8, rgb += 24) {
+        uint8x8x3_t v = vld3_u8(rgb);
+        uint16x8_t r = vmovl_u8(v.val[0]), g = vmovl_u8(v.val[1]), b = vmovl_u8(v.val[2]);
+        // Separate multiply and add (no vmla/vfma) to round exactly like the scalar kernel
+        float32x4_t lumLow = vaddq_f32(vaddq_f32(vmulq_f32(lowToFloat(r), wr), vmulq_f32(lowToFloat(g), wg)), vmulq_f32(lowToFloat(b), wb));
+        float32x4_t lumHigh = vaddq_f32(vaddq_f32(vmulq_f32(highToFloat(r), wr), vmulq_f32(highToFloat(g), wg)), vmulq_f32(highToFloat(b), wb));
+        vst1q_f32(out + i, lumLow);
+        vst1q_f32(out + i + 4, lumHigh);
+    }
+    luminanceScalar(rgb, numPixels - i, out + i);
+}
+
+static float frameDifferenceNEON(const uint8_t* a, const uint8_t* b, size_t numPixels) {
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= numPixels; i += 8, a += 24, b += 24) {
+        uint8x8x3_t va = vld3_u8(a);
+        uint8x8x3_t vb = vld3_u8(b);
+        // |a - b| is exact in 8 bits, its square fits in 16 bits
+        uint16x8_t dr = vmull_u8(vabd_u8(va.val[0], vb.val[0]), vabd_u8(va.val[0], vb.val[0]));
+        uint16x8_t dg = vmull_u8(vabd_u8(va.val[1], vb.val[1]), vabd_u8(va.val[1], vb.val[1]));
+        uint16x8_t db = vmull_u8(vabd_u8(va.val[2], vb.val[2]), vabd_u8(va.val[2], vb.val[2]));
+        float32x4_t squaredLow = vaddq_f32(vaddq_f32(lowToFloat(dr), lowToFloat(dg)), lowToFloat(db));
+        float32x4_t squaredHigh = vaddq_f32(vaddq_f32(highToFloat(dr), highToFloat(dg)), highToFloat(db));
+        acc = vaddq_f32(acc, vsqrtq_f32(squaredLow));
+        acc = vaddq_f32(acc, vsqrtq_f32(squaredHigh));
+    }
+    return vaddvq_f32(acc) + frameDifferenceScalar(a, b, numPixels - i);
+}
+
+#endif // PIXEL_KERNELS_NEON
+
+// -------------------------------------------------------------------------------------------------------------------------
+// DISPATCH
+// -------------------------------------------------------------------------------------------------------------------------
+
+// The histogram has no profitable SIMD form (it is a scatter), every table uses the sub-histogram version
+static const PixelKernels scalarKernels = { "scalar", channelSumsScalar, histogramScalar, luminanceScalar, frameDifferenceScalar };
+#ifdef PIXEL_KERNELS_X86
+static const PixelKernels sse2Kernels = { "sse2", channelSumsSSE2, histogramScalar, luminanceSSE2, frameDifferenceSSE2 };
+static const PixelKernels avx2Kernels = { "avx2", channelSumsAVX2, histogramScalar, luminanceAVX2, frameDifferenceAVX2 };
+#endif
+#ifdef PIXEL_KERNELS_NEON
+static const PixelKernels neonKernels = { "neon", channelSumsNEON, histogramScalar, luminanceNEON, frameDifferenceNEON };
+#endif
+
+static std::atomic<const PixelKernels*> selectedKernels(nullptr);
+
+std::vector<const PixelKernels*> PixelKernels::supported() {
+    std::vector<const PixelKernels*> kernels = { &scalarKernels };
+#ifdef PIXEL_KERNELS_X86
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    kernels.push_back(&sse2Kernels); // part of every x86-64 CPU
+#endif
+    static const bool hasAVX2 = cpuSupportsAVX2();
+    if (hasAVX2) {
+        kernels.push_back(&avx2Kernels);
+    }
+#endif
+#ifdef PIXEL_KERNELS_NEON
+    kernels.push_back(&neonKernels); // part of every AArch64 CPU
+#endif
+    return kernels;
+}
+
+const PixelKernels& PixelKernels::get() {
+    const PixelKernels* kernels = selectedKernels.load(std::memory_order_acquire);
+    if (kernels == nullptr) {
+        kernels = supported().back();
+        selectedKernels.store(kernels, std::memory_order_release);
+    }
+    return *kernels;
+}
+
+const PixelKernels& PixelKernels::scalar() {
+    return scalarKernels;
+}
+
+void PixelKernels::select(const PixelKernels& kernels) {
+    selectedKernels.store(&kernels, std::memory_order_release);
+}
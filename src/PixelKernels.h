@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct PixelKernels {
+	// PixelKernels is a table of the hot per-pixel loops used by the feature extractors,
+	// with one implementation per instruction set (scalar, SSE2, AVX2, NEON).
+	// get() returns the best table supported by the CPU the program runs on, chosen once at startup.
+	// All kernels work on packed 8-bit RGB pixels (3 bytes per pixel).
+	// The SIMD tables give the same luminance values as the scalar one bit for bit;
+	// frameDifference only sums in a different order, so it matches within float rounding.
+
+	struct ChannelSums {
+		uint64_t r = 0, g = 0, b = 0;
+	};
+
+	const char* name;
+
+	// Sum of every channel over numPixels pixels
+	ChannelSums (*channelSums)(const uint8_t* rgb, size_t numPixels);
+
+	// Adds the per-channel histogram of numPixels pixels to red/green/blue (256 bins each)
+	void (*histogram)(const uint8_t* rgb, size_t numPixels, uint32_t* red, uint32_t* green, uint32_t* blue);
+
+	// Writes the Rec. 709 luminance (0.2126 R + 0.7152 G + 0.0722 B) of every pixel to out
+	void (*luminance)(const uint8_t* rgb, size_t numPixels, float* out);
+
+	// Sum over all pixels of the euclidean RGB distance between a and b
+	float (*frameDifference)(const uint8_t* a, const uint8_t* b, size_t numPixels);
+
+	static const PixelKernels& get(); // best supported implementation, or the one set with select()
+	static const PixelKernels& scalar();
+	static std::vector<const PixelKernels*> supported(); // every implementation this CPU can run, scalar first
+	static void select(const PixelKernels& kernels); // forces an implementation, used to compare them
+};
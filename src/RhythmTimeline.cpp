@@ -0,0 +1,229 @@
+#include "RhythmTimeline.h"
+#include "BinaryIO.h"
+#include "PixelKernels.h"
+#include <opencv2/opencv.hpp>
+#include <filesystem>
+#include <fstream>
+
+static const uint32_t timelineMagic = 0x4C54524D; // "MRTL"
+static const uint32_t timelineFormatVersion = 1;
+static const int cutWindow = 8; // frames on each side whose median difference a cut is compared with
+
+// -------------------------------------------------------------------------------------------------------------------------
+// OBSERVATION
+// -------------------------------------------------------------------------------------------------------------------------
+
+bool RhythmTimeline::observe(const std::string& path, const ofPixels& frame, int frameIndex, int totalFrames) {
+    if (frameIndex < 0 || !frame.isAllocated() || frame.getNumChannels() != 3) return false;
+
+    // The first frame of a video since it was loaded: its timeline starts over if the file changed
+    auto run = runs.find(path);
+    if (run == runs.end()) {
+        run = runs.emplace(path, Run()).first;
+        FeatureCache::FileIdentity identity;
+        FeatureCache::getFileIdentity(path, identity);
+        auto it = timelines.find(path);
+        if (it != timelines.end() && !(it->second.identity == identity)) timelines.erase(it);
+        Timeline& timeline = timelines[path];
+        timeline.identity = identity;
+        if (totalFrames > 0 && timeline.scores.size() < size_t(totalFrames)) timeline.scores.resize(totalFrames, -1.0f);
+    }
+
+    cv::Mat pixels(frame.getHeight(), frame.getWidth(), CV_8UC3, const_cast<unsigned char*>(frame.getData()));
+    sample.resize(sampleSize * sampleSize * 3);
+    cv::Mat resized(sampleSize, sampleSize, CV_8UC3, sample.data());
+    cv::resize(pixels, resized, resized.size(), 0, 0, cv::INTER_AREA);
+
+    Run& current = run->second;
+    bool consecutive = current.lastFrame >= 0 && frameIndex == current.lastFrame + 1 && current.previousSample.size() == sample.size();
+    current.lastFrame = frameIndex;
+    sample.swap(current.previousSample); // previousSample is now this frame
+    if (!consecutive) return false;
+
+    Timeline& timeline = timelines[path];
+    if (size_t(frameIndex) >= timeline.scores.size()) timeline.scores.resize(frameIndex + 1, -1.0f); // frame count unknown
+    float score = PixelKernels::get().frameDifference(sample.data(), current.previousSample.data(), sampleSize * sampleSize) / (sampleSize * sampleSize);
+    float& stored = timeline.scores[frameIndex];
+    if (stored >= 0) {
+        timeline.scoreSum -= stored; // seen on a previous loop, the latest decode wins
+    }
+    else {
+        timeline.observedFrames++;
+    }
+    stored = score;
+    timeline.scoreSum += score;
+    dirty = true;
+    return true;
+}
+
+void RhythmTimeline::forget(const std::string& path) {
+    if (timelines.erase(path)) dirty = true;
+    runs.erase(path);
+}
+
+const RhythmTimeline::Timeline* RhythmTimeline::find(const std::string& path) const {
+    auto it = timelines.find(path);
+    return it != timelines.end() ? &it->second : nullptr;
+}
+
+bool RhythmTimeline::getRhythmMetric(const std::string& path, int prePassStride, float& metric) const {
+    const Timeline* timeline = find(path);
+    if (!timeline || timeline->observedFrames == 0 || timeline->getCoverage() < minCoverage) return false;
+    metric = float(timeline->scoreSum / timeline->observedFrames) * std::max(1, prePassStride);
+    return true;
+}
+
+std::vector<int> RhythmTimeline::getShotBoundaries(const std::string& path) const {
+    std::vector<int> boundaries;
+    const Timeline* timeline = find(path);
+    if (!timeline) return boundaries;
+
+    // A cut is a difference far above the ones around it: a fast pan raises all of them, a cut only one
+    const std::vector<float>& scores = timeline->scores;
+    int count = scores.size();
+    std::vector<float> window;
+    for (int frame = 1; frame < count; frame++) {
+        float score = scores[frame];
+        if (score < cutMinScore) continue;
+        window.clear();
+        bool isPeak = true;
+        for (int other = std::max(1, frame - cutWindow); other <= std::min(count - 1, frame + cutWindow); other++) {
+            if (other == frame || scores[other] < 0) continue;
+            window.push_back(scores[other]);
+            if (std::abs(other - frame) <= 2 && scores[other] > score) isPeak = false;
+        }
+        if (!isPeak || window.size() < cutWindow / 2) continue; // too little observed around it to tell
+        std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+        if (score >= cutRatio * window[window.size() / 2]) boundaries.push_back(frame);
+    }
+    return boundaries;
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// FILE
+// -------------------------------------------------------------------------------------------------------------------------
+
+bool RhythmTimeline::load() {
+    timelines.clear();
+    runs.clear();
+    dirty = false;
+    std::ifstream in(ofToDataPath(timelinePath, true), std::ios::binary);
+    if (!in) return false;
+
+    uint32_t magic = 0, formatVersion = 0, count = 0;
+    readBinary(in, magic);
+    readBinary(in, formatVersion);
+    if (!readBinary(in, count) || magic != timelineMagic || formatVersion != timelineFormatVersion) {
+        ofLogWarning() << "Ignoring unreadable rhythm timelines " << timelinePath;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        std::string path;
+        Timeline timeline;
+        readBinary(in, path);
+        readBinary(in, timeline.identity.size);
+        readBinary(in, timeline.identity.modifiedTime);
+        if (!readBinary(in, timeline.scores)) {
+            ofLogWarning() << "Rhythm timelines " << timelinePath << " are truncated, kept " << timelines.size() << " videos";
+            break;
+        }
+
+        FeatureCache::FileIdentity identity;
+        if (!FeatureCache::getFileIdentity(path, identity) || !(identity == timeline.identity)) {
+            dirty = true; // the video changed since it was played
+            continue;
+        }
+        for (float score : timeline.scores) {
+            if (score < 0) continue;
+            timeline.observedFrames++;
+            timeline.scoreSum += score;
+        }
+        timelines[path] = std::move(timeline);
+    }
+    return true;
+}
+
+bool RhythmTimeline::save() {
+    if (!dirty) return true;
+
+    // Write to a temporary file first so a crash never leaves half written timelines behind
+    std::string finalPath = ofToDataPath(timelinePath, true);
+    std::string tempPath = finalPath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            ofLogError() << "Cannot write rhythm timelines " << tempPath;
+            return false;
+        }
+        writeBinary(out, timelineMagic);
+        writeBinary(out, timelineFormatVersion);
+        writeBinary(out, uint32_t(timelines.size()));
+        for (const auto& pair : timelines) {
+            writeBinary(out, pair.first);
+            writeBinary(out, pair.second.identity.size);
+            writeBinary(out, pair.second.identity.modifiedTime);
+            writeBinary(out, pair.second.scores);
+        }
+        if (!out) return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, finalPath, error);
+    if (error) {
+        ofLogError() << "Cannot replace rhythm timelines " << finalPath << ": " << error.message();
+        return false;
+    }
+    dirty = false;
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// DRAWER
+// -------------------------------------------------------------------------------------------------------------------------
+
+void RhythmTimeline::draw(const std::string& path, int currentFrame, int prePassStride, int x, int y, int width, int height) const {
+    const Timeline* timeline = find(path);
+    if (!timeline || timeline->scores.empty() || width <= 0) return;
+    const std::vector<float>& scores = timeline->scores;
+    size_t count = scores.size();
+
+    ofPushStyle();
+    ofFill();
+    ofSetColor(0, 0, 0, 180);
+    ofDrawRectangle(x, y, width, height);
+
+    // One bar per pixel column: the largest difference of its frames, dark where nothing was observed yet
+    for (int column = 0; column < width; column++) {
+        size_t first = count * column / width;
+        size_t last = std::max(first + 1, count * (column + 1) / width);
+        float score = -1.0f;
+        for (size_t frame = first; frame < last && frame < count; frame++) score = std::max(score, scores[frame]);
+        if (score < 0) {
+            ofSetColor(60);
+            ofDrawRectangle(x + column, y + height - 2, 1, 2);
+            continue;
+        }
+        float barHeight = std::min(1.0f, score / (2 * cutMinScore)) * (height - 2);
+        ofSetColor(120, 180, 255);
+        ofDrawRectangle(x + column, y + height - barHeight, 1, barHeight);
+    }
+
+    std::vector<int> boundaries = getShotBoundaries(path);
+    ofSetColor(255, 60, 60);
+    for (int frame : boundaries) {
+        ofDrawRectangle(x + float(frame) * width / count, y, 1, height);
+    }
+    if (currentFrame >= 0) {
+        ofSetColor(255);
+        ofDrawRectangle(x + float(currentFrame) * width / count, y, 2, height);
+    }
+
+    float metric = 0;
+    std::string label = ofToString(int(timeline->getCoverage() * 100)) + "% observed, "
+        + ofToString(boundaries.size() + 1) + " shots";
+    if (getRhythmMetric(path, prePassStride, metric)) label += ", rhythm " + ofToString(metric, 1);
+    ofSetColor(255);
+    ofDrawBitmapString(label, x + 5, y + 14);
+    ofPopStyle();
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "ofMain.h"
+#include "FeatureCache.h"
+#include <map>
+
+class RhythmTimeline {
+	// The RhythmTimeline keeps, for every video played in the gallery, the difference between each frame and the
+	// one before it, and the shot boundaries found in those differences. It is filled from the frames the player
+	// decodes anyway: observe() is called once per new frame, downsamples it and compares it with the previous
+	// frame of the same video when the two are consecutive (a seek or a loop starts a new run). Every video keeps
+	// its own run, so frames of several sessions can arrive interleaved. Every playback fills more of the
+	// timeline, and the mean difference becomes the rhythm metric of the video once coverage is reached,
+	// replacing the estimate of the ingest pre-pass (see VideoAnalysisSession) without decoding anything more.
+	// The pre-pass stays: the videos never played need a rhythm to be grouped and sorted, it shares its decode
+	// with the thumbnail, and the FeatureCache runs it once per file.
+	// Timelines are saved in timelinePath, keyed by path and checked against the size and time of the file.
+	// Main thread only.
+
+public:
+
+	struct Timeline {
+		FeatureCache::FileIdentity identity;
+		std::vector<float> scores; // frame i: difference with frame i - 1, negative while not observed
+		int observedFrames = 0;
+		double scoreSum = 0; // of the observed scores
+
+		float getCoverage() const { return scores.size() > 1 ? float(observedFrames) / (scores.size() - 1) : 0.0f; };
+	};
+
+	// CONSTRUCTORS
+
+	RhythmTimeline() {};
+
+	// TIMELINE METHODS
+
+	bool load(); // false if the file is missing or unreadable; the timelines of changed files are dropped
+	bool save(); // writes the file if a timeline changed
+	bool observe(const std::string& path, const ofPixels& frame, int frameIndex, int totalFrames); // true if a score was recorded
+	void forget(const std::string& path); // the file changed or was deleted
+
+	const Timeline* find(const std::string& path) const; // nullptr if the video was never played
+	std::vector<int> getShotBoundaries(const std::string& path) const; // first frames of the shots after the first one
+	// false until minCoverage of the video was observed. The metric is scaled to the pre-pass of the video, which
+	// compared frames prePassStride apart (FeatureStore::rhythmFrameStride): for a steady motion that is that many differences
+	bool getRhythmMetric(const std::string& path, int prePassStride, float& metric) const;
+
+	// DRAWER METHODS
+
+	void draw(const std::string& path, int currentFrame, int prePassStride, int x, int y, int width, int height) const; // scores, cuts and playhead
+
+	// ATTRIBUTES
+
+	size_t size() const { return timelines.size(); };
+
+	std::string timelinePath = "timelines.bin"; // relative to the data folder
+	int sampleSize = 64; // frames are compared at sampleSize x sampleSize, like the pre-pass (RhythmOptions::sampleSize)
+	float minCoverage = 0.25f; // fraction of the frames observed before the timeline gives the rhythm metric
+	float cutMinScore = 30.0f; // a shot boundary changes every pixel by at least this much on average
+	float cutRatio = 3.0f; // and is cutRatio times the median difference of the frames around it
+
+private:
+	std::map<std::string, Timeline> timelines;
+	bool dirty = false;
+
+	// Run being observed in a video: its last frame, the next one is scored if it follows it
+	struct Run {
+		int lastFrame = -1;
+		std::vector<uint8_t> previousSample; // sampleSize x sampleSize RGB
+	};
+	std::map<std::string, Run> runs; // of the videos observed since they were loaded or forgotten
+	std::vector<uint8_t> sample;
+};
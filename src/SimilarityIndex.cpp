@@ -0,0 +1,267 @@
+#include "SimilarityIndex.h"
+
+SimilarityIndex::SimilarityIndex(int reducedDimensions, uint32_t seed)
+    : reducedDimensions(std::max(1, reducedDimensions)), seed(seed), random(seed) {
+}
+
+// ----------------------------------------------------------------------------------------------------------------
+// DESCRIPTORS
+// ----------------------------------------------------------------------------------------------------------------
+
+std::vector<float> SimilarityIndex::makeDescriptor(const FeatureStore& store, MediaId id) {
+    std::vector<float> descriptor;
+    if (!store.hasColorHistogram[id] || !store.hasEdgeHistogram[id]) return descriptor;
+
+    // Quantized rows are decoded in place, float rows copied
+    const size_t colorLength = 3 * FeatureStore::histogramBins;
+    descriptor.resize(colorLength + store.getEdgeCells());
+    const float* color = store.getColorHistograms(id, descriptor.data());
+    const float* edgeHist = store.getEdgeHistogram(id, descriptor.data() + colorLength);
+    if (color != descriptor.data()) std::copy(color, color + colorLength, descriptor.begin());
+    if (edgeHist != descriptor.data() + colorLength) std::copy(edgeHist, edgeHist + store.getEdgeCells(), descriptor.begin() + colorLength);
+
+    // Color and edges are normalized separately so they weigh the same whatever their number of bins
+    auto normalize = [&descriptor](size_t begin, size_t end) {
+        double norm = 0;
+        for (size_t i = begin; i < end; i++) norm += double(descriptor[i]) * descriptor[i];
+        if (norm <= 0) return;
+        float scale = float(1.0 / std::sqrt(2.0 * norm)); // each half has norm 1/sqrt(2), the whole descriptor 1
+        for (size_t i = begin; i < end; i++) descriptor[i] *= scale;
+    };
+    normalize(0, colorLength);
+    normalize(colorLength, descriptor.size());
+    return descriptor;
+}
+
+float SimilarityIndex::descriptorDistance(const std::vector<float>& a, const std::vector<float>& b) {
+    if (a.size() != b.size()) return std::numeric_limits<float>::max();
+    float sum = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return std::sqrt(sum);
+}
+
+void SimilarityIndex::project(const std::vector<float>& descriptor, float* out) const {
+    std::fill(out, out + reducedDimensions, 0.0f);
+    for (size_t i = 0; i < descriptorLength; i++) {
+        float value = descriptor[i];
+        if (value == 0.0f) continue; // empty histogram bins
+        for (uint32_t e = projectionStart[i]; e < projectionStart[i + 1]; e++) {
+            out[projectionEntries[e].dimension] += projectionEntries[e].weight * value;
+        }
+    }
+}
+
+float SimilarityIndex::reducedDistance(const float* a, const float* b) const {
+    float sum = 0;
+    for (int d = 0; d < reducedDimensions; d++) {
+        float diff = a[d] - b[d];
+        sum += diff * diff;
+    }
+    return std::sqrt(sum);
+}
+
+// ----------------------------------------------------------------------------------------------------------------
+// BUILDING
+// ----------------------------------------------------------------------------------------------------------------
+
+void SimilarityIndex::clear() {
+    ids.clear();
+    reduced.clear();
+    nodes.clear();
+    pending.clear();
+    removed.clear();
+    removedCount = 0;
+    root = -1;
+}
+
+void SimilarityIndex::build(const FeatureStore& store) {
+    uint64_t startTime = ofGetElapsedTimeMillis();
+    clear();
+    for (size_t id = 0; id < store.size(); id++) {
+        append((int)id, makeDescriptor(store, id));
+    }
+    rebuildTree();
+    ofLogNotice() << "Similarity index built over " << ids.size() << " elements in " << (ofGetElapsedTimeMillis() - startTime) << " ms";
+}
+
+bool SimilarityIndex::add(int id, const std::vector<float>& descriptor) {
+    if (!append(id, descriptor)) return false;
+    pending.push_back(ids.size() - 1);
+
+    // The linear scan of the pending elements gets slower than a rebuild once the list is a sizeable part of the tree
+    size_t treeSize = ids.size() - pending.size();
+    if (pending.size() > std::max<size_t>(64, size_t(rebuildFraction * treeSize))) {
+        rebuildTree();
+    }
+    return true;
+}
+
+bool SimilarityIndex::remove(int id) {
+    bool found = false;
+    for (size_t item = 0; item < ids.size(); item++) {
+        if (ids[item] != id || removed[item]) continue;
+        removed[item] = true;
+        removedCount++;
+        found = true;
+    }
+
+    // Tombstones cost the queries like pending elements do
+    if (removedCount > std::max<size_t>(64, size_t(rebuildFraction * ids.size()))) {
+        rebuildTree();
+    }
+    return found;
+}
+
+bool SimilarityIndex::append(int id, const std::vector<float>& descriptor) {
+    if (descriptor.empty()) return false;
+    if (descriptorLength == 0) {
+        // Very sparse random projection (Li, Hastie and Church): every entry is +-sqrt(s / reducedDimensions)
+        // with probability 1/s, 0 otherwise, with s = sqrt(descriptorLength). It preserves distances like a
+        // Gaussian projection but costs a couple of operations per descriptor value instead of reducedDimensions.
+        // Fixed by the seed so the index is reproducible
+        descriptorLength = descriptor.size();
+        double sparsity = std::sqrt(double(descriptorLength));
+        float weight = float(std::sqrt(sparsity / reducedDimensions));
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        projectionStart.assign(1, 0);
+        projectionEntries.clear();
+        for (size_t i = 0; i < descriptorLength; i++) {
+            for (int d = 0; d < reducedDimensions; d++) {
+                double u = uniform(generator) * sparsity;
+                if (u < 0.5) projectionEntries.push_back({ d, weight });
+                else if (u < 1.0) projectionEntries.push_back({ d, -weight });
+            }
+            projectionStart.push_back(projectionEntries.size());
+        }
+    }
+    if (descriptor.size() != descriptorLength) {
+        ofLogWarning() << "SimilarityIndex: descriptor of element " << id << " has " << descriptor.size() << " values instead of " << descriptorLength;
+        return false;
+    }
+
+    ids.push_back(id);
+    removed.push_back(false);
+    reduced.resize(ids.size() * reducedDimensions);
+    project(descriptor, &reduced[(ids.size() - 1) * reducedDimensions]);
+    return true;
+}
+
+void SimilarityIndex::rebuildTree() {
+    // Tombstones are dropped, the remaining elements keep their order
+    if (removedCount > 0) {
+        size_t kept = 0;
+        for (size_t item = 0; item < ids.size(); item++) {
+            if (removed[item]) continue;
+            ids[kept] = ids[item];
+            std::copy_n(&reduced[item * reducedDimensions], reducedDimensions, &reduced[kept * reducedDimensions]);
+            kept++;
+        }
+        ids.resize(kept);
+        reduced.resize(kept * reducedDimensions);
+        removed.assign(kept, false);
+        removedCount = 0;
+    }
+
+    nodes.clear();
+    nodes.reserve(ids.size());
+    pending.clear();
+    std::vector<int> items(ids.size());
+    for (size_t i = 0; i < items.size(); i++) items[i] = i;
+    root = buildNode(items, 0, items.size());
+}
+
+int SimilarityIndex::buildNode(std::vector<int>& items, int begin, int end) {
+    if (begin >= end) return -1;
+
+    // Random vantage point, the rest is split at the median distance to it
+    std::swap(items[begin], items[begin + random() % (end - begin)]);
+    int index = nodes.size();
+    nodes.push_back(Node{ items[begin], 0.0f });
+    if (end - begin == 1) return index;
+
+    const float* vantage = &reduced[size_t(items[begin]) * reducedDimensions];
+    std::vector<std::pair<float, int>> distances;
+    distances.reserve(end - begin - 1);
+    for (int i = begin + 1; i < end; i++) {
+        distances.push_back({ reducedDistance(vantage, &reduced[size_t(items[i]) * reducedDimensions]), items[i] });
+    }
+    size_t median = distances.size() / 2;
+    std::nth_element(distances.begin(), distances.begin() + median, distances.end());
+    for (size_t i = 0; i < distances.size(); i++) items[begin + 1 + i] = distances[i].second;
+
+    int split = begin + 1 + median;
+    nodes[index].radius = distances[median].first;
+    int inside = buildNode(items, begin + 1, split);
+    int outside = buildNode(items, split, end);
+    nodes[index].inside = inside; // assigned after the recursion, nodes may have been reallocated
+    nodes[index].outside = outside;
+    return index;
+}
+
+// ----------------------------------------------------------------------------------------------------------------
+// QUERIES
+// ----------------------------------------------------------------------------------------------------------------
+
+void SimilarityIndex::pushCandidate(std::vector<std::pair<float, int>>& heap, size_t k, float distance, int item, float& tau) {
+    if (heap.size() < k) {
+        heap.push_back({ distance, item });
+        std::push_heap(heap.begin(), heap.end());
+    }
+    else if (distance < heap.front().first) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = { distance, item };
+        std::push_heap(heap.begin(), heap.end());
+    }
+    if (heap.size() == k) tau = heap.front().first; // worst of the k best so far
+}
+
+void SimilarityIndex::searchNode(int node, const float* target, size_t k, int excludeId, std::vector<std::pair<float, int>>& heap, float& tau) const {
+    if (node < 0) return;
+    const Node& n = nodes[node];
+    float distance = reducedDistance(target, &reduced[size_t(n.item) * reducedDimensions]);
+    if (ids[n.item] != excludeId && !removed[n.item]) {
+        pushCandidate(heap, k, distance, n.item, tau);
+    }
+
+    // Visit the side of the target first, the other only if the ball of radius tau crosses the boundary
+    if (distance < n.radius) {
+        if (distance - tau < n.radius) searchNode(n.inside, target, k, excludeId, heap, tau);
+        if (distance + tau >= n.radius) searchNode(n.outside, target, k, excludeId, heap, tau);
+    }
+    else {
+        if (distance + tau >= n.radius) searchNode(n.outside, target, k, excludeId, heap, tau);
+        if (distance - tau < n.radius) searchNode(n.inside, target, k, excludeId, heap, tau);
+    }
+}
+
+std::vector<SimilarityIndex::Neighbour> SimilarityIndex::query(const std::vector<float>& descriptor, size_t k, int excludeId,
+    const std::function<float(int)>& exactDistance) const {
+    std::vector<Neighbour> neighbours;
+    if (k == 0 || size() == 0 || descriptor.size() != descriptorLength) return neighbours;
+
+    std::vector<float> target(reducedDimensions);
+    project(descriptor, target.data());
+
+    size_t numCandidates = exactDistance ? k * std::max(1, rerankFactor) : k;
+    std::vector<std::pair<float, int>> heap;
+    heap.reserve(numCandidates + 1);
+    float tau = std::numeric_limits<float>::max();
+    searchNode(root, target.data(), numCandidates, excludeId, heap, tau);
+    for (int item : pending) {
+        if (ids[item] == excludeId || removed[item]) continue;
+        pushCandidate(heap, numCandidates, reducedDistance(target.data(), &reduced[size_t(item) * reducedDimensions]), item, tau);
+    }
+
+    neighbours.reserve(heap.size());
+    for (const auto& candidate : heap) {
+        int id = ids[candidate.second];
+        neighbours.push_back({ id, exactDistance ? exactDistance(id) : candidate.first });
+    }
+    std::sort(neighbours.begin(), neighbours.end(), [](const Neighbour& a, const Neighbour& b) { return a.distance < b.distance; });
+    if (neighbours.size() > k) neighbours.resize(k);
+    return neighbours;
+}
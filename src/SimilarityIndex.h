@@ -0,0 +1,84 @@
+#pragma once
+#include "ofMain.h"
+#include "FeatureStore.h"
+#include <functional>
+#include <random>
+
+class SimilarityIndex {
+	// The SimilarityIndex answers "which media look like this one" without comparing against the whole collection.
+	// Every element is described by its RGB histograms followed by its edge histogram (see makeDescriptor),
+	// a fixed random projection reduces that descriptor to reducedDimensions values and a vantage-point tree
+	// over the reduced vectors finds the nearest candidates. The candidates can then be reranked with the exact
+	// distance on the full descriptors, the projection roughly preserves distances so a few times k candidates
+	// are enough to recover the true top-k.
+	// Elements added after build() go to a pending list that is searched linearly, the tree is rebuilt once
+	// that list grows past a fraction of the tree, so adding media stays cheap. Removed elements stay in the tree
+	// as tombstones skipped by the queries, until they too grow past that fraction and the tree is rebuilt without them.
+	// Not thread safe: build, add and query from the same thread.
+
+public:
+
+	struct Neighbour {
+		int id; // id given to add(), the MediaId for build()
+		float distance;
+	};
+
+	// CONSTRUCTORS
+
+	SimilarityIndex(int reducedDimensions = 64, uint32_t seed = 5489u);
+
+	// INDEX METHODS
+
+	static std::vector<float> makeDescriptor(const FeatureStore& store, MediaId id); // L2-normalized color and edge histograms, empty if the features are missing
+	static float descriptorDistance(const std::vector<float>& a, const std::vector<float>& b); // Euclidean distance
+
+	void build(const FeatureStore& store); // replaces the content with every media of the store
+	bool add(int id, const std::vector<float>& descriptor); // returns false if the descriptor is empty or of a different length
+	bool remove(int id); // returns false if id is not in the index; remove then add to replace a descriptor
+	void clear();
+
+	// k nearest elements to descriptor, closest first. With exactDistance the best rerankFactor * k candidates
+	// of the reduced space are reranked by exactDistance(id); excludeId is never returned (the query itself)
+	std::vector<Neighbour> query(const std::vector<float>& descriptor, size_t k, int excludeId = -1,
+		const std::function<float(int)>& exactDistance = nullptr) const;
+
+	// ATTRIBUTES
+
+	size_t size() const { return ids.size() - removedCount; };
+	int rerankFactor = 8;
+	float rebuildFraction = 0.125f; // pending elements allowed, as a fraction of the tree size, before rebuilding
+
+private:
+
+	struct Node {
+		int item; // vantage point, index in ids
+		float radius; // median distance of the subtree to the vantage point
+		int inside = -1, outside = -1; // children nodes: distance < radius, distance >= radius
+	};
+
+	bool append(int id, const std::vector<float>& descriptor); // adds to ids/reduced without touching the tree
+	void project(const std::vector<float>& descriptor, float* out) const;
+	float reducedDistance(const float* a, const float* b) const;
+	void rebuildTree();
+	int buildNode(std::vector<int>& items, int begin, int end);
+	void searchNode(int node, const float* target, size_t k, int excludeId, std::vector<std::pair<float, int>>& heap, float& tau) const;
+	static void pushCandidate(std::vector<std::pair<float, int>>& heap, size_t k, float distance, int item, float& tau);
+
+	int reducedDimensions;
+	uint32_t seed;
+	size_t descriptorLength = 0; // fixed by the first descriptor added
+	struct ProjectionEntry {
+		int dimension;
+		float weight;
+	};
+	std::vector<uint32_t> projectionStart; // entries of descriptor value i: projectionStart[i] to projectionStart[i + 1]
+	std::vector<ProjectionEntry> projectionEntries; // non-zero entries of the sparse projection matrix
+	std::vector<int> ids;
+	std::vector<float> reduced; // reducedDimensions values per element, same order as ids
+	std::vector<Node> nodes;
+	int root = -1;
+	std::vector<int> pending; // elements not yet in the tree, indices in ids
+	std::vector<bool> removed; // tombstones, same order as ids
+	size_t removedCount = 0;
+	std::mt19937 random;
+};
@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+template<typename T>
+class SpscRing {
+	// A SpscRing is a lock-free bounded queue between exactly one producer thread and one consumer thread.
+	// Values are swapped in and out of slots allocated once: the producer gets back what the consumer left in
+	// the slot, so buffers such as ofPixels circulate between the two threads without being reallocated.
+	// tryPush() and tryPop() never block, a full ring makes tryPush() fail and the producer decides what to drop.
+
+public:
+
+	// CONSTRUCTORS
+
+	explicit SpscRing(size_t capacity) : slots(capacity + 1) {}; // one slot stays empty to tell full from empty
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	// QUEUE METHODS
+
+	bool tryPush(T& value) { // producer only, value receives the recycled content of the slot
+		size_t tail = this->tail.load(std::memory_order_relaxed);
+		size_t next = (tail + 1) % slots.size();
+		if (next == head.load(std::memory_order_acquire)) return false; // full
+		std::swap(slots[tail], value);
+		this->tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool tryPush(T&& value) {
+		T pushed = std::move(value);
+		return tryPush(pushed);
+	}
+
+	bool tryPop(T& value) { // consumer only, the previous content of value is left in the slot for the producer
+		size_t head = this->head.load(std::memory_order_relaxed);
+		if (head == tail.load(std::memory_order_acquire)) return false; // empty
+		std::swap(value, slots[head]);
+		this->head.store((head + 1) % slots.size(), std::memory_order_release);
+		return true;
+	}
+
+	T* front() { // consumer only, the value tryPop() would return next or nullptr, valid until that tryPop()
+		size_t head = this->head.load(std::memory_order_relaxed);
+		if (head == tail.load(std::memory_order_acquire)) return nullptr; // empty
+		return &slots[head];
+	}
+
+	// ATTRIBUTES
+
+	bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); };
+	size_t capacity() const { return slots.size() - 1; };
+
+private:
+	std::vector<T> slots;
+	alignas(64) std::atomic<size_t> head{ 0 }; // next slot to pop, written by the consumer
+	alignas(64) std::atomic<size_t> tail{ 0 }; // next slot to push, written by the producer
+};
@@ -0,0 +1,204 @@
+#include "ThumbnailCache.h"
+#include <opencv2/opencv.hpp>
+
+ThumbnailCache::~ThumbnailCache() {
+    stop();
+}
+
+void ThumbnailCache::setup(size_t capacity, int numThreads, std::pair<int, int> imageSize, float openTimeoutSeconds) {
+    stop();
+    this->capacity = capacity;
+    this->imageSize = imageSize;
+    this->openTimeoutSeconds = openTimeoutSeconds;
+    stopping = false;
+    for (int t = 0; t < std::max(1, numThreads); t++) {
+        workers.emplace_back(&ThumbnailCache::workerLoop, this);
+    }
+}
+
+void ThumbnailCache::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+// Size of a width x height source fitted inside maxWidth x maxHeight, downscaled only
+static std::pair<int, int> fitSize(int width, int height, int maxWidth, int maxHeight) {
+    float scale = std::min(1.0f, std::min((float)maxWidth / width, (float)maxHeight / height));
+    return { std::max(1, int(width * scale)), std::max(1, int(height * scale)) };
+}
+
+bool ThumbnailCache::loadPixels(const std::string& path, bool isVideo, int width, int height, ofPixels& pixels, bool fit, float openTimeoutSeconds) {
+    if (!isVideo) {
+        if (!ofLoadImage(pixels, path)) return false;
+        if (fit) {
+            std::tie(width, height) = fitSize(pixels.getWidth(), pixels.getHeight(), width, height);
+            if (width == (int)pixels.getWidth() && height == (int)pixels.getHeight()) return true;
+        }
+        pixels.resize(width, height);
+        return true;
+    }
+
+    // First frame of the video, OpenCV decodes on the calling thread without a GL context. The timeouts make a
+    // corrupt file fail instead of blocking the worker, like in VideoAnalysisSession
+    int timeoutMs = std::max(1, int(openTimeoutSeconds * 1000));
+    cv::VideoCapture video(ofToDataPath(path, true), cv::CAP_ANY, { cv::CAP_PROP_OPEN_TIMEOUT_MSEC, timeoutMs, cv::CAP_PROP_READ_TIMEOUT_MSEC, timeoutMs });
+    cv::Mat frame;
+    if (!video.isOpened() || !video.read(frame) || frame.empty()) return false;
+    if (fit) {
+        std::tie(width, height) = fitSize(frame.cols, frame.rows, width, height);
+    }
+    cv::Mat rgb, resized;
+    cv::cvtColor(frame, rgb, cv::COLOR_BGR2RGB);
+    cv::resize(rgb, resized, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+    pixels.setFromPixels(resized.data, width, height, OF_PIXELS_RGB);
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// WORKERS
+// -------------------------------------------------------------------------------------------------------------------------
+
+void ThumbnailCache::workerLoop() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        Result result;
+        result.id = job.id;
+        result.generation = job.generation;
+        try {
+            result.loaded = loadPixels(job.path, job.isVideo, imageSize.first, imageSize.second, result.pixels, level == SCREEN, openTimeoutSeconds);
+        }
+        catch (const std::exception& e) {
+            ofLogError() << "Error loading the thumbnail of " << job.path << ": " << e.what();
+            result.loaded = false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        results.push_back(std::move(result));
+    }
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// MAIN THREAD
+// -------------------------------------------------------------------------------------------------------------------------
+
+void ThumbnailCache::beginFrame(std::vector<MediaElement>& medias) {
+    frame++;
+    std::deque<Result> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Drop the requests of the tiles that were not drawn last frame
+        auto stale = std::remove_if(jobs.begin(), jobs.end(), [this](const Job& job) { return lastRequired[job.id] + 1 < frame; });
+        for (auto it = stale; it != jobs.end(); ++it) {
+            pending.erase(it->id);
+        }
+        jobs.erase(stale, jobs.end());
+
+        int count = std::min<int>(results.size(), maxUploadsPerFrame);
+        for (int i = 0; i < count; i++) {
+            finished.push_back(std::move(results.front()));
+            results.pop_front();
+        }
+    }
+
+    for (auto& result : finished) {
+        if (result.generation != generations[result.id]) continue; // decoded from a file that changed since
+        pending.erase(result.id);
+        if (!result.loaded) {
+            failed.insert(result.id);
+            continue;
+        }
+        ofImage& image = getImage(medias[result.id]);
+        image.setUseTexture(true);
+        image.setFromPixels(result.pixels);
+        touch(result.id, medias);
+    }
+}
+
+bool ThumbnailCache::require(MediaId id, std::vector<MediaElement>& medias) {
+    if (id >= lastRequired.size()) {
+        lastRequired.resize(medias.size(), 0);
+        generations.resize(medias.size(), 0);
+    }
+    lastRequired[id] = frame;
+
+    MediaElement& media = medias[id];
+    ofImage& image = getImage(media);
+    if (image.isAllocated()) {
+        if (!image.isUsingTexture()) {
+            image.setUseTexture(true);
+            image.update();
+        }
+        touch(id, medias);
+        return true;
+    }
+    if (workers.empty() || pending.count(id) || failed.count(id)) return false;
+
+    pending.insert(id);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back({ id, generations[id], media.isVideo() ? media.videoPath : media.filePath, media.isVideo() });
+    }
+    wake.notify_one();
+    return false;
+}
+
+void ThumbnailCache::touch(MediaId id, std::vector<MediaElement>& medias) {
+    auto it = positions.find(id);
+    if (it != positions.end()) {
+        recent.splice(recent.begin(), recent, it->second); // already resident, move to the front
+        return;
+    }
+
+    recent.push_front(id);
+    positions[id] = recent.begin();
+    while (recent.size() > std::max<size_t>(capacity, 1)) {
+        MediaId oldest = recent.back();
+        if (lastRequired[oldest] == frame) break; // everything left is on screen
+        getImage(medias[oldest]).clear();
+        positions.erase(oldest);
+        recent.pop_back();
+    }
+}
+
+void ThumbnailCache::clear(std::vector<MediaElement>& medias) {
+    for (MediaId id : recent) {
+        getImage(medias[id]).clear();
+    }
+    recent.clear();
+    positions.clear();
+}
+
+void ThumbnailCache::forget(MediaId id, std::vector<MediaElement>& medias) {
+    getImage(medias[id]).clear();
+    failed.erase(id); // the new file may be readable
+
+    // Queued and finished requests are dropped, a worker decoding the old file delivers a result of an older generation
+    if (id < generations.size()) {
+        generations[id]++;
+        pending.erase(id);
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [id](const Job& job) { return job.id == id; }), jobs.end());
+        results.erase(std::remove_if(results.begin(), results.end(), [id](const Result& result) { return result.id == id; }), results.end());
+    }
+    auto it = positions.find(id);
+    if (it == positions.end()) return;
+    recent.erase(it->second);
+    positions.erase(it);
+}
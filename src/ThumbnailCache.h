@@ -0,0 +1,100 @@
+#pragma once
+#include "ofMain.h"
+#include "MediaElement.h"
+#include "FeatureStore.h"
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+class ThumbnailCache {
+	// The ThumbnailCache keeps the pixels and textures of the tiles around the viewport only, so the gallery
+	// memory does not grow with the collection (ingest drops the images once their features are extracted).
+	// require() returns true when the image of medias[id] is ready to draw, otherwise it queues it: worker
+	// threads decode and resize it, beginFrame() then uploads a few finished ones per frame on the main thread.
+	// At most `capacity` thumbnails are resident, the least recently required ones are freed first; the ones
+	// required in the current frame are never freed, so a capacity below the visible tile count only overshoots.
+	// Requests not renewed by the next frame (the tile scrolled away) are dropped before being decoded.
+	// Main thread only, apart from the workers which never touch the MediaElements.
+	// A cache serves one level of the image pyramid of the elements: GRID thumbnails (MediaElement::image, resized
+	// to the tile size) or SCREEN images (MediaElement::screenImage, fitted in the screen for the fullscreen view).
+
+public:
+
+	enum Level {
+		GRID, // the tile of the grid, fills exactly imageSize
+		SCREEN // fullscreen, fitted inside imageSize with its aspect ratio and never upscaled
+	};
+
+	// CONSTRUCTORS
+
+	ThumbnailCache(Level level = GRID) : level(level) {};
+	~ThumbnailCache();
+	ThumbnailCache(const ThumbnailCache&) = delete;
+	ThumbnailCache& operator=(const ThumbnailCache&) = delete;
+
+	void setup(size_t capacity, int numThreads, std::pair<int, int> imageSize, float openTimeoutSeconds = 5.0f); // starts the workers
+
+	// CACHE METHODS
+
+	void beginFrame(std::vector<MediaElement>& medias); // call once per frame, before the require calls
+	bool require(MediaId id, std::vector<MediaElement>& medias); // true if the image of the level is ready, otherwise queues it
+	void clear(std::vector<MediaElement>& medias); // frees every resident thumbnail
+	void forget(MediaId id, std::vector<MediaElement>& medias); // frees the thumbnail of a media whose file changed or was deleted, and drops its requests
+
+	// Decodes the thumbnail of a file, resized to width x height or, with fit, to the largest size inside it that
+	// keeps the aspect ratio (never larger than the file). A video that takes longer than openTimeoutSeconds to open
+	// or to decode its first frame fails. Thread safe, also used by the IngestPipeline
+	static bool loadPixels(const std::string& path, bool isVideo, int width, int height, ofPixels& pixels, bool fit = false, float openTimeoutSeconds = 5.0f);
+	ofImage& getImage(MediaElement& media) const { return level == SCREEN ? media.screenImage : media.image; };
+
+	// ATTRIBUTES
+
+	Level getLevel() const { return level; };
+	size_t size() const { return recent.size(); };
+	size_t getPendingCount() const { return pending.size(); };
+	size_t capacity = 256;
+	int maxUploadsPerFrame = 16; // texture uploads per frame, the others wait for the next frames
+
+private:
+	struct Job {
+		MediaId id;
+		uint32_t generation; // of id when queued
+		std::string path;
+		bool isVideo;
+	};
+	struct Result {
+		MediaId id;
+		uint32_t generation;
+		ofPixels pixels;
+		bool loaded;
+	};
+
+	void workerLoop();
+	void touch(MediaId id, std::vector<MediaElement>& medias); // marks id as the most recently used, evicting the oldest
+	void stop();
+
+	Level level;
+	std::pair<int, int> imageSize = { 280, 280 };
+	float openTimeoutSeconds = 5.0f; // RhythmOptions::openTimeoutSeconds
+
+	// Shared with the workers
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Job> jobs;
+	std::deque<Result> results;
+	bool stopping = false;
+	std::vector<std::thread> workers;
+
+	// Main thread only
+	std::unordered_set<MediaId> pending; // queued, being decoded or waiting for their upload
+	std::unordered_set<MediaId> failed; // unreadable files, not queued again
+	std::vector<uint64_t> lastRequired; // frame of the last require() of every id
+	std::vector<uint32_t> generations; // of every id, bumped by forget(): a result of an older job shows the previous file
+	uint64_t frame = 0;
+	std::list<MediaId> recent; // resident thumbnails, most recently required first
+	std::unordered_map<MediaId, std::list<MediaId>::iterator> positions; // position of every id in recent
+};
@@ -0,0 +1,82 @@
+#include "VideoAnalysisSession.h"
+#include "PixelKernels.h"
+#include <opencv2/opencv.hpp>
+
+std::string VideoAnalysisSession::getStatusName(Status status) {
+    switch (status) {
+    case SUCCEEDED: return "succeeded";
+    case TIMED_OUT: return "timed out";
+    case DECODE_ERROR: return "decode error";
+    case NO_FRAMES: return "no frames";
+    case OPEN_FAILED: return "open failed";
+    }
+    return "unknown";
+}
+
+VideoAnalysisSession::Result VideoAnalysisSession::run() {
+    Result result;
+    uint64_t startTime = ofGetElapsedTimeMillis();
+    uint64_t deadline = startTime + uint64_t(options.timeBudgetSeconds * 1000);
+
+    // The timeouts make a stalled demuxer or decoder give up instead of blocking the worker
+    int timeoutMs = std::max(1, int(options.openTimeoutSeconds * 1000));
+    cv::VideoCapture video(ofToDataPath(path, true), cv::CAP_ANY, { cv::CAP_PROP_OPEN_TIMEOUT_MSEC, timeoutMs, cv::CAP_PROP_READ_TIMEOUT_MSEC, timeoutMs });
+    if (!video.isOpened()) {
+        result.status = OPEN_FAILED;
+        result.message = "cannot open " + path;
+        return result;
+    }
+
+    int totalFrames = (int)video.get(cv::CAP_PROP_FRAME_COUNT); // 0 or less when the container does not tell
+    result.frameStride = std::max(1, options.frameStride);
+    if (options.maxSamples > 0 && totalFrames > 0) {
+        result.frameStride = std::max(result.frameStride, totalFrames / options.maxSamples); // spread the samples over long videos
+    }
+
+    const PixelKernels& kernels = PixelKernels::get();
+    const cv::Size sampleSize(options.sampleSize, options.sampleSize);
+    cv::Mat frame, rgb, resized, sample, previousSample;
+    float totalChange = 0.0f;
+    result.status = SUCCEEDED;
+
+    for (int index = 0; video.grab(); index++) {
+        result.framesDecoded++;
+        bool isThumbnail = index == 0;
+        if (!isThumbnail && index % result.frameStride != 0) continue; // skipped frames are decoded but never converted nor resized
+        if (!video.retrieve(frame) || frame.empty() || frame.type() != CV_8UC3) {
+            result.status = DECODE_ERROR;
+            result.message = "frame " + ofToString(index) + " could not be decoded";
+            break;
+        }
+
+        if (isThumbnail) {
+            cv::cvtColor(frame, rgb, cv::COLOR_BGR2RGB);
+            cv::resize(rgb, resized, cv::Size(thumbnailSize.first, thumbnailSize.second), 0, 0, cv::INTER_AREA);
+            result.thumbnail.setFromPixels(resized.data, thumbnailSize.first, thumbnailSize.second, OF_PIXELS_RGB);
+        }
+
+        // Frames are BGR, the distance is symmetric in the channels so they are compared as they are
+        cv::resize(frame, sample, sampleSize, 0, 0, cv::INTER_AREA);
+        if (!previousSample.empty()) {
+            totalChange += kernels.frameDifference(previousSample.ptr(), sample.ptr(), sample.total()) / sample.total();
+            result.comparisons++;
+        }
+        cv::swap(sample, previousSample); // the old buffer is reused by the next resize
+
+        if (options.timeBudgetSeconds > 0 && ofGetElapsedTimeMillis() > deadline) {
+            result.status = TIMED_OUT;
+            result.message = "stopped at frame " + ofToString(index) + " after " + ofToString(options.timeBudgetSeconds) + " s";
+            break;
+        }
+    }
+
+    if (!result.thumbnail.isAllocated()) {
+        result.status = NO_FRAMES;
+        if (result.message.empty()) result.message = "no frame could be decoded";
+        return result;
+    }
+    if (result.comparisons > 0) {
+        result.rhythmMetric = totalChange / result.comparisons;
+    }
+    return result;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "ofMain.h"
+#include "FeatureHandler.h"
+
+class VideoAnalysisSession {
+	// A VideoAnalysisSession opens a video once and decodes it forward in a single pass: the first frame becomes
+	// the thumbnail and the sampled frames feed the rhythm metric, so no per-video feature opens the file again.
+	// The decoder is OpenCV (it runs on the ingest workers, without a GL context), opened with open and read
+	// timeouts, and the whole pass has a deadline: a corrupt or endless file ends the session with a status
+	// instead of blocking the ingest.
+
+public:
+
+	enum Status {
+		SUCCEEDED,
+		TIMED_OUT, // the deadline stopped the pass, the features use the frames decoded so far
+		DECODE_ERROR, // a frame could not be decoded, the features use the frames before it
+		NO_FRAMES, // opened but not a single frame could be decoded
+		OPEN_FAILED
+	};
+
+	struct Result {
+		Status status = OPEN_FAILED;
+		std::string message; // why the session failed or stopped early, empty on SUCCEEDED
+		ofPixels thumbnail; // first frame, RGB, resized to the thumbnail size
+		float rhythmMetric = 0.0f; // 0 without at least two samples
+		int framesDecoded = 0;
+		int comparisons = 0;
+		int frameStride = 1;
+
+		bool isUsable() const { return status != OPEN_FAILED && status != NO_FRAMES; }; // the thumbnail is there
+	};
+
+	// CONSTRUCTORS
+
+	VideoAnalysisSession(const std::string& path, const FeatureHandler::RhythmOptions& options, std::pair<int, int> thumbnailSize = { 280, 280 })
+		: path(path), options(options), thumbnailSize(thumbnailSize) {};
+
+	// SESSION METHODS
+
+	Result run(); // blocks for at most about options.timeBudgetSeconds plus the open timeout
+	static std::string getStatusName(Status status);
+
+private:
+	std::string path;
+	FeatureHandler::RhythmOptions options;
+	std::pair<int, int> thumbnailSize;
+};
@@ -0,0 +1,265 @@
+#include "VideoPlayback.h"
+#include <opencv2/opencv.hpp>
+
+VideoPlayback::~VideoPlayback() {
+    clear();
+}
+
+void VideoPlayback::setup(size_t maxSessions, int queueFrames, float openTimeoutSeconds) {
+    clear();
+    this->maxSessions = std::max<size_t>(maxSessions, 1);
+    this->queueFrames = std::max(queueFrames, 2);
+    openTimeoutMs = std::max(1, int(openTimeoutSeconds * 1000));
+}
+
+void VideoPlayback::clear() {
+    std::vector<MediaId> ids;
+    for (const auto& pair : sessions) ids.push_back(pair.first);
+    for (MediaId id : ids) retire(id);
+    for (auto& session : retired) session->decoder.join(); // the open and read timeouts bound the wait
+    retired.clear();
+    closeAudio();
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// PLAYBACK
+// -------------------------------------------------------------------------------------------------------------------------
+
+void VideoPlayback::beginFrame() {
+    frame++;
+    Clock::time_point now = Clock::now();
+    double elapsedMs = std::chrono::duration<double, std::milli>(now - lastTick).count();
+    lastTick = now;
+
+    // Sessions not required since the previous frame are closed, the playing one stays until another one plays
+    std::vector<MediaId> unused;
+    for (const auto& pair : sessions) {
+        if (int(pair.first) != playing && pair.second->lastRequired + 1 < frame) unused.push_back(pair.first);
+    }
+    for (MediaId id : unused) retire(id);
+    retired.erase(std::remove_if(retired.begin(), retired.end(), [](std::unique_ptr<Session>& session) {
+        if (!session->finished) return false;
+        session->decoder.join();
+        return true;
+    }), retired.end());
+
+    for (auto& pair : sessions) {
+        Session& session = *pair.second;
+        if (int(pair.first) != playing || paused) {
+            if (session.current.index < 0) present(session, 0); // the first frame, shown until play()
+            continue;
+        }
+        clockMs += elapsedMs;
+        present(session, clockMs);
+        // A decoder behind the clock holds it at the frame shown: the video slows down instead of jumping ahead
+        if (!session.frames.front() && session.current.index >= 0) {
+            clockMs = std::min(clockMs, session.current.timeMs + session.frameMs);
+        }
+        syncAudio(session);
+    }
+}
+
+void VideoPlayback::require(MediaId id, const std::string& path) {
+    Session* session = open(id, path, true);
+    if (session) session->lastRequired = frame;
+}
+
+void VideoPlayback::play(MediaId id, const std::string& path) {
+    if (playing != int(id)) playing = -1; // the previous video keeps its position while its session stays open
+    Session* session = open(id, path, false);
+    if (!session) return;
+    session->lastRequired = frame;
+    if (playing != int(id)) {
+        playing = id;
+        clockMs = session->current.index >= 0 ? session->current.timeMs : 0;
+    }
+    paused = false;
+    lastTick = Clock::now();
+    openAudio(*session);
+    if (audioStarted) audio.setPaused(false);
+}
+
+void VideoPlayback::pause() {
+    paused = true;
+    if (audioStarted) audio.setPaused(true);
+}
+
+void VideoPlayback::close(MediaId id) {
+    retire(id);
+}
+
+VideoPlayback::Session* VideoPlayback::open(MediaId id, const std::string& path, bool preload) {
+    auto it = sessions.find(id);
+    if (it != sessions.end()) {
+        if (it->second->path == path) return it->second.get();
+        retire(id);
+    }
+
+    // Room for the new session: the least recently required one that is not playing is closed
+    if (sessions.size() >= maxSessions) {
+        Session* oldest = nullptr;
+        for (const auto& pair : sessions) {
+            if (int(pair.first) == playing || (preload && pair.second->lastRequired == frame)) continue;
+            if (!oldest || pair.second->lastRequired < oldest->lastRequired) oldest = pair.second.get();
+        }
+        if (!oldest) return nullptr;
+        retire(oldest->id);
+    }
+
+    std::unique_ptr<Session> session(new Session(queueFrames));
+    session->id = id;
+    session->path = path;
+    session->lastRequired = frame;
+    session->decoder = std::thread(&VideoPlayback::decodeLoop, session.get(), openTimeoutMs);
+    Session* opened = session.get();
+    sessions[id] = std::move(session);
+    return opened;
+}
+
+void VideoPlayback::retire(MediaId id) {
+    auto it = sessions.find(id);
+    if (it == sessions.end()) return;
+    std::unique_ptr<Session> session = std::move(it->second);
+    sessions.erase(it);
+    if (playing == int(id)) playing = -1;
+    if (audioId == int(id)) closeAudio();
+
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->stopping = true;
+    }
+    session->space.notify_one();
+    retired.push_back(std::move(session));
+}
+
+bool VideoPlayback::present(Session& session, double untilMs) {
+    bool changed = false;
+    Frame* next;
+    while ((next = session.frames.front()) && next->timeMs <= untilMs) {
+        session.frames.tryPop(session.current); // the buffer of the previous frame goes back to the decoder
+        changed = true;
+        if (frameObserver) frameObserver(session.id, session.current, session.totalFrames);
+    }
+    if (!changed) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(session.mutex); // a decoder about to wait sees the room before it sleeps
+    }
+    session.space.notify_one();
+
+    const ofPixels& pixels = session.current.pixels;
+    if (!session.texture.isAllocated() || session.texture.getWidth() != pixels.getWidth() || session.texture.getHeight() != pixels.getHeight()) {
+        session.texture.allocate(pixels);
+    }
+    session.texture.loadData(pixels);
+    return true;
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// AUDIO
+// -------------------------------------------------------------------------------------------------------------------------
+
+void VideoPlayback::openAudio(const Session& session) {
+    if (!playAudio || audioId == int(session.id)) return;
+    closeAudio();
+    audio.setUseTexture(false);
+    audio.setLoopState(OF_LOOP_NORMAL);
+    audio.loadAsync(session.path); // started by syncAudio once loaded, the main thread never waits for the file
+    audioId = session.id;
+}
+
+void VideoPlayback::syncAudio(const Session& session) {
+    if (audioId != int(session.id) || session.current.index < 0) return;
+    if (!audioStarted) {
+        if (!audio.isLoaded()) return;
+        audio.play();
+        audioStarted = true;
+    }
+
+    // Position of the frame shown within the loop; the decoder restarts its frame index at every loop like the player
+    float durationMs = audio.getDuration() * 1000;
+    if (durationMs <= 0) return;
+    double videoMs = std::fmod(session.current.index * double(session.frameMs), durationMs);
+    double audioMs = audio.getPosition() * durationMs;
+    if (std::abs(audioMs - videoMs) > audioSyncMs) audio.setPosition(float(videoMs / durationMs));
+}
+
+void VideoPlayback::closeAudio() {
+    if (audioId < 0) return;
+    audio.close();
+    audioId = -1;
+    audioStarted = false;
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// DECODE THREAD
+// -------------------------------------------------------------------------------------------------------------------------
+
+void VideoPlayback::decodeLoop(Session* session, int openTimeoutMs) {
+    // The timeouts make a stalled demuxer or decoder give up instead of blocking the session forever
+    std::string path = ofToDataPath(session->path, true);
+    std::vector<int> parameters = { cv::CAP_PROP_OPEN_TIMEOUT_MSEC, openTimeoutMs, cv::CAP_PROP_READ_TIMEOUT_MSEC, openTimeoutMs };
+    cv::VideoCapture video(path, cv::CAP_ANY, parameters);
+    if (!video.isOpened()) {
+        ofLogWarning() << "Cannot open the video " << session->path;
+        session->finished = true;
+        return;
+    }
+    double fps = video.get(cv::CAP_PROP_FPS);
+    if (fps > 0 && fps < 1000) session->frameMs = float(1000.0 / fps); // otherwise 30 fps
+    session->totalFrames = std::max(0, (int)video.get(cv::CAP_PROP_FRAME_COUNT));
+
+    Frame frame;
+    cv::Mat bgr;
+    int index = 0;
+    int decoded = 0;
+    double timeMs = 0;
+    while (!session->stopping) {
+        if (!video.read(bgr) || bgr.empty() || bgr.type() != CV_8UC3) {
+            if (index == 0) break; // not a single frame, or the video cannot start over
+            // Loops from the first frame, reopened if the container cannot seek
+            if (!video.set(cv::CAP_PROP_POS_FRAMES, 0)) video.open(path, cv::CAP_ANY, parameters);
+            index = 0;
+            continue;
+        }
+
+        // The slot gave back a buffer of an earlier frame, reallocated only if the size changed
+        if (frame.pixels.getWidth() != size_t(bgr.cols) || frame.pixels.getHeight() != size_t(bgr.rows)) {
+            frame.pixels.allocate(bgr.cols, bgr.rows, OF_PIXELS_RGB);
+        }
+        cv::Mat rgb(bgr.rows, bgr.cols, CV_8UC3, frame.pixels.getData());
+        cv::cvtColor(bgr, rgb, cv::COLOR_BGR2RGB);
+        frame.index = index++;
+        decoded++;
+        frame.timeMs = timeMs;
+        timeMs += session->frameMs;
+
+        std::unique_lock<std::mutex> lock(session->mutex);
+        while (!session->stopping && !session->frames.tryPush(frame)) {
+            session->space.wait_for(lock, std::chrono::milliseconds(50));
+        }
+    }
+    if (decoded == 0 && !session->stopping) ofLogWarning() << "Cannot decode the video " << session->path;
+    session->finished = true;
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// DRAWER
+// -------------------------------------------------------------------------------------------------------------------------
+
+bool VideoPlayback::draw(MediaId id, float x, float y, float width, float height) const {
+    auto it = sessions.find(id);
+    if (it == sessions.end() || !it->second->texture.isAllocated()) return false;
+    it->second->texture.draw(x, y, width, height);
+    return true;
+}
+
+int VideoPlayback::getCurrentFrame(MediaId id) const {
+    auto it = sessions.find(id);
+    return it != sessions.end() ? it->second->current.index : -1;
+}
+
+int VideoPlayback::getTotalFrames(MediaId id) const {
+    auto it = sessions.find(id);
+    return it != sessions.end() ? it->second->totalFrames.load() : 0;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "ofMain.h"
+#include "FeatureStore.h"
+#include "SpscRing.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+class VideoPlayback {
+	// The VideoPlayback plays the videos of the gallery without decoding on the main thread. Every opened video
+	// is a session with its own decode thread: OpenCV decodes and converts the frames ahead into a bounded
+	// SpscRing, each frame stamped with its presentation time, and the thread waits while the ring is full.
+	// beginFrame() advances the clock of the playing video by the wall time since the previous frame and presents
+	// the last frame that is due, so the speed of a video no longer depends on the frame rate of the app: frames
+	// of a slow app frame are skipped, and the clock waits for a decoder that falls behind instead of jumping.
+	// require() opens a video ahead of play(), like ThumbnailCache::require(): the gallery requires the selected
+	// video and its neighbours, whose first frames are then decoded before space is pressed. Sessions neither
+	// playing nor required in the previous frame are closed; their threads are joined once they finish, so a
+	// decoder blocked in a slow open never stalls the main thread.
+	// OpenCV decodes no audio: the sound of the playing video comes from an ofVideoPlayer whose frames are never
+	// read, started once loaded, paused with the video and moved back to its frame when it drifts by audioSyncMs.
+	// Main thread only, apart from the decode threads which only touch their session.
+
+public:
+
+	struct Frame {
+		ofPixels pixels; // RGB, the buffers circulate between the decode thread and the main thread
+		int index = -1; // in the video, restarts at 0 when the video loops
+		double timeMs = 0; // presentation time since the session opened, keeps growing across loops
+	};
+
+	// CONSTRUCTORS
+
+	VideoPlayback() {};
+	~VideoPlayback();
+	VideoPlayback(const VideoPlayback&) = delete;
+	VideoPlayback& operator=(const VideoPlayback&) = delete;
+
+	void setup(size_t maxSessions, int queueFrames, float openTimeoutSeconds);
+
+	// PLAYBACK METHODS
+
+	void beginFrame(); // call once per frame, before the require calls: presents the due frames, closes the sessions not required
+	void require(MediaId id, const std::string& path); // opens the video in the background, ready to play
+	void play(MediaId id, const std::string& path); // starts or resumes the video, pausing the one playing
+	void pause();
+	void close(MediaId id); // the file changed or was deleted
+	void clear(); // closes every session
+
+	// DRAWER METHODS
+
+	bool draw(MediaId id, float x, float y, float width, float height) const; // false until a frame of the video is decoded
+
+	// ATTRIBUTES
+
+	int getPlaying() const { return playing; }; // id of the video playing or paused, -1 if none
+	bool isPaused() const { return paused; };
+	int getCurrentFrame(MediaId id) const; // index of the frame shown, -1 before the first one
+	int getTotalFrames(MediaId id) const; // 0 when the container does not tell
+	size_t size() const { return sessions.size(); };
+
+	bool playAudio = true; // false: the videos play muted, no audio player is opened
+	float audioSyncMs = 100; // drift of the audio from the frame shown before it is moved back
+
+	// Called with every frame taken from the queue of a session, in decoding order, including the skipped ones
+	std::function<void(MediaId id, const Frame& frame, int totalFrames)> frameObserver;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Session {
+		Session(int queueFrames) : frames(queueFrames) {};
+
+		MediaId id = 0;
+		std::string path;
+		std::thread decoder;
+		SpscRing<Frame> frames;
+		std::mutex mutex; // only for space
+		std::condition_variable space; // signalled when a frame is popped
+		std::atomic<bool> stopping{ false };
+		std::atomic<bool> finished{ false }; // the decode thread returned
+		std::atomic<int> totalFrames{ 0 };
+		std::atomic<float> frameMs{ 1000.0f / 30 };
+
+		// Main thread only
+		Frame current; // shown frame
+		ofTexture texture;
+		uint64_t lastRequired = 0;
+	};
+
+	static void decodeLoop(Session* session, int openTimeoutMs);
+	// The existing session of id, or a new one. Preloads only close the sessions not required in this frame, nullptr if there are none
+	Session* open(MediaId id, const std::string& path, bool preload);
+	void retire(MediaId id); // stops the decode thread, joined once it finished
+	bool present(Session& session, double untilMs); // pops the frames due at untilMs, true if the shown frame changed
+	void openAudio(const Session& session);
+	void syncAudio(const Session& session); // starts the audio once loaded and keeps it on the frame shown
+	void closeAudio();
+
+	std::unordered_map<MediaId, std::unique_ptr<Session>> sessions;
+	std::vector<std::unique_ptr<Session>> retired; // stopping, not joined yet
+	size_t maxSessions = 3;
+	int queueFrames = 8;
+	int openTimeoutMs = 5000;
+	uint64_t frame = 0;
+
+	int playing = -1;
+	bool paused = false;
+	double clockMs = 0; // presentation time of the playing video
+	Clock::time_point lastTick;
+
+	ofVideoPlayer audio; // sound of the playing video, its frames are never read
+	int audioId = -1; // video loaded in audio, -1 if none
+	bool audioStarted = false;
+};
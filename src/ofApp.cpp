@@ -1,12 +1,22 @@
 #include "ofApp.h"
 #include "MotionDetection.h"
+#include "IngestPipeline.h"
+
+// Sort orders cycled with 'o', the first one keeps the directory order
+static const std::vector<std::pair<std::string, std::vector<FeatureType>>> sortModes = {
+    { "directory order", {} },
+    { "luminance", { LUMINANCE } },
+    { "dominant hue", { COLOR } },
+    { "texture", { TEXTURE } },
+    { "edge density", { EDGE } },
+    { "color variety", { RGBHISTOGRAM } },
+    { "luminance, then texture", { LUMINANCE, TEXTURE } },
+};
 
 //--------------------------------------------------------------
 void ofApp::setup() {
 
-    dir.listDir("images/of_logos/"); // Media directory
-    dir.allowExt("jpg");
-    dir.allowExt("mp4");
+    loadSettings();
 
     if (!videoIcon.load("video_icon.png")) {
         ofLogError() << "Failed to load video_icon.png";
@@ -15,64 +25,423 @@ void ofApp::setup() {
     ofSetVerticalSync(true);
     ofBackground(ofColor::black);
 
-    FeatureHandler featureHandler; // Create a handler instance
+    sections.update = profiler.addSection("update");
+    sections.mediaChanges = profiler.addSection("media changes");
+    sections.gestures = profiler.addSection("gestures");
+    sections.video = profiler.addSection("video");
+    sections.timeline = profiler.addSection("timeline");
+    sections.draw = profiler.addSection("draw");
+    sections.caches = profiler.addSection("caches");
+    sections.debugCameras = profiler.addSection("cameras");
+    sections.tiles = profiler.addSection("tiles");
+    sections.overlays = profiler.addSection("overlays");
+    sections.info = profiler.addSection("xml info");
+    sections.fullscreen = profiler.addSection("fullscreen");
 
     motionDetection.SetupMotionDetection();
+    thumbnailCache.setup(thumbnailCacheSize, thumbnailThreads, standardImageSize, rhythmOptions.openTimeoutSeconds);
+    videoPlayback.setup(videoSessions, videoQueueFrames, rhythmOptions.openTimeoutSeconds);
+    screenImageCache.setup(screenImageCacheSize, 1, { ofGetScreenWidth(), ofGetScreenHeight() }, rhythmOptions.openTimeoutSeconds);
+
+    // Collect the supported files, then decode and extract their features on all cores
+    std::vector<std::string> paths;
+    for (const auto& directory : mediaDirectories) {
+        std::vector<std::string> directoryPaths = IngestPipeline::listMediaFiles(directory, mediaRecursive);
+        paths.insert(paths.end(), directoryPaths.begin(), directoryPaths.end());
+    }
 
-	updateMediaMatrix(); // Initialize media matrix
+    // The feature columns of the last run give back the rows of the unchanged files without reading them,
+    // only the other files go through the ingest (and the FeatureCache)
+    featureStore.analysisSettings = FeatureHandler::getAnalysisSettings(rhythmOptions, standardImageSize);
+    FeatureStore storedFeatures(featureStore.edgeGridRows, featureStore.edgeGridCols);
+    storedFeatures.analysisSettings = featureStore.analysisSettings; // the rows of other settings are analysed again
+    std::vector<std::string> storedPaths;
+    std::unordered_map<std::string, MediaId> storedRows;
+    if (!featureColumns.empty() && storedFeatures.map(featureColumns, storedPaths)) {
+        for (MediaId row = 0; row < storedPaths.size(); row++) storedRows[storedPaths[row]] = row;
+    }
+    std::vector<int64_t> rowOfPath(paths.size(), -1);
+    std::vector<std::string> missingPaths;
+    for (size_t i = 0; i < paths.size(); i++) {
+        auto stored = storedRows.find(paths[i]);
+        if (stored != storedRows.end() && storedFeatures.isFileUnchanged(stored->second, paths[i])) rowOfPath[i] = stored->second;
+        else missingPaths.push_back(paths[i]);
+    }
 
-    for (int i = 0; i < dir.size(); i++) {
-        string filePath = dir.getPath(i);
-        string extension = ofToLower(ofFilePath::getFileExt(filePath));
+    featureCache.rhythmOptions = rhythmOptions;
+    featureCache.imageSize = standardImageSize;
+    featureCache.load();
+    IngestPipeline ingestPipeline(ingestThreads, standardImageSize, &featureCache);
+    ingestPipeline.rhythmOptions = rhythmOptions;
+    ingestPipeline.releaseImages = true; // only the tiles around the viewport keep their pixels, see ThumbnailCache
+    std::vector<MediaElement> ingested = ingestPipeline.ingest(missingPaths);
+    ofLogNotice() << "Feature columns: " << paths.size() - missingPaths.size() << " files unchanged, feature cache: "
+        << featureCache.getHits() << " hits, " << featureCache.getMisses() << " misses";
+    featureCache.save(missingPaths.size() == paths.size()); // entries of the files restored from the columns were not used
+
+    // Merged in directory order. When every file is unchanged and in the same order the mapped store is taken as is
+    bool sameRows = missingPaths.empty() && storedPaths == paths && storedFeatures.getHistogramEncoding() == histogramEncoding;
+    FeatureStore mergedFeatures(featureStore.edgeGridRows, featureStore.edgeGridCols, histogramEncoding);
+    size_t nextIngested = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
         MediaElement media;
+        if (rowOfPath[i] >= 0) {
+            IngestPipeline::createElement(paths[i], media);
+            if (!sameRows) mergedFeatures.add(storedFeatures, rowOfPath[i]);
+        }
+        else if (nextIngested < ingested.size() && (ingested[nextIngested].isVideo() ? ingested[nextIngested].videoPath : ingested[nextIngested].filePath) == paths[i]) {
+            media = std::move(ingested[nextIngested++]);
+            mergedFeatures.add(std::move(media.features));
+        }
+        else {
+            continue; // the ingest dropped it
+        }
+        media.uploadTextures(); // textures can only be created on the main thread
+        mediaIds[paths[i]] = medias.size(); // the id of a media is its index in medias and its row in the store
+        medias.push_back(std::move(media));
+    }
+    featureStore.swap(sameRows ? storedFeatures : mergedFeatures);
+    storedFeatures.clear(); // unmaps the file read above, Windows cannot replace a mapped file
+    removedMedias.assign(medias.size(), false);
+    if (sameRows) savedRevision = featureStore.getRevision();
+    else saveFeatureColumns();
+
+    // Videos played in the previous runs keep the rhythm of their timeline, refined by every playback
+    rhythmTimeline.sampleSize = rhythmOptions.sampleSize;
+    rhythmTimeline.load();
+    for (MediaId id = 0; id < medias.size(); id++) {
+        if (medias[id].isVideo()) applyRhythmTimeline(id);
+    }
+    // Every decoded frame extends the timeline of its video, also the ones skipped to keep up
+    videoPlayback.frameObserver = [this](MediaId id, const VideoPlayback::Frame& frame, int totalFrames) {
+        FrameProfiler::Scope scope(profiler, sections.timeline);
+        if (rhythmTimeline.observe(medias[id].videoPath, frame.pixels, frame.index, totalFrames)) applyRhythmTimeline(id);
+    };
+
+    // Files dropped in the directories from now on are ingested in the background, see applyMediaChanges()
+    if (watchMedia) {
+        mediaWatcher.rhythmOptions = rhythmOptions;
+        mediaWatcher.setup(mediaDirectories, mediaRecursive, paths, standardImageSize, &featureCache);
+    }
+
+    applySortMode(); // Initialize display order and media matrix
+}
 
-        if (extension == "jpg") {
-            ofImage img;
-            img.load(filePath);
-            media = MediaElement(img, standardImageSize.first, standardImageSize.second, filePath);
+void ofApp::loadSettings() {
+    ofxXmlSettings settings;
+    if (!settings.load("settings.xml")) return; // keep the defaults
+
+    settings.pushTag("settings");
+    if (settings.getNumTags("mediaDirectory") > 0) {
+        mediaDirectories.clear();
+        for (int i = 0; i < settings.getNumTags("mediaDirectory"); i++) {
+            mediaDirectories.push_back(settings.getValue("mediaDirectory", "", i));
         }
-        else if (extension == "mp4") {
-            media = MediaElement(filePath);
+    }
+    mediaRecursive = settings.getValue("mediaRecursive", int(mediaRecursive)) != 0;
+    watchMedia = settings.getValue("watchMedia", int(watchMedia)) != 0;
+    mediaWatcher.debounceMs = settings.getValue("watchDebounce", mediaWatcher.debounceMs);
+    mediaWatcher.pollIntervalMs = settings.getValue("watchPollInterval", mediaWatcher.pollIntervalMs);
+    ingestThreads = settings.getValue("ingestThreads", ingestThreads);
+    featureCache.cachePath = settings.getValue("featureCache", featureCache.cachePath);
+    featureColumns = settings.getValue("featureColumns", featureColumns);
+    std::string encodingName = settings.getValue("histogramEncoding", std::string());
+    if (!encodingName.empty() && !FeatureStore::parseHistogramEncoding(encodingName, histogramEncoding)) {
+        ofLogWarning() << "Unknown histogramEncoding " << encodingName << ", use float32, float16 or uint8";
+    }
+    rhythmOptions.frameStride = settings.getValue("rhythmFrameStride", rhythmOptions.frameStride);
+    rhythmOptions.maxSamples = settings.getValue("rhythmMaxSamples", rhythmOptions.maxSamples);
+    rhythmOptions.timeBudgetSeconds = settings.getValue("rhythmTimeBudget", rhythmOptions.timeBudgetSeconds);
+    rhythmOptions.openTimeoutSeconds = settings.getValue("videoOpenTimeout", rhythmOptions.openTimeoutSeconds);
+    rhythmTimeline.timelinePath = settings.getValue("rhythmTimelines", rhythmTimeline.timelinePath);
+    rhythmTimeline.minCoverage = settings.getValue("timelineMinCoverage", rhythmTimeline.minCoverage);
+    videoSessions = settings.getValue("videoSessions", videoSessions);
+    videoQueueFrames = settings.getValue("videoQueueFrames", videoQueueFrames);
+    videoPlayback.playAudio = settings.getValue("videoAudio", int(videoPlayback.playAudio)) != 0;
+    thumbnailCacheSize = settings.getValue("thumbnailCacheSize", thumbnailCacheSize);
+    thumbnailThreads = settings.getValue("thumbnailThreads", thumbnailThreads);
+    motionDetection.replayPath = settings.getValue("gestureReplay", motionDetection.replayPath);
+    settings.popTag(); // settings
+}
+
+void ofApp::saveFeatureColumns() {
+    if (featureColumns.empty()) return;
+    std::vector<std::string> paths(medias.size());
+    for (MediaId id = 0; id < medias.size(); id++) {
+        if (!removedMedias[id]) paths[id] = medias[id].isVideo() ? medias[id].videoPath : medias[id].filePath;
+    }
+    if (!featureStore.save(featureColumns, paths)) {
+        ofLogError() << "Cannot save the feature columns to " << featureColumns;
+        return; // tried again on exit
+    }
+    savedRevision = featureStore.getRevision();
+}
+
+void ofApp::applyRhythmTimeline(MediaId id) {
+    float metric = 0;
+    if (rhythmTimeline.getRhythmMetric(medias[id].videoPath, featureStore.rhythmFrameStride[id], metric)) featureStore.setRhythmMetric(id, metric);
+}
+
+void ofApp::exit() {
+    mediaWatcher.stop();
+    if (missingFeatureThread.joinable()) missingFeatureThread.join(); // its features are lost, the cache keeps the ones computed
+    videoPlayback.clear();
+    rhythmTimeline.save();
+    if (featureStore.getRevision() != savedRevision) {
+        saveFeatureColumns(); // lazy edge maps and the media changes of this run
+    }
+}
+
+bool ofApp::requestMissingFeature(FeatureType feature) {
+    if (missingFeatureThread.joinable()) return false; // one pass at a time, mergeMissingFeature calls again
+
+    std::vector<IngestPipeline::MissingFeature> missing = IngestPipeline::listMissingFeature(medias, featureStore, feature);
+    undecodableMedias.resize(medias.size(), false);
+    missing.erase(std::remove_if(missing.begin(), missing.end(), [this](const IngestPipeline::MissingFeature& entry) {
+        return removedMedias[entry.id] || undecodableMedias[entry.id];
+    }), missing.end());
+    if (missing.empty()) return true;
+
+    // The files are decoded again on the ingest threads, the gallery keeps drawing meanwhile
+    ofLogNotice() << "Computing a missing feature of " << missing.size() << " media in the background";
+    missingFeatures = std::move(missing);
+    missingFeatureType = feature;
+    changedWhileComputing.clear();
+    missingFeatureDone = false;
+    missingFeatureThread = std::thread([this]() {
+        IngestPipeline ingestPipeline(ingestThreads, standardImageSize, &featureCache);
+        ingestPipeline.rhythmOptions = rhythmOptions; // the open timeout of the videos
+        ingestPipeline.computeMissingFeature(missingFeatures, missingFeatureType);
+        missingFeatureDone = true;
+    });
+    return false;
+}
+
+void ofApp::mergeMissingFeature() {
+    if (!missingFeatureThread.joinable() || !missingFeatureDone) return;
+    missingFeatureThread.join();
+
+    for (auto& entry : missingFeatures) {
+        if (std::find(changedWhileComputing.begin(), changedWhileComputing.end(), entry.id) != changedWhileComputing.end()) {
+            entry.computed = false; // the next request computes it from the new file
         }
+        else if (!entry.computed) {
+            undecodableMedias[entry.id] = true;
+        }
+    }
+    IngestPipeline::mergeMissingFeature(missingFeatures, featureStore, missingFeatureType);
+    missingFeatures.clear();
+    featureCache.save(false); // keep them for the next launch
 
-        else {
-            continue; // Skip unsupported formats
+    if (sortWaitsForFeatures) {
+        sortWaitsForFeatures = false;
+        applySortMode();
+    }
+    if (similarWaitsForFeatures) {
+        similarWaitsForFeatures = false;
+        if (showSimilar) {
+            findSimilar();
+            updateMediaMatrix();
         }
+    }
+}
+
+void ofApp::applySortMode() {
+    // The lazy features are computed in the background: the current order stays until they are merged
+    const auto& features = sortModes[sortMode].second;
+    bool ready = true;
+    for (FeatureType feature : features) {
+        ready = requestMissingFeature(feature) && ready;
+    }
+    if (!ready) {
+        sortWaitsForFeatures = true;
+        if (!displayOrder.empty()) return;
+    }
+    if (features.empty() || !ready) {
+        displayOrder.resize(featureStore.size());
+        for (MediaId id = 0; id < displayOrder.size(); id++) displayOrder[id] = id;
+    }
+    else {
+        displayOrder = featureHandler.sortByFeatures(featureStore, features);
+    }
+    displayOrder.erase(std::remove_if(displayOrder.begin(), displayOrder.end(), [this](MediaId id) { return removedMedias[id]; }),
+        displayOrder.end());
+    updateMediaMatrix();
+}
 
-        // Extract all relevant features using the handler
-        featureHandler.computeAllFeatures(media);
+void ofApp::findSimilar() {
+    similarMedias.clear();
+    if (medias.empty() || currentMedia < 0) return;
 
-        medias.push_back(media); // Store processed media
+    // The descriptors need the edge maps, which are lazy: until they are computed the query is shown alone
+    if (!requestMissingFeature(EDGE)) {
+        similarWaitsForFeatures = true;
+        similarMedias.push_back(currentMedia);
+        return;
+    }
 
+    // Built on first use, then the media that came since are added
+    if (similarityIndex.size() == 0) {
+        similarityIndex.build(featureStore);
+        unindexedMedias.clear();
+    }
+    else if (!unindexedMedias.empty()) {
+        std::sort(unindexedMedias.begin(), unindexedMedias.end());
+        unindexedMedias.erase(std::unique(unindexedMedias.begin(), unindexedMedias.end()), unindexedMedias.end());
+        for (MediaId id : unindexedMedias) {
+            if (!removedMedias[id]) similarityIndex.add(id, SimilarityIndex::makeDescriptor(featureStore, id));
+        }
+        unindexedMedias.clear();
     }
+
+    // The index returns candidates from the reduced descriptors, they are reranked with the full ones
+    std::vector<float> descriptor = SimilarityIndex::makeDescriptor(featureStore, currentMedia);
+    uint64_t startTime = ofGetElapsedTimeMicros();
+    auto neighbours = similarityIndex.query(descriptor, similarCount, currentMedia, [&](int id) {
+        return SimilarityIndex::descriptorDistance(descriptor, SimilarityIndex::makeDescriptor(featureStore, id));
+    });
+
+    similarMedias.push_back(currentMedia);
+    for (const auto& neighbour : neighbours) {
+        if (!removedMedias[neighbour.id]) similarMedias.push_back(neighbour.id);
+    }
+    ofLogNotice() << "Found " << neighbours.size() << " similar media in " << (ofGetElapsedTimeMicros() - startTime) / 1000.0f << " ms";
 }
 
 
+void ofApp::applyMediaChanges() {
+    // Only the layout is patched: a new media goes at the end of its group until the next sort
+    std::vector<MediaWatcher::Change> changes = mediaWatcher.poll();
+    if (changes.empty()) return;
+
+    for (auto& change : changes) {
+        auto known = mediaIds.find(change.path);
+        rhythmTimeline.forget(change.path); // its frames changed, or are gone
+        if (change.type == MediaWatcher::REMOVED) {
+            if (known != mediaIds.end() && !removedMedias[known->second]) removeMedia(known->second);
+            continue;
+        }
+
+        MediaElement& media = change.media;
+        media.uploadTextures(); // built on the watcher thread
+        if (known == mediaIds.end()) {
+            MediaId id = medias.size();
+            featureStore.add(std::move(media.features));
+            medias.push_back(std::move(media));
+            removedMedias.push_back(false);
+            mediaIds[change.path] = id;
+            displayOrder.push_back(id);
+            if (!showSimilar) galleryLayout.insert(id);
+            if (similarityIndex.size() > 0) unindexedMedias.push_back(id);
+            continue;
+        }
+
+        // Changed, or deleted then created again: the file keeps its id
+        MediaId id = known->second;
+        videoPlayback.close(id);
+        thumbnailCache.forget(id, medias);
+        screenImageCache.forget(id, medias);
+        overlayCache.forget(id, medias);
+        bool regroup = featureStore.luminanceGroup[id] != media.features.luminanceGroup
+            || featureStore.colorGroup[id] != media.features.colorGroup || featureStore.textureGroup[id] != media.features.textureGroup;
+        featureStore.set(id, std::move(media.features));
+        medias[id] = std::move(media);
+        if (missingFeatureThread.joinable()) changedWhileComputing.push_back(id);
+        if (id < undecodableMedias.size()) undecodableMedias[id] = false;
+        similarityIndex.remove(id); // its histograms changed
+        if (similarityIndex.size() > 0) unindexedMedias.push_back(id);
+
+        if (removedMedias[id]) {
+            removedMedias[id] = false;
+            displayOrder.push_back(id);
+            if (!showSimilar) galleryLayout.insert(id);
+        }
+        else if (regroup && !showSimilar) {
+            galleryLayout.remove(id);
+            galleryLayout.insert(id);
+        }
+    }
+    // The selection moves to the tile that took the place of a deleted media, or to the first one that came
+    const auto& rows = galleryLayout.getRows();
+    if (currentMedia < 0 || (currentMedia < removedMedias.size() && removedMedias[currentMedia])) {
+        if (rows.empty()) { // the last media was deleted: nothing is selected
+            currentMedia = -1;
+            selectedRow = selectedCol = 0;
+            return;
+        }
+        int row = std::min<int>(selectedRow, rows.size() - 1);
+        currentMedia = rows[row][std::min<int>(selectedCol, rows[row].size() - 1)];
+    }
+    GalleryLayout::GridPosition position = galleryLayout.locate(currentMedia);
+    if (position.row >= 0) {
+        selectedRow = position.row;
+        selectedCol = position.col;
+    }
+}
+
+void ofApp::removeMedia(MediaId id) {
+    removedMedias[id] = true;
+    displayOrder.erase(std::remove(displayOrder.begin(), displayOrder.end(), id), displayOrder.end());
+    similarMedias.erase(std::remove(similarMedias.begin(), similarMedias.end(), id), similarMedias.end());
+    galleryLayout.remove(id);
+    similarityIndex.remove(id);
+
+    videoPlayback.close(id);
+    thumbnailCache.forget(id, medias);
+    screenImageCache.forget(id, medias);
+    overlayCache.forget(id, medias);
+}
+
 //--------------------------------------------------------------
 void ofApp::update() {
+    profiler.beginFrame(); // update() starts every frame of the loop
+    FrameProfiler::Scope updateScope(profiler, sections.update);
 
-    motionDetection.UpdateMotionDetection(mediaMatrix, selectedRow, selectedCol, currentMedia, medias);
-    // if a video is playing, update it
-
-    if (currentVideoPlaying && !currentVideoPlaying->isPaused) {
-        currentVideoPlaying->videoPlayer.nextFrame();
-        currentVideoPlaying->videoPlayer.update();
+    {
+        FrameProfiler::Scope scope(profiler, sections.mediaChanges);
+        applyMediaChanges();
+        mergeMissingFeature();
+    }
+    {
+        FrameProfiler::Scope scope(profiler, sections.gestures);
+        motionDetection.UpdateMotionDetection(galleryLayout.getRows(), selectedRow, selectedCol, currentMedia, medias);
+    }
+    {
+        // Shows the frames of the playing video that are due, decoded on the threads of videoPlayback
+        FrameProfiler::Scope scope(profiler, sections.video);
+        videoPlayback.beginFrame();
     }
-    updateMediaMatrix();
 }
 
 //--------------------------------------------------------------
 void ofApp::draw() {
-    motionDetection.DrawDebugCameras();
+    FrameProfiler::Scope drawScope(profiler, sections.draw);
+    {
+        FrameProfiler::Scope scope(profiler, sections.caches);
+        overlayCache.beginFrame();
+        thumbnailCache.beginFrame(medias);
+        screenImageCache.beginFrame(medias);
+    }
+    {
+        FrameProfiler::Scope scope(profiler, sections.debugCameras);
+        motionDetection.DrawDebugCameras();
+    }
+    if (showProfiler) {
+        profiler.draw(350, 10); // next to the debug cameras
+    }
     if (medias.empty()) return;
     if (fullscreenMode) {
+        FrameProfiler::Scope scope(profiler, sections.fullscreen);
         drawSelectedMediaFullscreen();
         return;
     }
 
     std::string groupingInfo;
 
-    if (groupByLuminance) {
+    if (showSimilar) {
+        groupingInfo = "Similar media: most similar first, press 'n' to go back";
+    }
+    else if (groupByLuminance) {
         auto luminanceNames = getLuminanceGroupNames();
         groupingInfo = "Luminance grouping active: rows represent ";
         int count = 0;
@@ -103,113 +472,112 @@ void ofApp::draw() {
         groupingInfo = "No grouping active: all media in one row";
     }
 
+    if (!showSimilar && sortMode != 0) {
+        groupingInfo += ", sorted by " + sortModes[sortMode].first;
+    }
+
     ofSetColor(255);
     ofDrawBitmapStringHighlight(groupingInfo, 10, 20);  // Draw at the top-left corner
 
-    bool groupingActive = groupByLuminance || groupByColor || groupByTexture;
-
-    // Build grouped matrix
-    mediaMatrix.clear();
-    std::array<std::vector<MediaElement*>, 3> groupedMedias;
-
-    if (groupByLuminance) {
-        for (auto& media : medias) groupedMedias[media.luminanceGroup].push_back(&media);
-    }
-    else if (groupByColor) {
-        for (auto& media : medias) groupedMedias[media.colorGroup].push_back(&media);
-    }
-    else if (groupByTexture) {
-        for (auto& media : medias) groupedMedias[media.textureGroup].push_back(&media);
-    }
-    else {
-        for (auto& media : medias) groupedMedias[0].push_back(&media);
-    }
-
-    for (int row = 0; row < 3; ++row) {
-        if (!groupedMedias[row].empty()) {
-            mediaMatrix.push_back(groupedMedias[row]);
-        }
-    }
+    const auto& mediaMatrix = galleryLayout.getRows(); // rebuilt by updateMediaMatrix() only when the grouping changes
 
     int rowHeight = standardImageSize.second + margin;
     int baseY = (ofGetHeight() - mediaMatrix.size() * rowHeight) / 2;
 
     int viewWidth = ofGetWidth();
 
-    // Get currently selected media pointer
-    MediaElement* current = &medias[currentMedia];
+    MediaId current = currentMedia;
 
     // === Auto-scroll to selected media ===
-    for (int row = 0; row < mediaMatrix.size(); ++row) {
-        for (int col = 0; col < mediaMatrix[row].size(); ++col) {
-            if (mediaMatrix[row][col] == current) {
-                selectedRow = row;
-                selectedCol = col;
-                int selectedX = margin + col * (standardImageSize.first + margin);
-                if (selectedX - scrollOffsetX < 0) {
-                    scrollOffsetX = selectedX;
-                }
-                else if (selectedX - scrollOffsetX + standardImageSize.first > viewWidth) {
-                    scrollOffsetX = selectedX - (viewWidth - standardImageSize.first - margin);
-                }
-                break;
-            }
+    GalleryLayout::GridPosition position = galleryLayout.locate(current);
+    if (position.row >= 0) {
+        selectedRow = position.row;
+        selectedCol = position.col;
+        int selectedX = margin + position.col * (standardImageSize.first + margin);
+        if (selectedX - scrollOffsetX < 0) {
+            scrollOffsetX = selectedX;
+        }
+        else if (selectedX - scrollOffsetX + standardImageSize.first > viewWidth) {
+            scrollOffsetX = selectedX - (viewWidth - standardImageSize.first - margin);
         }
     }
 
     // === Draw all rows ===
+    FrameProfiler::Scope tilesScope(profiler, sections.tiles); // includes the overlays, also timed on their own
     for (int row = 0; row < mediaMatrix.size(); ++row) {
         int x_pos = margin - scrollOffsetX;
         int y_pos = baseY + row * rowHeight;
 
         // === Row label ===
         std::string rowLabel = "";
-        if (groupByLuminance) rowLabel = getLuminanceGroupNames().at(static_cast<LuminanceGroup>(row));
-        else if (groupByColor) rowLabel = getColorGroupNames().at(static_cast<ColorGroup>(row));
-        else if (groupByTexture) rowLabel = getTextureGroupNames().at(static_cast<TextureGroup>(row));
+        if (showSimilar) rowLabel = "Similar";
+        else if (groupByLuminance) rowLabel = getLuminanceGroupNames().at(static_cast<LuminanceGroup>(galleryLayout.getRowGroup(row)));
+        else if (groupByColor) rowLabel = getColorGroupNames().at(static_cast<ColorGroup>(galleryLayout.getRowGroup(row)));
+        else if (groupByTexture) rowLabel = getTextureGroupNames().at(static_cast<TextureGroup>(galleryLayout.getRowGroup(row)));
         else rowLabel = "All";
 
         ofSetColor(255);
         ofDrawBitmapString(rowLabel + " group", 10, y_pos + standardImageSize.second / 2);
 
-        for (int col = 0; col < mediaMatrix[row].size(); ++col) {
-            MediaElement* media = mediaMatrix[row][col];
-            int drawX = margin + col * (standardImageSize.first + margin) - scrollOffsetX;
-            int drawY = y_pos;
-
-            if (drawX + standardImageSize.first < 0 || drawX > ofGetWidth()) continue;
+        // Only the columns inside the viewport are visited
+        int tileStride = standardImageSize.first + margin;
+        int firstCol = std::max(0, (scrollOffsetX - margin - standardImageSize.first) / tileStride);
+        int lastCol = std::min<int>(mediaMatrix[row].size() - 1, (scrollOffsetX + viewWidth - margin) / tileStride);
 
-            std::string luminanceString = getLuminanceGroupNames().at(media->luminanceGroup) +
-                " luminance (" + std::to_string(media->averageLuminance) + ")";
-            std::string colorString = getColorGroupNames().at(media->colorGroup) + " dominant color ";
+        for (int col = firstCol; col <= lastCol; ++col) {
+            MediaId id = mediaMatrix[row][col];
+            MediaElement* media = &medias[id];
+            int drawX = margin + col * tileStride - scrollOffsetX;
+            int drawY = y_pos;
 
-            if (media == current) {
+            if (drawX + standardImageSize.first < 0 || drawX > viewWidth) continue;
+
+            std::string luminanceString = getLuminanceGroupNames().at(static_cast<LuminanceGroup>(featureStore.luminanceGroup[id])) +
+                " luminance (" + std::to_string(featureStore.averageLuminance[id]) + ")";
+            std::string colorString = getColorGroupNames().at(static_cast<ColorGroup>(featureStore.colorGroup[id])) + " dominant color ";
+
+            if (!thumbnailCache.require(id, medias)) {
+                // Thumbnail still loading: a tile of the dominant color, outlined when selected
+                ofSetColor(featureStore.dominantColor[id], 96);
+                ofDrawRectangle(drawX, drawY, standardImageSize.first, standardImageSize.second);
+                if (id == current) {
+                    ofNoFill();
+                    ofSetColor(ofColor::white);
+                    ofDrawRectangle(drawX, drawY, standardImageSize.first, standardImageSize.second);
+                    ofFill();
+                }
+                ofSetColor(ofColor::white);
+            }
+            else if (id == current) {
                 media->drawImageWithContour(drawX, drawY);
             }
             else if (showDominantColor) {
-                media->drawImageWithContour(drawX, drawY, media->dominantColor);
+                media->drawImageWithContour(drawX, drawY, featureStore.dominantColor[id]);
             }
             else {
                 media->drawImage(drawX, drawY);
             }
 
             if (showDominantColor) {
-                ofDrawBitmapString(colorString, drawX + 5, drawY + media->image.getHeight() - 5);
+                ofDrawBitmapString(colorString, drawX + 5, drawY + standardImageSize.second - 5);
             }
 
             if (media->isVideo()) {
-                int iconX = drawX + media->image.getWidth() - iconSize - 5;
+                int iconX = drawX + standardImageSize.first - iconSize - 5;
                 int iconY = drawY + 5;
                 ofSetColor(255);
                 videoIcon.draw(iconX, iconY, iconSize, iconSize);
             }
 
-            if (showEdgeHist) {
-                media->drawEdgeMap(drawX, drawY, standardImageSize.first, standardImageSize.second);
+            FrameProfiler::Scope overlaysScope(profiler, sections.overlays);
+            if (showEdgeHist && overlayCache.requireEdgeMap(id, medias, featureStore)) {
+                featureStore.drawEdgeMap(id, drawX, drawY, standardImageSize.first, standardImageSize.second);
             }
 
             if (showLuminanceMap) {
-                media->drawLuminanceMap(drawX, drawY);
+                if (overlayCache.requireLuminanceMap(id, medias)) {
+                    media->drawLuminanceMap(drawX, drawY);
+                }
                 ofDrawBitmapString(luminanceString, drawX, drawY - 10);
             }
 
@@ -217,13 +585,23 @@ void ofApp::draw() {
                 int histW = 150;
                 int histH = 400;
                 int histX = drawX + 5;
-                int histY = drawY + media->image.getHeight() - histH - 5;
+                int histY = drawY + standardImageSize.second - histH - 5;
                 ofSetColor(255);
-                media->drawNormalizedRGBHistogram(histX, histY + histH, histW, histH);
+                featureStore.drawNormalizedRGBHistogram(id, histX, histY + histH, histW, histH);
             }
         }
+
+        // Load the next tiles on both sides ahead of the scroll
+        for (int col = std::max(0, firstCol - prefetchTiles); col < firstCol; ++col) {
+            thumbnailCache.require(mediaMatrix[row][col], medias);
+        }
+        for (int col = lastCol + 1; col < std::min<int>(mediaMatrix[row].size(), lastCol + 1 + prefetchTiles); ++col) {
+            thumbnailCache.require(mediaMatrix[row][col], medias);
+        }
     }
 
+    tilesScope.stop();
+
     if (showLegend) {
         drawLegend();
     }
@@ -235,8 +613,9 @@ void ofApp::draw() {
         ofDrawBitmapString(hint, x, y);
     }
     // Draw the currently selected media info box
-    if (showInfoWindow && current != nullptr) {
-        drawMediaXMLInfo(*current, ofGetWidth(), ofGetHeight());
+    if (showInfoWindow && currentMedia >= 0) {
+        FrameProfiler::Scope scope(profiler, sections.info);
+        drawMediaXMLInfo(medias[current], ofGetWidth(), ofGetHeight());
     }
 
 
@@ -252,20 +631,41 @@ void ofApp::drawSelectedMediaFullscreen() {
     // Set fullscreen mode
     ofSetFullscreen(true);
     // Make sure we have media to show
-    if (medias.empty()) return;
+    if (medias.empty() || currentMedia < 0) return;
 
     // Get current screen size
     int screenW = ofGetWidth();
     int screenH = ofGetHeight();
 
+    // Load the screen images of the neighbours reached by the arrows and the swipes in the background
+    const auto& mediaMatrix = galleryLayout.getRows();
+    if (selectedRow < mediaMatrix.size() && !mediaMatrix[selectedRow].empty()) {
+        const auto& row = mediaMatrix[selectedRow];
+        int count = row.size();
+        screenImageCache.require(row[(selectedCol + 1) % count], medias);
+        screenImageCache.require(row[(selectedCol - 1 + count) % count], medias);
+    }
+
     // Get the currently selected media
     MediaElement& selected = medias[currentMedia];
 
-    // Make sure the image is allocated
-    if (!selected.image.isAllocated()) return;
+    // Videos are opened ahead of space: the selected one first, then the neighbours, so that play starts at once
+    if (selected.isVideo()) videoPlayback.require(currentMedia, selected.videoPath);
+    if (selectedRow < mediaMatrix.size() && !mediaMatrix[selectedRow].empty()) {
+        const auto& row = mediaMatrix[selectedRow];
+        int count = row.size();
+        for (MediaId id : { row[(selectedCol + 1) % count], row[(selectedCol - 1 + count) % count] }) {
+            if (medias[id].isVideo()) videoPlayback.require(id, medias[id].videoPath);
+        }
+    }
+
+    // The screen image is sharp, the grid thumbnail is shown upscaled until it is loaded
+    bool sharp = screenImageCache.require(currentMedia, medias);
+    if (!sharp && !thumbnailCache.require(currentMedia, medias)) return;
+    const ofImage& shown = sharp ? selected.screenImage : selected.image;
 
-    int imgW = selected.image.getWidth();
-    int imgH = selected.image.getHeight();
+    int imgW = shown.getWidth();
+    int imgH = shown.getHeight();
 
     // Calculate scale to fit the screen (keep aspect ratio)
     float scale = std::min((float)screenW / imgW, (float)screenH / imgH);
@@ -276,47 +676,39 @@ void ofApp::drawSelectedMediaFullscreen() {
     int x = (screenW - drawW) / 2;
     int y = (screenH - drawH) / 2;
 
-    if (selected.isVideo()) { // playing the video
-        if (selected.videoPlayer.isLoaded()) {
-            selected.videoPlayer.update();
-            selected.videoPlayer.draw(x, y, drawW, drawH);
+    if (selected.isVideo()) { // the current frame of the video, its screen image until the first one is decoded
+        if (!videoPlayback.draw(currentMedia, x, y, drawW, drawH)) {
+            shown.draw(x, y, drawW, drawH);
         }
-        else {
-            selected.image.draw(x, y, drawW, drawH);
+        if (showTimeline) {
+            rhythmTimeline.draw(selected.videoPath, videoPlayback.getCurrentFrame(currentMedia), featureStore.rhythmFrameStride[currentMedia], margin, screenH - margin - 40, screenW - 2 * margin, 40);
         }
         return;
     }
     // Draw the image
-    selected.image.draw(x, y, drawW, drawH);
+    shown.draw(x, y, drawW, drawH);
 }
 
 void ofApp::updateMediaMatrix() {
-    mediaMatrix.clear();
-    mediaMatrix.resize(3);
-
-    if (groupByLuminance) {
-        for (auto& m : medias) mediaMatrix[m.luminanceGroup].push_back(&m);
-    }
-    else if (groupByColor) {
-        for (auto& m : medias) mediaMatrix[m.colorGroup].push_back(&m);
-    }
-    else if (groupByTexture) {
-        for (auto& m : medias) mediaMatrix[m.textureGroup].push_back(&m);
+    // Called when the order or the grouping changes, the layout keeps its rows between frames
+    if (showSimilar) {
+        galleryLayout.setOrder(similarMedias);
+        galleryLayout.setGrouping(nullptr);
     }
     else {
-        mediaMatrix[0] = {};
-        for (auto& m : medias) mediaMatrix[0].push_back(&m);
+        galleryLayout.setOrder(displayOrder);
+        if (groupByLuminance) galleryLayout.setGrouping(&featureStore.luminanceGroup);
+        else if (groupByColor) galleryLayout.setGrouping(&featureStore.colorGroup);
+        else if (groupByTexture) galleryLayout.setGrouping(&featureStore.textureGroup);
+        else galleryLayout.setGrouping(nullptr);
     }
+    galleryLayout.update();
 
     // Find new selection position
-    for (int row = 0; row < 3; ++row) {
-        for (int col = 0; col < mediaMatrix[row].size(); ++col) {
-            if (mediaMatrix[row][col] == &medias[currentMedia]) {
-                selectedRow = row;
-                selectedCol = col;
-                return;
-            }
-        }
+    GalleryLayout::GridPosition position = galleryLayout.locate(currentMedia);
+    if (position.row >= 0) {
+        selectedRow = position.row;
+        selectedCol = position.col;
     }
 }
 
@@ -327,6 +719,7 @@ void ofApp::drawLegend() {
         "-> / <-       : Next / Previous media",
         "'f'           : Toggle fullscreen",
         "Spacebar      : Play/Pause video (only while in fullscreen mode)",
+        "'t'           : Toggle the rhythm timeline of the video (fullscreen)",
         "'e'           : Toggle edge histogram",
         "'c'           : Toggle dominant color contour",
         "'l'           : Toggle luminance map",
@@ -334,7 +727,11 @@ void ofApp::drawLegend() {
         "'1'           : Group by luminance",
         "'2'           : Group by dominant color",
         "'3'           : Group by texture level",
+        "'n'           : Show the media most similar to the selected one",
+        "'o'           : Cycle the sort order (luminance, hue, texture...)",
         "'i'           : Toggle media metadata (XML) info window",
+        "'g'           : Record the camera for gesture replay",
+        "'p' / 'P'     : Toggle the frame profiler / save it (CSV, JSON)",
         "'h'           : Toggle this legend"
     };
 
@@ -389,7 +786,7 @@ void ofApp::drawMediaXMLInfo(const MediaElement& media, int screenW, int screenH
 
     // Serialize XML to string
     ofxXmlSettings xml;
-    media.saveToXML(xml, 0);
+    media.saveToXML(xml, 0, featureStore.get(currentMedia));
     std::string xmlStr;
     xml.copyXmlToString(xmlStr);
 
@@ -414,6 +811,9 @@ void ofApp::drawMediaXMLInfo(const MediaElement& media, int screenW, int screenH
 
 //--------------------------------------------------------------
 void ofApp::keyPressed(int key) {
+    const auto& mediaMatrix = galleryLayout.getRows();
+    bool navigation = key == OF_KEY_RIGHT || key == OF_KEY_LEFT || key == OF_KEY_UP || key == OF_KEY_DOWN;
+    if (navigation && (mediaMatrix.empty() || selectedRow >= (int)mediaMatrix.size())) return; // nothing to move to
     switch (key) {
 
     case OF_KEY_RIGHT: {
@@ -424,12 +824,7 @@ void ofApp::keyPressed(int key) {
         else {
             selectedCol = 0;
         }
-        MediaElement* selectedPtr = mediaMatrix[selectedRow][selectedCol];
-        currentMedia = std::distance(
-            medias.begin(),
-            std::find_if(medias.begin(), medias.end(),
-                [selectedPtr](MediaElement& m) { return &m == selectedPtr; })
-        );
+        currentMedia = mediaMatrix[selectedRow][selectedCol];
 
         break;
     }
@@ -442,12 +837,7 @@ void ofApp::keyPressed(int key) {
         else {
             selectedCol = mediaMatrix[selectedRow].size() - 1;
         }
-        MediaElement* selectedPtr = mediaMatrix[selectedRow][selectedCol];
-        currentMedia = std::distance(
-            medias.begin(),
-            std::find_if(medias.begin(), medias.end(),
-                [selectedPtr](MediaElement& m) { return &m == selectedPtr; })
-        );
+        currentMedia = mediaMatrix[selectedRow][selectedCol];
 
         break;
     }
@@ -466,12 +856,7 @@ void ofApp::keyPressed(int key) {
             selectedCol = mediaMatrix[selectedRow].size() - 1;
         }
 
-        MediaElement* selectedPtr = mediaMatrix[selectedRow][selectedCol];
-        currentMedia = std::distance(
-            medias.begin(),
-            std::find_if(medias.begin(), medias.end(),
-                [selectedPtr](MediaElement& m) { return &m == selectedPtr; })
-        );
+        currentMedia = mediaMatrix[selectedRow][selectedCol];
 
         break;
     }
@@ -490,12 +875,7 @@ void ofApp::keyPressed(int key) {
             selectedCol = mediaMatrix[selectedRow].size() - 1;
         }
 
-        MediaElement* selectedPtr = mediaMatrix[selectedRow][selectedCol];
-        currentMedia = std::distance(
-            medias.begin(),
-            std::find_if(medias.begin(), medias.end(),
-                [selectedPtr](MediaElement& m) { return &m == selectedPtr; })
-        );
+        currentMedia = mediaMatrix[selectedRow][selectedCol];
 
         break;
     }
@@ -511,28 +891,18 @@ void ofApp::keyPressed(int key) {
 
 
     case(' '): // Play/pause the video
-        if (medias[currentMedia].isVideo()) {
+        if (currentMedia >= 0 && medias[currentMedia].isVideo()) {
             MediaElement& media = medias[currentMedia];
 
-            if (!media.videoPlayer.isLoaded()) {
-                media.videoPlayer.setPixelFormat(OF_PIXELS_RGB);
-                media.videoPlayer.load(media.videoPath);
-                media.videoPlayer.setLoopState(OF_LOOP_NORMAL);
-                media.videoPlayer.play();
-                media.isPaused = false;
+            // Never blocks: the video was opened by require(), or its decode thread starts now
+            if (videoPlayback.getPlaying() == currentMedia && !videoPlayback.isPaused()) {
+                videoPlayback.pause();
+                media.isPaused = true;
             }
             else {
-                if (media.isPaused) {
-                    media.videoPlayer.setPaused(false);
-                    media.isPaused = false;
-                }
-                else {
-                    media.videoPlayer.setPaused(true);
-                    media.isPaused = true;
-                }
+                videoPlayback.play(currentMedia, media.videoPath);
+                media.isPaused = false;
             }
-
-            currentVideoPlaying = &media;
         }
         break;
 
@@ -548,22 +918,57 @@ void ofApp::keyPressed(int key) {
     case('r'): // show RGB histogram
         showRGBHist = !showRGBHist; break;
 
+    case('g'): // record the camera frames, for tools/gesture_replay
+        if (motionDetection.isRecording()) {
+            motionDetection.stopRecording();
+        }
+        else {
+            motionDetection.startRecording(ofToDataPath("gestures_" + ofGetTimestampString("%Y%m%d_%H%M%S") + ".gfr"));
+        }
+        break;
+
+    case('p'): // show/hide the frame profiler
+        showProfiler = !showProfiler; break;
+
+    case('P'): { // save the frame profile of the last frames
+        std::string path = ofToDataPath("profile_" + ofGetTimestampString("%Y%m%d_%H%M%S"));
+        if (profiler.save(path + ".csv") && profiler.save(path + ".json")) {
+            ofLogNotice() << "Frame profile saved to " << path << ".csv and .json";
+        }
+        else {
+            ofLogError() << "Cannot save the frame profile to " << path;
+        }
+        break;
+    }
+
     case('h'): // show/hide legend
         showLegend = !showLegend; break;
 
+    case('t'): // show/hide the rhythm timeline of the fullscreen video
+        showTimeline = !showTimeline; break;
+
     case('i'): // show xml metadata
         showInfoWindow = !showInfoWindow; break;
 
+    case('n'): // show the media most similar to the selected one
+        showSimilar = !showSimilar;
+        if (showSimilar) findSimilar();
+        updateMediaMatrix(); break;
+
+    case('o'): // next sort order
+        sortMode = (sortMode + 1) % sortModes.size();
+        applySortMode(); break;
+
     case '1': groupByLuminance = !groupByLuminance;
-        groupByColor = groupByTexture = false;
+        groupByColor = groupByTexture = showSimilar = false;
         updateMediaMatrix(); break;
 
     case '2': groupByColor = !groupByColor;
-        groupByLuminance = groupByTexture = false;
+        groupByLuminance = groupByTexture = showSimilar = false;
         updateMediaMatrix(); break;
 
     case '3': groupByTexture = !groupByTexture;
-        groupByLuminance = groupByColor = false;
+        groupByLuminance = groupByColor = showSimilar = false;
         updateMediaMatrix(); break;
     }
 }
\ No newline at end of file
@@ -2,6 +2,17 @@
 #include "MediaElement.h" 
 #include "FeatureHandler.h"
 #include "MotionDetection.h"
+#include "FeatureCache.h"
+#include "IngestPipeline.h"
+#include "SimilarityIndex.h"
+#include "OverlayCache.h"
+#include "FeatureStore.h"
+#include "GalleryLayout.h"
+#include "ThumbnailCache.h"
+#include "FrameProfiler.h"
+#include "MediaWatcher.h"
+#include "RhythmTimeline.h"
+#include "VideoPlayback.h"
 #include "utils.h"
 
 
@@ -12,16 +23,55 @@ public:
 	void setup();
 	void update();
 	void draw();
+	void exit();
 	void drawSelectedMediaFullscreen();
 	void drawLegend();
 	void ofApp::drawMediaXMLInfo(const MediaElement& media, int screenW, int screenH);
 	void keyPressed(int key);
-	void updateMediaMatrix();
+	void updateMediaMatrix(); // relayouts the grid after a change of order, grouping or similar mode
+	void loadSettings(); // reads the optional bin/data/settings.xml
+	void findSimilar(); // fills similarMedias with the media closest to the selected one
+	void applySortMode(); // recomputes displayOrder for sortMode
+	bool requestMissingFeature(FeatureType feature); // true if every media has the lazy feature, otherwise computes it in the background
+	void mergeMissingFeature(); // once the background computation finished: merges it and runs the sort or search that waited
+	void applyMediaChanges(); // merges the files added, changed or deleted since the last frame (see MediaWatcher)
+	void removeMedia(MediaId id); // hides a media whose file was deleted, its id stays reserved
+	void saveFeatureColumns(); // writes featureStore to featureColumns, for the next launch
+	void applyRhythmTimeline(MediaId id); // rhythm metric of a video from its playback timeline, once it covers enough frames
 
 	MotionDetection motionDetection;
-	ofDirectory dir;
-	std::vector<MediaElement> medias;
-	std::vector<std::vector<MediaElement*>> mediaMatrix;
+	FeatureHandler featureHandler;
+	FeatureCache featureCache; // features of the previous launches, saved in bin/data
+	MediaWatcher mediaWatcher; // ingests the files dropped in the media directories while the gallery runs
+	SimilarityIndex similarityIndex; // nearest neighbours over the color and edge histograms, built on the first search
+	std::vector<MediaId> unindexedMedias; // added or changed since the index was built, added by the next search
+
+	// Lazy features computed on a background thread for the sort and the similarity search, see requestMissingFeature
+	std::thread missingFeatureThread;
+	std::atomic<bool> missingFeatureDone{ false };
+	std::vector<IngestPipeline::MissingFeature> missingFeatures; // owned by the thread while it runs
+	FeatureType missingFeatureType = EDGE;
+	std::vector<MediaId> changedWhileComputing; // their computed features describe the previous file, dropped
+	std::vector<uint8_t> undecodableMedias; // 1 for the ids the background pass could not decode, not tried again until they change
+	bool sortWaitsForFeatures = false;
+	bool similarWaitsForFeatures = false;
+	OverlayCache overlayCache; // luminance and edge maps of the visible tiles, computed when an overlay is shown
+	ThumbnailCache thumbnailCache; // pixels and textures of the tiles around the viewport, loaded in the background
+	ThumbnailCache screenImageCache{ ThumbnailCache::SCREEN }; // full resolution level of the selected media and its neighbours
+	std::vector<MediaElement> medias; // images and players, the MediaId of a media is its index
+	FeatureStore featureStore; // features of every media, row id belongs to medias[id]
+	uint64_t savedRevision = 0; // revision of featureStore when it was last saved
+	std::vector<MediaId> displayOrder; // ids in the order they are drawn, medias itself is never reordered
+	std::vector<uint8_t> removedMedias; // 1 for the ids whose file was deleted, they are in no order nor layout
+	std::unordered_map<std::string, MediaId> mediaIds; // file path -> id, a file deleted then created again gets its id back
+	GalleryLayout galleryLayout; // rows of the grid, drawn by draw() and navigated by the keys and gestures
+	FrameProfiler profiler; // time of the update and draw sections, 'p' shows it, 'P' saves it
+	RhythmTimeline rhythmTimeline; // frame differences and shot boundaries of the videos, filled while they play
+	VideoPlayback videoPlayback; // decodes the videos on background threads, the selected one and its neighbours ahead of play
+
+	struct ProfileSections { // ids of the sections timed by profiler
+		int update, mediaChanges, gestures, video, timeline, draw, caches, debugCameras, tiles, overlays, info, fullscreen;
+	} sections;
 
 	ofImage videoIcon;
 
@@ -32,8 +82,6 @@ public:
 	int selectedRow = 0;
 	int selectedCol = 0;
 
-
-	MediaElement* currentVideoPlaying = nullptr;
 	bool fullscreenMode = false;
 	bool showEdgeHist = false;
 	bool showDominantColor = false;
@@ -41,11 +89,33 @@ public:
 	bool showRGBHist = false;
 	bool showLegend = false;
 	bool showInfoWindow = false;
+	bool showProfiler = false;
+	bool showTimeline = false; // 't': timeline of the video shown fullscreen
 
 	bool groupByLuminance = false;
 	bool groupByColor = false;
 	bool groupByTexture = false;
 
+	bool showSimilar = false; // 'n': a single row with the selected media followed by the most similar ones
+	std::vector<MediaId> similarMedias; // the query first
+	int similarCount = 20;
+
+	int sortMode = 0; // index in the sort modes of ofApp.cpp, 0 = directory order
+
+	std::vector<std::string> mediaDirectories = { "images/of_logos/" }; // relative to bin/data or absolute
+	bool mediaRecursive = false; // also load the subdirectories
+	bool watchMedia = true; // follow the media directories while the gallery runs
+	int ingestThreads = 0; // worker threads used to load the media, 0 = one per hardware core
+	std::string featureColumns = "features.columns"; // feature store of the last run, relative to bin/data, empty = not kept
+	FeatureStore::HistogramEncoding histogramEncoding = FeatureStore::HISTOGRAM_FLOAT32; // precision of the stored histograms
+	int thumbnailCacheSize = 256; // thumbnails kept in memory, at least the number of visible tiles
+	int thumbnailThreads = 2; // worker threads decoding the thumbnails
+	int prefetchTiles = 6; // tiles loaded ahead on each side of the viewport
+	int screenImageCacheSize = 5; // screen size images kept in memory: the selected media, its neighbours and the previous ones
+	FeatureHandler::RhythmOptions rhythmOptions; // sampling of the video rhythm analysis
+	int videoSessions = 3; // videos opened at once: the one playing and the preloaded neighbours
+	int videoQueueFrames = 8; // frames decoded ahead of the playing video
+
 	std::pair<int, int> prevScreenSize = { 1024, 768 }; // to restore screen size when exiting fullscreen
 	std::pair<int, int> standardImageSize = { 280, 280 }; // standard image size for the application
 };
@@ -0,0 +1,313 @@
+#include "ofMain.h"
+#include "FeatureHandler.h"
+#include "PixelKernels.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <thread>
+
+// Headless micro-benchmark of the FeatureHandler extractors.
+// Every extractor runs on synthetic images of several resolutions, the results (ns/pixel,
+// throughput, heap allocations per call) are printed as JSON lines or CSV so that runs of
+// different releases can be compared by a script. No window nor GL context is created.
+//
+// usage: benchmark [--format json|csv] [--sizes 280x280,1920x1080] [--min-time 0.5]
+//                  [--filter name] [--kernels best|all|scalar|sse2|avx2|neon] [--output file]
+
+// -------------------------------------------------------------------------------------------------------------------------
+// ALLOCATION COUNTING
+// -------------------------------------------------------------------------------------------------------------------------
+
+static std::atomic<uint64_t> allocationCount(0);
+static std::atomic<uint64_t> allocatedBytes(0);
+
+static void* countedAlloc(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+static void* countedAlignedAlloc(std::size_t size, std::size_t alignment) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+#ifdef _MSC_VER
+    return _aligned_malloc(size ? size : 1, alignment);
+#else
+    void* p = nullptr;
+    return posix_memalign(&p, alignment < sizeof(void*) ? sizeof(void*) : alignment, size ? size : 1) == 0 ? p : nullptr;
+#endif
+}
+
+static void alignedFree(void* p) {
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void* operator new(std::size_t size) { if (void* p = countedAlloc(size)) return p; throw std::bad_alloc(); }
+void* operator new[](std::size_t size) { if (void* p = countedAlloc(size)) return p; throw std::bad_alloc(); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void* operator new(std::size_t size, std::align_val_t a) { if (void* p = countedAlignedAlloc(size, std::size_t(a))) return p; throw std::bad_alloc(); }
+void* operator new[](std::size_t size, std::align_val_t a) { if (void* p = countedAlignedAlloc(size, std::size_t(a))) return p; throw std::bad_alloc(); }
+void operator delete(void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { alignedFree(p); }
+
+// -------------------------------------------------------------------------------------------------------------------------
+// SYNTHETIC IMAGES
+// -------------------------------------------------------------------------------------------------------------------------
+
+// Gradient background with random rectangles and noise: gives the histogram, edge and texture
+// extractors realistic work. The same seed always gives the same image
+static ofPixels makeSyntheticImage(int width, int height, uint32_t seed) {
+    uint32_t state = seed * 2654435761u + 1;
+    auto next = [&state]() { state = state * 1664525u + 1013904223u; return state >> 8; };
+
+    ofPixels pixels;
+    pixels.allocate(width, height, OF_PIXELS_RGB);
+    unsigned char* data = pixels.getData();
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            unsigned char* p = data + 3 * (y * width + x);
+            p[0] = (unsigned char)(255 * x / std::max(1, width - 1));
+            p[1] = (unsigned char)(255 * y / std::max(1, height - 1));
+            p[2] = (unsigned char)((p[0] + p[1]) / 2);
+        }
+    }
+
+    int numRectangles = 8 + next() % 8;
+    for (int i = 0; i < numRectangles; i++) {
+        int x0 = next() % width, y0 = next() % height;
+        int x1 = std::min(width, x0 + 1 + int(next() % (width / 3 + 1)));
+        int y1 = std::min(height, y0 + 1 + int(next() % (height / 3 + 1)));
+        unsigned char r = next() % 256, g = next() % 256, b = next() % 256;
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                unsigned char* p = data + 3 * (y * width + x);
+                p[0] = r; p[1] = g; p[2] = b;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < pixels.size(); i++) {
+        int noisy = data[i] + int(next() % 17) - 8;
+        data[i] = (unsigned char)std::min(255, std::max(0, noisy));
+    }
+    return pixels;
+}
+
+static MediaElement makeElement(const ofPixels& pixels) {
+    MediaElement element;
+    element.image.setUseTexture(false); // headless: no GL context
+    element.luminanceMap.setUseTexture(false);
+    element.image.setFromPixels(pixels);
+    return element;
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// MEASUREMENT
+// -------------------------------------------------------------------------------------------------------------------------
+
+struct BenchmarkResult {
+    std::string extractor;
+    std::string kernels;
+    int width = 0;
+    int height = 0;
+    int iterations = 0;
+    double medianNs = 0;
+    double minNs = 0;
+    double allocationsPerCall = 0;
+    double bytesPerCall = 0;
+};
+
+struct BenchmarkOptions {
+    std::string format = "json";
+    std::vector<std::pair<int, int>> sizes = { { 64, 64 }, { 280, 280 }, { 640, 480 }, { 1280, 720 }, { 1920, 1080 } };
+    double minSeconds = 0.5; // per extractor and size
+    int minIterations = 5;
+    std::string filter;
+    std::string kernels = "best";
+    std::string outputPath;
+};
+
+template<typename Function>
+static BenchmarkResult measure(const std::string& name, int width, int height, const BenchmarkOptions& options, Function&& function) {
+    typedef std::chrono::steady_clock Clock;
+    function(); // warm up: first call allocates the buffers reused afterwards
+
+    std::vector<double> samples;
+    uint64_t allocationsBefore = allocationCount.load();
+    uint64_t bytesBefore = allocatedBytes.load();
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start;
+    while (int(samples.size()) < options.minIterations || std::chrono::duration<double>(end - start).count() < options.minSeconds) {
+        Clock::time_point before = Clock::now();
+        function();
+        end = Clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(end - before).count());
+    }
+    uint64_t allocations = allocationCount.load() - allocationsBefore;
+    uint64_t bytes = allocatedBytes.load() - bytesBefore;
+
+    BenchmarkResult result;
+    result.extractor = name;
+    result.kernels = PixelKernels::get().name;
+    result.width = width;
+    result.height = height;
+    result.iterations = samples.size();
+    result.allocationsPerCall = double(allocations) / samples.size(); // includes the bookkeeping of samples, amortized to ~0
+    result.bytesPerCall = double(bytes) / samples.size();
+    std::sort(samples.begin(), samples.end());
+    result.medianNs = samples[samples.size() / 2];
+    result.minNs = samples.front();
+    return result;
+}
+
+static void runSize(int width, int height, const BenchmarkOptions& options, std::vector<BenchmarkResult>& results) {
+    FeatureHandler featureHandler;
+    ofPixels pixels = makeSyntheticImage(width, height, 1);
+    ofPixels otherPixels = makeSyntheticImage(width, height, 2);
+    MediaElement element = makeElement(pixels);
+    ofImage otherImage;
+    otherImage.setUseTexture(false);
+    otherImage.setFromPixels(otherPixels);
+
+    const PixelKernels& kernels = PixelKernels::get();
+    const size_t numPixels = size_t(width) * height;
+    std::vector<float> luminance(numPixels);
+    std::vector<uint32_t> histograms(3 * 256);
+
+    // The extractors are timed cold, like in the releases before the shared gray plane: computeEdgeMap and
+    // computeTextureDescriptor called on their own convert the image to gray on every call, only computeAllFeatures
+    // shares one conversion within its call. Each row therefore includes the whole work of one call
+    typedef std::function<void()> Extractor;
+    std::vector<std::pair<std::string, Extractor>> extractors = {
+        { "computeAllFeatures", [&]() { featureHandler.computeAllFeatures(element); } },
+        { "computeColorFeatures", [&]() { featureHandler.computeColorFeatures(element); } },
+        { "computeNormalizedRGBHistogram", [&]() { featureHandler.computeNormalizedRGBHistogram(element); } },
+        { "computeDominantColor", [&]() { featureHandler.computeDominantColor(element); } },
+        { "computeLuminanceMap", [&]() { featureHandler.computeLuminanceMap(element); } },
+        { "computeAverageLuminance", [&]() { featureHandler.computeAverageLuminance(element); } },
+        { "computeEdgeMap", [&]() { featureHandler.computeEdgeMap(element); } },
+        { "computeTextureDescriptor", [&]() { featureHandler.computeTextureDescriptor(element); } },
+        { "computeFrameDifference", [&]() { featureHandler.computeFrameDifference(element.image, otherImage); } },
+        { "PixelKernels::channelSums", [&]() { kernels.channelSums(pixels.getData(), numPixels); } },
+        { "PixelKernels::histogram", [&]() { kernels.histogram(pixels.getData(), numPixels, &histograms[0], &histograms[256], &histograms[512]); } },
+        { "PixelKernels::luminance", [&]() { kernels.luminance(pixels.getData(), numPixels, luminance.data()); } },
+        { "PixelKernels::frameDifference", [&]() { kernels.frameDifference(pixels.getData(), otherPixels.getData(), numPixels); } },
+    };
+
+    for (auto& extractor : extractors) {
+        if (!options.filter.empty() && extractor.first.find(options.filter) == std::string::npos) continue;
+        results.push_back(measure(extractor.first, width, height, options, extractor.second));
+        std::cerr << "  " << extractor.first << " " << width << "x" << height << " (" << kernels.name << ")" << std::endl;
+    }
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// OUTPUT
+// -------------------------------------------------------------------------------------------------------------------------
+
+static void writeResults(std::ostream& out, const std::vector<BenchmarkResult>& results, const BenchmarkOptions& options) {
+    if (options.format == "csv") {
+        out << "extractor,kernels,width,height,pixels,iterations,median_ns,min_ns,ns_per_pixel,mpixels_per_s,calls_per_s,allocations_per_call,bytes_per_call\n";
+    }
+    else {
+        out << "{\"benchmark\":\"FeatureHandler\",\"extractor_version\":" << FeatureHandler::extractorVersion
+            << ",\"hardware_threads\":" << std::thread::hardware_concurrency()
+            << ",\"timestamp\":\"" << ofGetTimestampString("%Y-%m-%dT%H:%M:%S") << "\"}\n";
+    }
+
+    for (const auto& r : results) {
+        double pixels = double(r.width) * r.height;
+        double nsPerPixel = r.medianNs / pixels;
+        double megapixelsPerSecond = pixels / r.medianNs * 1e3;
+        double callsPerSecond = 1e9 / r.medianNs;
+        if (options.format == "csv") {
+            out << r.extractor << "," << r.kernels << "," << r.width << "," << r.height << "," << pixels << ","
+                << r.iterations << "," << r.medianNs << "," << r.minNs << "," << nsPerPixel << ","
+                << megapixelsPerSecond << "," << callsPerSecond << "," << r.allocationsPerCall << "," << r.bytesPerCall << "\n";
+        }
+        else {
+            out << "{\"extractor\":\"" << r.extractor << "\",\"kernels\":\"" << r.kernels << "\",\"width\":" << r.width
+                << ",\"height\":" << r.height << ",\"pixels\":" << pixels << ",\"iterations\":" << r.iterations
+                << ",\"median_ns\":" << r.medianNs << ",\"min_ns\":" << r.minNs << ",\"ns_per_pixel\":" << nsPerPixel
+                << ",\"mpixels_per_s\":" << megapixelsPerSecond << ",\"calls_per_s\":" << callsPerSecond
+                << ",\"allocations_per_call\":" << r.allocationsPerCall << ",\"bytes_per_call\":" << r.bytesPerCall << "}\n";
+        }
+    }
+}
+
+static bool parseArguments(int argc, char* argv[], BenchmarkOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--format" && hasValue) options.format = argv[++i];
+        else if (arg == "--min-time" && hasValue) options.minSeconds = std::atof(argv[++i]);
+        else if (arg == "--filter" && hasValue) options.filter = argv[++i];
+        else if (arg == "--kernels" && hasValue) options.kernels = argv[++i];
+        else if (arg == "--output" && hasValue) options.outputPath = argv[++i];
+        else if (arg == "--sizes" && hasValue) {
+            options.sizes.clear();
+            for (const auto& size : ofSplitString(argv[++i], ",", true, true)) {
+                std::vector<std::string> dims = ofSplitString(size, "x");
+                if (dims.size() != 2 || ofToInt(dims[0]) <= 0 || ofToInt(dims[1]) <= 0) return false;
+                options.sizes.push_back({ ofToInt(dims[0]), ofToInt(dims[1]) });
+            }
+        }
+        else return false;
+    }
+    return options.format == "json" || options.format == "csv";
+}
+
+//========================================================================
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        std::cerr << "usage: benchmark [--format json|csv] [--sizes 280x280,1920x1080] [--min-time 0.5]" << std::endl
+            << "                 [--filter name] [--kernels best|all|scalar|sse2|avx2|neon] [--output file]" << std::endl;
+        return 1;
+    }
+
+    ofInit();
+    ofSetLogLevel(OF_LOG_ERROR); // the extractors log every call
+
+    std::vector<const PixelKernels*> kernelSets;
+    for (const PixelKernels* kernels : PixelKernels::supported()) {
+        if (options.kernels == "all" || options.kernels == kernels->name) kernelSets.push_back(kernels);
+    }
+    if (options.kernels == "best") kernelSets.push_back(&PixelKernels::get());
+    if (kernelSets.empty()) {
+        std::cerr << "Kernels " << options.kernels << " are not supported on this CPU" << std::endl;
+        return 1;
+    }
+
+    std::vector<BenchmarkResult> results;
+    for (const PixelKernels* kernels : kernelSets) {
+        PixelKernels::select(*kernels);
+        for (const auto& size : options.sizes) {
+            runSize(size.first, size.second, options, results);
+        }
+    }
+
+    if (options.outputPath.empty()) {
+        writeResults(std::cout, results, options);
+    }
+    else {
+        std::ofstream out(options.outputPath);
+        writeResults(out, results, options);
+    }
+    return 0;
+}
@@ -0,0 +1,262 @@
+#include "ofMain.h"
+#include "GestureDetector.h"
+#include "FrameRecording.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <numeric>
+
+// Headless replay of a camera recording through the GestureDetector (record one with the 'g' key of the gallery).
+// Every frame is processed as on the camera thread of MotionDetection and the run reports the processing latency
+// per frame, the swipes detected and how many frames each swipe took to be detected after the movement started.
+// The same recording and options always give the same swipes, so thresholds can be tuned and optimizations
+// compared reproducibly; --expect turns a run into a regression check.
+//
+// usage: gesture_replay recording.gfr [--format json|csv] [--frames] [--repeat 1] [--output file]
+//                       [--diff-threshold 30] [--movement-threshold 1000] [--cooldown 30] [--band 0.3,0.7]
+//                       [--onset 0.25] [--expect left,right,...]
+
+// -------------------------------------------------------------------------------------------------------------------------
+// REPLAY
+// -------------------------------------------------------------------------------------------------------------------------
+
+struct ReplayOptions {
+    std::string recordingPath;
+    std::string format = "json";
+    bool perFrame = false; // one line per frame in the output
+    int repeat = 1; // passes over the recording, latencies are kept from the fastest pass
+    float onsetFraction = 0.25f; // movement that starts a gesture, in fractions of movementThreshold
+    std::string outputPath;
+    std::vector<std::string> expected;
+    GestureDetector::Options detector;
+};
+
+struct FrameResult {
+    uint64_t timeUs = 0;
+    double latencyNs = 0;
+    GestureDetector::Detection detection;
+};
+
+struct GestureResult {
+    GestureDetector::Gesture gesture = GestureDetector::NONE;
+    uint64_t frame = 0;
+    uint64_t timeUs = 0;
+    int64_t onsetFrame = -1; // first frame of the movement, -1 if it started before the cooldown ended
+};
+
+static const char* getGestureName(GestureDetector::Gesture gesture) {
+    switch (gesture) {
+    case GestureDetector::SWIPE_LEFT: return "left";
+    case GestureDetector::SWIPE_RIGHT: return "right";
+    default: return "none";
+    }
+}
+
+static bool replayOnce(FrameReplay& replay, const ReplayOptions& options, std::vector<FrameResult>& frames) {
+    typedef std::chrono::steady_clock Clock;
+    GestureDetector detector(options.detector);
+    detector.keepDiff = false; // the debug view is not part of the detection cost
+
+    if (!replay.rewind()) return false;
+    const uint8_t* gray = nullptr;
+    uint64_t timeUs = 0;
+    size_t index = 0;
+    while (replay.read(gray, timeUs)) {
+        Clock::time_point before = Clock::now();
+        GestureDetector::Detection detection = detector.process(gray, replay.getWidth(), replay.getHeight());
+        double latencyNs = std::chrono::duration<double, std::nano>(Clock::now() - before).count();
+
+        if (index == frames.size()) frames.emplace_back();
+        FrameResult& frame = frames[index++];
+        if (frame.latencyNs == 0 || latencyNs < frame.latencyNs) frame.latencyNs = latencyNs;
+        frame.timeUs = timeUs;
+        frame.detection = detection;
+    }
+    return !replay.isCorrupt() && index == frames.size();
+}
+
+// A movement starts on the first frame where one half moves more than the onset level, and ends when both halves
+// calm down again. Frames-to-detection counts the frames from that start to the swipe
+static std::vector<GestureResult> findGestures(const std::vector<FrameResult>& frames, const ReplayOptions& options) {
+    std::vector<GestureResult> gestures;
+    int onsetLevel = std::max(1, int(options.detector.movementThreshold * options.onsetFraction));
+    int64_t onsetFrame = -1;
+    bool movementSeenInCooldown = false;
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        const GestureDetector::Detection& detection = frames[i].detection;
+        bool moving = std::max(detection.leftMovement, detection.rightMovement) >= onsetLevel;
+        if (detection.coolingDown) {
+            movementSeenInCooldown = moving;
+            onsetFrame = -1;
+            continue;
+        }
+        if (!moving) {
+            onsetFrame = -1;
+            movementSeenInCooldown = false;
+        }
+        else if (onsetFrame < 0 && !movementSeenInCooldown) {
+            onsetFrame = i;
+        }
+
+        if (detection.gesture != GestureDetector::NONE) {
+            GestureResult gesture;
+            gesture.gesture = detection.gesture;
+            gesture.frame = i;
+            gesture.timeUs = frames[i].timeUs - frames.front().timeUs;
+            gesture.onsetFrame = onsetFrame;
+            gestures.push_back(gesture);
+            onsetFrame = -1;
+        }
+    }
+    return gestures;
+}
+
+// -------------------------------------------------------------------------------------------------------------------------
+// OUTPUT
+// -------------------------------------------------------------------------------------------------------------------------
+
+static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, size_t(fraction * values.size()))];
+}
+
+static void writeResults(std::ostream& out, const FrameReplay& replay, const std::vector<FrameResult>& frames,
+    const std::vector<GestureResult>& gestures, const ReplayOptions& options) {
+    std::vector<double> latencies;
+    for (const auto& frame : frames) latencies.push_back(frame.latencyNs);
+    double meanNs = latencies.empty() ? 0 : std::accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
+    double durationMs = frames.empty() ? 0 : (frames.back().timeUs - frames.front().timeUs) / 1000.0;
+
+    int measured = 0;
+    double framesToDetection = 0;
+    for (const auto& gesture : gestures) {
+        if (gesture.onsetFrame < 0) continue;
+        framesToDetection += gesture.frame - gesture.onsetFrame;
+        measured++;
+    }
+    double meanFramesToDetection = measured ? framesToDetection / measured : 0;
+
+    if (options.format == "csv") {
+        if (options.perFrame) {
+            out << "frame,time_ms,latency_ns,left_movement,right_movement,cooling_down,gesture\n";
+            for (size_t i = 0; i < frames.size(); i++) {
+                const FrameResult& f = frames[i];
+                out << i << "," << (f.timeUs - frames.front().timeUs) / 1000.0 << "," << f.latencyNs << ","
+                    << f.detection.leftMovement << "," << f.detection.rightMovement << "," << f.detection.coolingDown << ","
+                    << getGestureName(f.detection.gesture) << "\n";
+            }
+            out << "\n";
+        }
+        out << "gesture,frame,time_ms,onset_frame,frames_to_detection\n";
+        for (const auto& g : gestures) {
+            out << getGestureName(g.gesture) << "," << g.frame << "," << g.timeUs / 1000.0 << "," << g.onsetFrame << ",";
+            if (g.onsetFrame >= 0) out << g.frame - g.onsetFrame;
+            out << "\n";
+        }
+        out << "\nrecording,width,height,frames,duration_ms,gestures,mean_latency_ns,median_latency_ns,p95_latency_ns,max_latency_ns,mean_frames_to_detection\n"
+            << options.recordingPath << "," << replay.getWidth() << "," << replay.getHeight() << "," << frames.size() << ","
+            << durationMs << "," << gestures.size() << "," << meanNs << "," << percentile(latencies, 0.5) << ","
+            << percentile(latencies, 0.95) << "," << percentile(latencies, 1.0) << "," << meanFramesToDetection << "\n";
+        return;
+    }
+
+    const GestureDetector::Options& d = options.detector;
+    out << "{\"benchmark\":\"GestureDetector\",\"recording\":\"" << options.recordingPath << "\",\"width\":" << replay.getWidth()
+        << ",\"height\":" << replay.getHeight() << ",\"diff_threshold\":" << d.diffThreshold
+        << ",\"movement_threshold\":" << d.movementThreshold << ",\"cooldown_frames\":" << d.cooldownFrames
+        << ",\"band_top\":" << d.bandTop << ",\"band_bottom\":" << d.bandBottom << ",\"repeat\":" << options.repeat
+        << ",\"timestamp\":\"" << ofGetTimestampString("%Y-%m-%dT%H:%M:%S") << "\"}\n";
+    if (options.perFrame) {
+        for (size_t i = 0; i < frames.size(); i++) {
+            const FrameResult& f = frames[i];
+            out << "{\"frame\":" << i << ",\"time_ms\":" << (f.timeUs - frames.front().timeUs) / 1000.0
+                << ",\"latency_ns\":" << f.latencyNs << ",\"left_movement\":" << f.detection.leftMovement
+                << ",\"right_movement\":" << f.detection.rightMovement << ",\"cooling_down\":" << (f.detection.coolingDown ? "true" : "false")
+                << ",\"gesture\":\"" << getGestureName(f.detection.gesture) << "\"}\n";
+        }
+    }
+    for (const auto& g : gestures) {
+        out << "{\"gesture\":\"" << getGestureName(g.gesture) << "\",\"frame\":" << g.frame << ",\"time_ms\":" << g.timeUs / 1000.0
+            << ",\"onset_frame\":" << g.onsetFrame << ",\"frames_to_detection\":";
+        if (g.onsetFrame >= 0) out << g.frame - g.onsetFrame;
+        else out << "null";
+        out << "}\n";
+    }
+    out << "{\"frames\":" << frames.size() << ",\"duration_ms\":" << durationMs << ",\"gestures\":" << gestures.size()
+        << ",\"mean_latency_ns\":" << meanNs << ",\"median_latency_ns\":" << percentile(latencies, 0.5)
+        << ",\"p95_latency_ns\":" << percentile(latencies, 0.95) << ",\"max_latency_ns\":" << percentile(latencies, 1.0)
+        << ",\"mean_frames_to_detection\":" << meanFramesToDetection << "}\n";
+}
+
+static bool parseArguments(int argc, char* argv[], ReplayOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--format" && hasValue) options.format = argv[++i];
+        else if (arg == "--frames") options.perFrame = true;
+        else if (arg == "--repeat" && hasValue) options.repeat = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--output" && hasValue) options.outputPath = argv[++i];
+        else if (arg == "--diff-threshold" && hasValue) options.detector.diffThreshold = std::atoi(argv[++i]);
+        else if (arg == "--movement-threshold" && hasValue) options.detector.movementThreshold = std::atoi(argv[++i]);
+        else if (arg == "--cooldown" && hasValue) options.detector.cooldownFrames = std::atoi(argv[++i]);
+        else if (arg == "--onset" && hasValue) options.onsetFraction = std::atof(argv[++i]);
+        else if (arg == "--expect" && hasValue) options.expected = ofSplitString(argv[++i], ",", true, true);
+        else if (arg == "--band" && hasValue) {
+            std::vector<std::string> band = ofSplitString(argv[++i], ",");
+            if (band.size() != 2) return false;
+            options.detector.bandTop = ofToFloat(band[0]);
+            options.detector.bandBottom = ofToFloat(band[1]);
+            if (options.detector.bandTop < 0 || options.detector.bandBottom > 1 || options.detector.bandTop >= options.detector.bandBottom) return false;
+        }
+        else if (arg.compare(0, 2, "--") != 0 && options.recordingPath.empty()) options.recordingPath = arg;
+        else return false;
+    }
+    return !options.recordingPath.empty() && (options.format == "json" || options.format == "csv");
+}
+
+//========================================================================
+int main(int argc, char* argv[]) {
+    ReplayOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        std::cerr << "usage: gesture_replay recording.gfr [--format json|csv] [--frames] [--repeat 1] [--output file]" << std::endl
+            << "                      [--diff-threshold 30] [--movement-threshold 1000] [--cooldown 30] [--band 0.3,0.7]" << std::endl
+            << "                      [--onset 0.25] [--expect left,right,...]" << std::endl;
+        return 1;
+    }
+
+    FrameReplay replay;
+    if (!replay.open(options.recordingPath)) {
+        std::cerr << "Cannot read the recording " << options.recordingPath << std::endl;
+        return 1;
+    }
+
+    std::vector<FrameResult> frames;
+    for (int pass = 0; pass < options.repeat; pass++) {
+        if (!replayOnce(replay, options, frames)) {
+            std::cerr << "The recording " << options.recordingPath << " is truncated or corrupt" << std::endl;
+            return 1;
+        }
+    }
+    std::vector<GestureResult> gestures = findGestures(frames, options);
+
+    if (options.outputPath.empty()) {
+        writeResults(std::cout, replay, frames, gestures, options);
+    }
+    else {
+        std::ofstream out(options.outputPath);
+        writeResults(out, replay, frames, gestures, options);
+    }
+
+    if (!options.expected.empty()) {
+        std::vector<std::string> detected;
+        for (const auto& gesture : gestures) detected.push_back(getGestureName(gesture.gesture));
+        if (detected != options.expected) {
+            std::cerr << "Expected the gestures " << ofJoinString(options.expected, ",")
+                << " but detected " << ofJoinString(detected, ",") << std::endl;
+            return 2;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,182 @@
+#include "ofMain.h"
+#include "IngestPipeline.h"
+#include "FeatureCache.h"
+#include "FeatureStore.h"
+#include "ofxXmlSettings.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+
+// Headless batch indexer: walks media directories and extracts the features of every file with the same
+// IngestPipeline and FeatureHandler as the gallery, on all cores, into the FeatureCache the gallery reads at
+// startup. A gallery pointed at the same directories (mediaDirectory in settings.xml, spelled the same way) then
+// starts without analysing anything. Runs are incremental: unchanged files already in the cache are skipped, and
+// the cache is saved after every batch so an interrupted run resumes where it stopped.
+// With --columns the features of every indexed file are also written as a feature column file (FeatureStore::save),
+// which the gallery maps at startup (featureColumns in settings.xml): the files it lists in the same order then
+// open without touching the cache at all.
+// Progress and per-file failures go to stderr, a JSON summary to stdout. No window nor GL context is created.
+//
+// usage: indexer directory... [--recursive] [--output features.cache] [--threads 0] [--batch 500]
+//                             [--size 280x280] [--prune] [--settings settings.xml]
+//                             [--columns features.columns] [--encoding float32|float16|uint8]
+// exit code: 0 when every file was indexed, 2 when some files failed, 1 on a usage or write error
+
+struct IndexerOptions {
+    std::vector<std::string> directories;
+    bool recursive = false;
+    std::string outputPath; // default: featureCache of the settings, else features.cache, relative to bin/data
+    int threads = 0;
+    size_t batchSize = 500; // files between two saves of the cache
+    std::pair<int, int> imageSize = { 280, 280 }; // must match the standardImageSize of the gallery
+    bool prune = false; // drop the cache entries of files that were not indexed by this run
+    std::string settingsPath = "settings.xml";
+    std::string columnsPath; // default: featureColumns of the settings, empty = no column file
+    std::string encoding; // default: histogramEncoding of the settings, else float32
+};
+
+struct IndexerStats {
+    std::atomic<size_t> done{ 0 };
+    std::atomic<size_t> cached{ 0 };
+    std::atomic<size_t> failed{ 0 };
+};
+
+static bool parseArguments(int argc, char* argv[], IndexerOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--recursive") options.recursive = true;
+        else if (arg == "--prune") options.prune = true;
+        else if (arg == "--output" && hasValue) options.outputPath = argv[++i];
+        else if (arg == "--threads" && hasValue) options.threads = std::atoi(argv[++i]);
+        else if (arg == "--batch" && hasValue) options.batchSize = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--settings" && hasValue) options.settingsPath = argv[++i];
+        else if (arg == "--columns" && hasValue) options.columnsPath = argv[++i];
+        else if (arg == "--encoding" && hasValue) options.encoding = argv[++i];
+        else if (arg == "--size" && hasValue) {
+            std::vector<std::string> dims = ofSplitString(argv[++i], "x");
+            if (dims.size() != 2 || ofToInt(dims[0]) <= 0 || ofToInt(dims[1]) <= 0) return false;
+            options.imageSize = { ofToInt(dims[0]), ofToInt(dims[1]) };
+        }
+        else if (arg.compare(0, 2, "--") != 0) options.directories.push_back(arg);
+        else return false;
+    }
+    return !options.directories.empty();
+}
+
+// Same keys as ofApp::loadSettings, so the indexer extracts the features the gallery would
+static void loadSettings(const std::string& path, IndexerOptions& options, FeatureHandler::RhythmOptions& rhythmOptions) {
+    ofxXmlSettings settings;
+    if (!settings.load(path)) return;
+    settings.pushTag("settings");
+    if (options.outputPath.empty()) options.outputPath = settings.getValue("featureCache", std::string());
+    if (options.columnsPath.empty()) options.columnsPath = settings.getValue("featureColumns", std::string());
+    if (options.encoding.empty()) options.encoding = settings.getValue("histogramEncoding", std::string());
+    rhythmOptions.frameStride = settings.getValue("rhythmFrameStride", rhythmOptions.frameStride);
+    rhythmOptions.maxSamples = settings.getValue("rhythmMaxSamples", rhythmOptions.maxSamples);
+    rhythmOptions.timeBudgetSeconds = settings.getValue("rhythmTimeBudget", rhythmOptions.timeBudgetSeconds);
+    rhythmOptions.openTimeoutSeconds = settings.getValue("videoOpenTimeout", rhythmOptions.openTimeoutSeconds);
+    settings.popTag(); // settings
+}
+
+//========================================================================
+int main(int argc, char* argv[]) {
+    IndexerOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        std::cerr << "usage: indexer directory... [--recursive] [--output features.cache] [--threads 0] [--batch 500]" << std::endl
+            << "                            [--size 280x280] [--prune] [--settings settings.xml]" << std::endl
+            << "                            [--columns features.columns] [--encoding float32|float16|uint8]" << std::endl;
+        return 1;
+    }
+
+    ofInit();
+    ofSetLogLevel(OF_LOG_ERROR); // the extractors log every call, failures are reported below
+
+    FeatureHandler::RhythmOptions rhythmOptions;
+    loadSettings(options.settingsPath, options, rhythmOptions);
+    if (options.outputPath.empty()) options.outputPath = "features.cache";
+    FeatureStore::HistogramEncoding encoding = FeatureStore::HISTOGRAM_FLOAT32;
+    if (!options.encoding.empty() && !FeatureStore::parseHistogramEncoding(options.encoding, encoding)) {
+        std::cerr << "Unknown histogram encoding " << options.encoding << ", use float32, float16 or uint8" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> paths;
+    for (const auto& directory : options.directories) {
+        std::vector<std::string> directoryPaths = IngestPipeline::listMediaFiles(directory, options.recursive);
+        std::cerr << directory << ": " << directoryPaths.size() << " files" << std::endl;
+        paths.insert(paths.end(), directoryPaths.begin(), directoryPaths.end());
+    }
+
+    FeatureCache featureCache(options.outputPath);
+    featureCache.rhythmOptions = rhythmOptions;
+    featureCache.imageSize = options.imageSize;
+    featureCache.load(); // incremental: unchanged files are restored instead of analysed
+    IngestPipeline ingestPipeline(options.threads, options.imageSize, &featureCache);
+    ingestPipeline.rhythmOptions = rhythmOptions;
+    ingestPipeline.releaseImages = true; // only the features are kept, and cached files are not even decoded
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    Clock::time_point lastProgress = start;
+    std::mutex outputMutex;
+    IndexerStats stats;
+
+    auto elapsedSeconds = [&]() { return std::chrono::duration<double>(Clock::now() - start).count(); };
+    ingestPipeline.onFileDone = [&](const IngestPipeline::FileReport& report) {
+        size_t done = ++stats.done;
+        if (report.cached) stats.cached++;
+        if (!report.loaded) stats.failed++;
+
+        std::lock_guard<std::mutex> lock(outputMutex);
+        if (!report.loaded) {
+            std::cerr << "FAILED " << report.path << ": " << report.failure << std::endl;
+        }
+        if (Clock::now() - lastProgress > std::chrono::seconds(1) || done == paths.size()) {
+            lastProgress = Clock::now();
+            double seconds = elapsedSeconds();
+            double rate = done / std::max(seconds, 1e-3);
+            std::cerr << done << "/" << paths.size() << " files, " << ofToString(rate, 1) << " files/s, "
+                << stats.failed << " failed, " << ofToString((paths.size() - done) / std::max(rate, 1e-3), 0) << " s left" << std::endl;
+        }
+    };
+
+    bool saved = true;
+    FeatureStore columns(32, 32, encoding); // only filled with --columns
+    columns.analysisSettings = FeatureHandler::getAnalysisSettings(rhythmOptions, options.imageSize);
+    std::vector<std::string> columnPaths;
+    for (size_t first = 0; first < paths.size(); first += options.batchSize) {
+        std::vector<std::string> batch(paths.begin() + first, paths.begin() + std::min(paths.size(), first + options.batchSize));
+        std::vector<MediaElement> medias = ingestPipeline.ingest(batch); // without --columns only the cache is kept
+        saved = featureCache.save(false) && saved; // checkpoint
+        if (options.columnsPath.empty()) continue;
+        for (auto& media : medias) {
+            columnPaths.push_back(media.isVideo() ? media.videoPath : media.filePath);
+            columns.add(std::move(media.features));
+        }
+    }
+    if (options.prune) {
+        saved = featureCache.save(true) && saved;
+    }
+    if (!options.columnsPath.empty() && !columns.save(options.columnsPath, columnPaths)) {
+        std::cerr << "Cannot write the feature columns " << options.columnsPath << std::endl;
+        saved = false;
+    }
+
+    double seconds = elapsedSeconds();
+    size_t failed = stats.failed;
+    size_t cached = stats.cached;
+    std::cout << "{\"indexer\":\"FeatureHandler\",\"extractor_version\":" << FeatureHandler::extractorVersion
+        << ",\"cache\":\"" << ofToDataPath(options.outputPath, true) << "\",\"columns\":\""
+        << (options.columnsPath.empty() ? std::string() : ofToDataPath(options.columnsPath, true)) << "\",\"files\":" << paths.size()
+        << ",\"analysed\":" << paths.size() - failed - cached << ",\"cached\":" << cached << ",\"failed\":" << failed
+        << ",\"entries\":" << featureCache.size() << ",\"seconds\":" << seconds
+        << ",\"files_per_s\":" << paths.size() / std::max(seconds, 1e-3) << ",\"threads\":" << ingestPipeline.getNumThreads() << "}" << std::endl;
+
+    if (!saved) {
+        std::cerr << "Cannot write the feature cache " << options.outputPath << std::endl;
+        return 1;
+    }
+    return failed > 0 ? 2 : 0;
+}